@@ -1,11 +1,12 @@
 #ifndef SOURCE_R_PLUS_HPP
 #define SOURCE_R_PLUS_HPP
 
+#include <array>
 #include <assert.h>
 #include <chrono>
-#include <forward_list>
 #include <functional>
 #include <memory>
+#include <queue>
 #include <typeinfo>
 #include <stack>
 #include <stdexcept>
@@ -60,21 +61,35 @@ namespace ads {
     typedef std::logic_error      err_log;
   }
 
+  /*Node_Size whose node fits in a byte budget (ex.: 4096 -> one page, 256 -> four cache lines), one more slot is kept for the overflow.
+    A narrower Coordinate (float, int32_t fixed point) gives more entries per node for the same budget -> a lower tree.
+    The budget must hold the header of the node and 3 entries (Node_Size >= 2 + the overflow slot): a smaller one is an error
+    (a compile error when it's evaluated as a constant, ex.: a template argument) and the answer is never below 2.*/
+  template<std::size_t K_Dimensions, typename Coordinate = double>
+  constexpr std::size_t node_size_for_bytes(std::size_t byte_budget) {
+    constexpr std::size_t header_bytes = 2 * sizeof(std::size_t);
+    constexpr std::size_t entry_bytes = (sizeof(KDRect<K_Dimensions, Coordinate>) + alignof(std::shared_ptr<void>) - 1) /
+      alignof(std::shared_ptr<void>) * alignof(std::shared_ptr<void>) + 2 * sizeof(std::shared_ptr<void>);//the MBR is padded up to the alignment of the pointers that follow it
+    return (byte_budget < header_bytes + 3 * entry_bytes) ?
+      throw err_iar("The byte budget of the node can't hold its header and 3 entries (node size 2 + overflow slot).") :
+      std::max<std::size_t>(2, (byte_budget - header_bytes) / entry_bytes - 1);
+  }
+
   template<std::size_t Node_Size, std::size_t Fill_Factor, typename RData_type, std::size_t K_Dimensions = RData_type::RDimensionality>
   class RPlusTree {
+    static_assert(Node_Size >= 2, "The node size should be at least 2 (see node_size_for_bytes).");
     typedef long double Cost_type;
+    typedef typename RData_type::RCoordinate Coordinate_type;//type of the axis values, given by the container of the records
     typedef typename RData_type::RContainer RContainer_type;
     struct RPNode;
     struct Entry;
 
-    std::function<Cost_type(std::vector<Entry>&, std::size_t, double)> cost_Function_;
-
     struct Entry {
       Entry() {}
 
       Entry(const std::shared_ptr<RData_type> record) {
         record_ = record;
-        mbr_ = record();
+        mbr_ = (*record)();
       }
 
       Entry(const std::shared_ptr<RPNode> son_ptr) {
@@ -88,34 +103,45 @@ namespace ads {
         record_ = other.record_;
       }
 
-      KDRect<K_Dimensions>& get_mbr() const noexcept {
+      Entry& operator=(const Entry& other) = default;
+
+      const KDRect<K_Dimensions, Coordinate_type>& get_mbr() const noexcept {
         return mbr_;
       }
 
+      void enlarge(const KDRect<K_Dimensions, Coordinate_type>& other) {
+        mbr_.enlarge(other);
+      }
+
       std::shared_ptr<RPNode> get_son() const noexcept{
         return son_ptr_;
       }
 
+      std::shared_ptr<RData_type> get_record() const noexcept {
+        return record_;
+      }
+
     private:
-      KDRect<K_Dimensions> mbr_;
+      KDRect<K_Dimensions, Coordinate_type> mbr_;
       std::shared_ptr<RPNode> son_ptr_;
       std::shared_ptr<RData_type> record_;
     };
 
+    /*Node with inline storage: Node_Size entries + one overflow slot in one contiguous array (no heap node per entry), so the scans
+      and the sweeps of the split walk contiguous memory. Use node_size_for_bytes to fit a node in a page or some cache lines.*/
     struct RPNode {
       typedef Entry* iterator;
       typedef const Entry* const_iterator;
 
-      iterator begin() { return fields.begin(); }
+      iterator begin() { return fields_.data(); }
 
-      iterator end() { return last_; }
+      iterator end() { return fields_.data() + size_; }
 
-      const_iterator begin() const { return fields.begin(); }
+      const_iterator begin() const { return fields_.data(); }
 
-      const_iterator end() const { return last_; }
+      const_iterator end() const { return fields_.data() + size_; }
 
       RPNode(std::size_t level = 0) { 
-        last_ = fields.before_begin();
         size_ = 0;
         level_ = level;
       }
@@ -132,36 +158,53 @@ namespace ads {
 
       bool is_overflowed() noexcept { return size_ > Node_Size; }
 
-      void insert(const Entry entry) {
-        last_ = fields.insert_after(last_, entry);
-        ++size_;
+      void insert(const Entry& entry) {
+        Assert_expression(size_ < fields_.size(), err_oor, "The node has no free slot, it should have been split.");
+        fields_[size_++] = entry;
+      }
+
+      //the entry of the given son is built again (its cached MBR changed)
+      void refresh(const std::shared_ptr<RPNode>& son) {
+        for (Entry& field : *this) {
+          if (field.get_son() == son)
+            field = Entry(son);
+        }
       }
 
-      const KDRect<K_Dimensions> calculate_mbr() {
-        KDRect<K_Dimensions> ans;
-        for (Entry& field : fields) {
+      const KDRect<K_Dimensions, Coordinate_type> calculate_mbr() {
+        KDRect<K_Dimensions, Coordinate_type> ans;
+        for (Entry& field : *this) {
           ans.enlarge(field.get_mbr());
         }
         return ans;
       }
 
-      Cost_type sweep(std::vector<Entry>& test_group, std::size_t axis, double& cutline) {
-        std::partial_sort(test_group.begin(), test_group.begin() + Fill_Factor, test_group.end(),
-          [=](Entry one_, Entry another_) {
-          return one_.get_mbr().get_bl()[axis] < another_.get_mbr().get_bl()[axis]; 
+      //the sweep sorts pointers to the entries, the first Fill_Factor ones are the group and its max bound is the cutline
+      Cost_type sweep(std::array<Entry*, Node_Size + 1>& order, std::size_t axis, Coordinate_type& cutline) {
+        std::partial_sort(order.begin(), order.begin() + Fill_Factor, order.begin() + size_,
+          [=](const Entry* one_, const Entry* another_) {
+          return one_->get_mbr().get_bl()[axis] < another_->get_mbr().get_bl()[axis]; 
         });
-        std::vector<Entry> ff_sorted(test_group.begin(), test_group.begin() + Fill_Factor);
-        cutline = (*ff_sorted.end()).get_mbr().get_tr()[axis];
-        return cost_Function_(ff_sorted, axis, cutline);
+        cutline = order[Fill_Factor - 1]->get_mbr().get_tr()[axis];
+        Cost_type cost = 0;//entries crossed by the cutline (each one is a downward split)
+        for (std::size_t idx(0); idx < size_; ++idx) {
+          if (order[idx]->get_mbr().get_bl()[axis] < cutline && order[idx]->get_mbr().get_tr()[axis] > cutline)
+            ++cost;
+        }
+        return cost;
       }
 
-      void find_best_partition(std::size_t& axis, double& cutline) {
+      void find_best_partition(std::size_t& axis, Coordinate_type& cutline) {
         Cost_type min_cost = std::numeric_limits<Cost_type>::max();
-        std::vector<Entry> to_test(fields.begin(), fields.end());
+        std::array<Entry*, Node_Size + 1> to_test;
+        axis = 0;
+        cutline = std::numeric_limits<Coordinate_type>::lowest();//no cutline fits: split by position
+        for (std::size_t idx(0); idx < size_; ++idx)
+          to_test[idx] = &fields_[idx];
         for (std::size_t axis_idx(0); axis_idx < K_Dimensions; ++axis_idx) {
-          double new_cutline;
+          Coordinate_type new_cutline;
           Cost_type new_cost = sweep(to_test, axis_idx, new_cutline);
-          if (new_cost < min_cost) {
+          if (new_cost < min_cost && fits(axis_idx, new_cutline)) {
             axis = axis_idx;
             cutline = new_cutline;
             min_cost = new_cost;
@@ -169,23 +212,58 @@ namespace ads {
         }
       }
 
-      std::shared_ptr<RPNode> split(std::size_t& axis, double& cutline) {
+      //this node keeps the left side (compacted in place), the right side goes to the returned node, the crossed sons are split too
+      std::shared_ptr<RPNode> split(std::size_t axis, Coordinate_type cutline) {
         std::shared_ptr<RPNode> other_half = std::make_shared<RPNode>(level_);
-        std::forward_list<Entry> left_group, right_group;
-        for (Entry& entry : fields) {
-          entry.get_mbr();
+        std::size_t kept(0);
+        if (!fits(axis, cutline)) {//equal bounds or too many crossed sons: the back half moves by position
+          kept = size_ / 2;
+          for (std::size_t idx(kept); idx < size_; ++idx)
+            other_half->insert(fields_[idx]);
+        }
+        else {
+          for (std::size_t idx(0); idx < size_; ++idx) {
+            const KDRect<K_Dimensions, Coordinate_type>& mbr = fields_[idx].get_mbr();
+            if (mbr.get_tr()[axis] <= cutline)
+              fields_[kept++] = fields_[idx];
+            else if (mbr.get_bl()[axis] >= cutline)
+              other_half->insert(fields_[idx]);
+            else {//the son crosses the cutline: downward split
+              std::shared_ptr<RPNode> son_left = fields_[idx].get_son();
+              std::shared_ptr<RPNode> son_right = son_left->split(axis, cutline);
+              fields_[kept++] = Entry(son_left);
+              other_half->insert(Entry(son_right));
+            }
+          }
         }
+        for (std::size_t idx(kept); idx < size_; ++idx)
+          fields_[idx] = Entry();//release the moved sons/records
+        size_ = kept;
         return other_half;
       }
 
     private:
-      std::forward_list<Entry> fields;
-      typename std::forward_list<Entry>::iterator last_;
+      //both sides of the cutline get at least one entry and none overflows (a crossed son goes to both sides)
+      bool fits(std::size_t axis, Coordinate_type cutline) const {
+        std::size_t to_left(0), to_right(0);
+        for (const Entry& field : *this) {
+          to_left += field.get_mbr().get_bl()[axis] < cutline || field.get_mbr().get_tr()[axis] <= cutline;
+          to_right += field.get_mbr().get_tr()[axis] > cutline;
+        }
+        return to_left > 0 && to_right > 0 && to_left <= Node_Size && to_right <= Node_Size;
+      }
+
+      std::array<Entry, Node_Size + 1> fields_;
       std::size_t size_, level_;
     };
     
     std::shared_ptr<RPNode> root_;
   public://public methods
+    //Bytes of one node (compare with the budget given to node_size_for_bytes)
+    static constexpr std::size_t get_node_bytes() {
+      return sizeof(RPNode);
+    }
+
     explicit RPlusTree() {
       Assert_expression(RData_type::check_container_class(), err_iar,
         "The given type for container class can not be used, only KDRect or KDPoint.");
@@ -193,6 +271,8 @@ namespace ads {
         "The given number of dimensions value is too long.");
       Assert_expression(RData_type::RDimensionality > 1, err_oor,
         "The given number of dimensions value should be greater than 1.");
+      Assert_expression(Fill_Factor > 0, err_log,
+        "The given value for fill factor should be greater than zero.");
       Assert_expression(Fill_Factor < Node_Size, err_log,
         "The given value for fill factor should be less than node size's value");
       root_ = std::make_shared<RPNode>();
@@ -205,25 +285,26 @@ namespace ads {
 
     void insert(const RData_type& data) {
       std::stack<std::shared_ptr<RPNode>> ancestors;
-      std::shared_ptr<RPNode> cnode = choose_leaf(data(), ancestors);
+      RData_type record(data);
+      std::shared_ptr<RPNode> cnode = choose_leaf(record(), ancestors);
       std::shared_ptr<RPNode> splitted_node_left, splitted_node_right;
       cnode->insert(Entry(std::make_shared<RData_type>(data)));
       ancestors.push(cnode);
       while (ancestors.top()->is_overflowed()) {
         std::size_t current_axis;
-        double current_cutline;
+        Coordinate_type current_cutline;
         ancestors.top()->find_best_partition(current_axis, current_cutline);
         splitted_node_right = ancestors.top()->split(current_axis, current_cutline);
         splitted_node_left = ancestors.top();
         ancestors.pop();
         if (!ancestors.empty()) {//normal split-insertion operation
-          ancestors.top()->insert(splitted_node_left);
-          ancestors.top()->insert(splitted_node_right);
+          ancestors.top()->refresh(splitted_node_left);
+          ancestors.top()->insert(Entry(splitted_node_right));
         }
         else {//new root by split-insertion operation
-          std::shared_ptr<RPNode> newroot = std::make_shared<RPNode>(root_->get_level());
-          newroot->insert(splitted_node_left);
-          newroot->insert(splitted_node_right);
+          std::shared_ptr<RPNode> newroot = std::make_shared<RPNode>(root_->get_level() + 1);
+          newroot->insert(Entry(splitted_node_left));
+          newroot->insert(Entry(splitted_node_right));
           root_ = newroot;
           return;
         }
@@ -233,32 +314,63 @@ namespace ads {
     void assign(const std::vector<RData_type>& data_set) {
       std::chrono::time_point<std::chrono::high_resolution_clock> start_time, end_time;
       start_time = std::chrono::high_resolution_clock::now();
-      for (RData_type& data : data_set) {
+      for (const RData_type& data : data_set) {
         insert(data);
       }
       end_time = std::chrono::high_resolution_clock::now();
     }
 
-    std::vector<RData_type> knn_query(std::size_t k, KDPoint<K_Dimensions> center) {
-      std::chrono::time_point<std::chrono::high_resolution_clock> start_time, end_time;
-      start_time = std::chrono::high_resolution_clock::now();
-      //query
-      end_time = std::chrono::high_resolution_clock::now();
-
+    //k nearest records to center, nearest first: best first search of the entries by MINDIST (the MBR of a record is its point)
+    std::vector<RData_type> knn_query(std::size_t k, KDPoint<K_Dimensions, Coordinate_type> center) {
+      typedef std::pair<Cost_type, const Entry*> Candidate;
+      std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> best_first;
+      std::vector<RData_type> answer;
+      for (const Entry& entry : *root_)
+        best_first.push(Candidate(mindist(entry.get_mbr(), center), &entry));
+      while (answer.size() < k && !best_first.empty()) {
+        const Entry* closest = best_first.top().second;
+        best_first.pop();
+        if (closest->get_record()) {
+          answer.push_back(*closest->get_record());
+          continue;
+        }
+        for (const Entry& entry : *closest->get_son())
+          best_first.push(Candidate(mindist(entry.get_mbr(), center), &entry));
+      }
+      return answer;
     }
 
   private://private methods
+    //squared distance from the point to the nearest point of the rectangle (0 inside), same order as the distance
+    static Cost_type mindist(const KDRect<K_Dimensions, Coordinate_type>& rect, const KDPoint<K_Dimensions, Coordinate_type>& point) {
+      Cost_type sum = 0;
+      for (std::size_t idx(0); idx < K_Dimensions; ++idx) {
+        Cost_type gap = 0;
+        if (point[idx] < rect.get_bl()[idx])
+          gap = Cost_type(rect.get_bl()[idx]) - Cost_type(point[idx]);
+        else if (point[idx] > rect.get_tr()[idx])
+          gap = Cost_type(point[idx]) - Cost_type(rect.get_tr()[idx]);
+        sum += gap * gap;
+      }
+      return sum;
+    }
+
     std::shared_ptr<RPNode> choose_leaf(const RContainer_type& val_container,
                                 std::stack<std::shared_ptr<RPNode>>& ancestors_path) {
-      std::shared_ptr<RPNode> cnode = root;
+      std::shared_ptr<RPNode> cnode = root_;
+      KDRect<K_Dimensions, Coordinate_type> val_mbr;
+      val_mbr = val_container;
       while (!cnode->is_leaf()) {
         ancestors_path.push(cnode);
         std::shared_ptr<RPNode> temp = cnode;
-        for (Entry& entry : temp) {
-          cnode = entry.get_son();
+        Entry* chosen = nullptr;
+        for (Entry& entry : *temp) {
+          chosen = &entry;
           if (entry.get_mbr().overlaps(val_container))
             break;
         }
+        chosen->enlarge(val_mbr);//the cached MBRs of the path must cover the new data
+        cnode = chosen->get_son();
       }
       return cnode;
     }
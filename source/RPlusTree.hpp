@@ -1,52 +1,79 @@
-#include <rplus_utils.hpp>
+#ifndef SOURCE_RPLUS_TREE_HPP
+#define SOURCE_RPLUS_TREE_HPP
 
-#define GET_BOUNDARIES(entry) entry.get_mbr().get_boundaries()
+#include <rplus_utils.hpp>
+#include <rplus_frozen.hpp>
+#include <rplus_parallel.hpp>
+#include <rplus_trace.hpp>
 
-/*Comment VISUALIZE_INSERT_COUNT if you don't want to see the insert counter ex.: [STEP] : 151623
-                                                                                  [STEP] : 151624
-                                                                                  [STEP] : 151625
-                                                                                  [STEP] : 151626
-                                                                                  [STEP] : 151627
-                                                                                  ...
-*/
-#define VISUALIZE_INSERT_COUNT
+#define ENTRY_LOW(entry, axis) entry.get_mbr().get_bottom_left()[axis]
+#define ENTRY_HIGH(entry, axis) entry.get_mbr().get_top_right()[axis]
 
 //Comment NON_REPEATED_SONGS if you want repeated songs by the id(this case is "name"), by default commented because this is a R+Tree for points, not for shapes with volume
+//With NON_REPEATED_SONGS a data whose id is already in the R+ is dropped by assign (id index), so the queries never see repeated songs
 
 //#define NON_REPEATED_SONGS
 
+#define JOIN_FLUSH_SIZE 1024//Pairs kept by each join worker before streaming them to the sink
+#define BUFFER_LEAF_FILL 0.75//Fill of the leaves cut from a flushed batch (room for the next batches before a new cut)
+
+//Comment RPLUS_ATTRIBUTE_SUMMARIES if the filtered queries (AttributePredicate) are rare: without the min/max of the attributes in
+//each node the predicate only drops data in the leaves (no subtree is pruned) and the nodes are a bit smaller
+
+#define RPLUS_ATTRIBUTE_SUMMARIES
+
+//Comment RPLUS_SIBLING_REDISTRIBUTION if each overflow in the insertion must split the node at once (old behavior). With it an
+//overflowed node first gives entries to a sibling with free slots that is beside it in some axis (no new overlap), so the split
+//and its downward cuts only happen when the neighbours are full
+
+#define RPLUS_SIBLING_REDISTRIBUTION
+
 //##########################################################################################################################################################################
 
 /*TEMPLATE PARAMETERS: (1)data type | (2)number of dimensions | (3)max entries per node | (4)fill factor(by default = 2)
+                      | (5)distance policy(by default = L2Metric, also L1Metric and LInfMetric)
+                      | (6)payload of the hyperpoints(by default = SongAttributes, the attribute predicates only filter this one)
   Contains: Node, Entry, comparators(ENTRYSINGLEDIM, ENTRYDIST).
   Approach: P R+ Tree (Point R+ Tree non packed) - insertion 1x1 - knn query and range query using queues and stacks.
   Features: No overlap (geometric and by saturation propagated splits), structure to store hyperpoints, non repeatable data (because this structure store points).
   Link: https://github.com/italoucsp/RPlus-Tree_Proyecto-Final.
   Why not pack algorithm?: too (a lot) slow at first for entries more than 10k, Time Complexity: O(n^2/k log ff) aprox.
                            But samely I have the code with pack algorithm (github link -> "garbage.txt").
-  Operations that you are able to do: assign(insert,"1x1"), range query(search), k-nearest neighbors query(kNN_query).
+  Operations that you are able to do: assign(insert,"1x1" or buffered), erase, update, range query(search, parallel_search), k-nearest neighbors query(kNN_query, approximate_kNN_query, incremental_kNN),
+                                     filtered range/kNN queries(search and kNN_query with an AttributePredicate), skyline,
+                                     joins(similarity_join, kNN_join), all kNN graph(all_kNN_graph),
+                                     read-only compact copy(freeze), rebuild of degraded subtrees(repack).
   REFERENCES:
      1.PAPER R+: T. Sellis, N. Roussopoulos, C. Faloutsos, "The R+ Tree A Dinamic Index For Multi-dimensional Objects"
                  Department of Computer Science University of Maryland College Park, MD 20742
      2.PAPER KNN: A. Papadopoulos, Y. Manolopoulos, "Performance of Nearest Neighbor Queries in R-trees *",
                  Department of Informatics Aristotle University - 54006 Thessaloniki , Greece
 */
-template<typename T, size_t N, size_t M, size_t ff = 2>
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+class AsyncRPlus;
+
+template<typename T, size_t N, size_t M, size_t ff = 2, typename Metric = L2Metric, typename Payload = SongAttributes>
 class RPlus {
+  friend class AsyncRPlus<T, N, M, ff, Metric>;//reports the errors of the queries (checked_search, checked_kNN_query) in the futures
+
 private:
   struct Node;
 
   struct Entry {
-    HyperPoint<T, N> data;
+    HyperPoint<T, N, Payload> data;//key of the R+ (normalized with normalized axes), don't change it after the construction, the cached MBR is built from it
     shared_ptr<Node> child;
+    shared_ptr<const array<T, N>> original;//only with normalized axes: the coordinates as they were given, the answers return them
 
     Entry();
-    Entry(shared_ptr<Node> &child);
-    Entry(HyperPoint<T, N> &data);
-    HyperRectangle<T, N> get_mbr();
-    Entry& operator=(const Entry &other);
-    bool is_in_leaf();
+    Entry(const shared_ptr<Node> &child);
+    Entry(HyperPoint<T, N, Payload> &data);
+    Entry(const HyperPoint<T, N, Payload> &given_data, const AxisNormalization<T, N> &normalization);
+    HyperPoint<T, N, Payload> get_data() const;
+    const HyperRectangle<T, N>& get_mbr() const;
+    bool is_in_leaf() const;
     void show_entry(size_t index);
+  private:
+    HyperRectangle<T, N> mbr;//cached MBR (0 volume) of the data in leaves, the internal entries use the MBR of their child
   };
 
   struct comparator_ENTRYSINGLEDIM {
@@ -54,20 +81,20 @@ private:
     comparator_ENTRYSINGLEDIM(size_t axis) {
       this->axis = axis;
     }
-    bool operator() (Entry &A, Entry &B) {
-      return (GET_BOUNDARIES(A).first[axis] < GET_BOUNDARIES(B).first[axis]);
+    bool operator() (const Entry *A, const Entry *B) {
+      return (ENTRY_LOW((*A), axis) < ENTRY_LOW((*B), axis));
     }
   };
 
   struct ENTRYDIST {
     double distance;//Priority criteria
     Entry entry;//Object for the queue
-    ENTRYDIST(HyperPoint<T, N> &p, Entry &md_obj) {
+    ENTRYDIST(HyperPoint<T, N, Payload> &p, Entry &md_obj) {
       entry = md_obj;
-      if (md_obj.get_mbr().get_hypervolume() > 0)
+      if (!md_obj.is_in_leaf())
         distance = RPlus::MINDIST(p, md_obj.get_mbr());//ref(PAPER KNN): page 5, rule 3, line 5 to 7 - Roussopoulos et al. suggest that when the overlap is small...
       else
-        distance = RPlus::EUCDIST(p, md_obj.data);//If the entry is in leaf, then use euclidean distance because the distance is now between hyperpoints
+        distance = RPlus::DIST(p, md_obj.data);//If the entry is in leaf, then use the metric's distance because the distance is now between hyperpoints
     }
   };
 
@@ -78,14 +105,21 @@ private:
   };
 
   struct Node {
-    HyperRectangle<T, N> mbr;
+    HyperRectangle<T, N> mbr;//covers the entries and the pending entries
+#ifdef RPLUS_ATTRIBUTE_SUMMARIES
+    AttributeSummary summary;//attributes of the entries and the pending entries, like mbr
+#endif
     vector<Entry> entries;
+    vector<Entry> pending;//buffered insertion: data waiting to be pushed down to the children (only internal nodes)
     bool is_leaf();
 
     Node();
     Entry& operator[](size_t index);
+    size_t data_count();
+    Entry& data_entry(size_t index);
     void add(Entry &new_entry);
     void add(vector<Entry> &S);
+    void cover(Entry &entry);
     size_t get_size();
     void resize(size_t new_size);
     void print_node(bool rp_root = false);
@@ -93,33 +127,127 @@ private:
     size_t size;
   };
 
-  shared_ptr<Node> root;
+  struct JoinTask {
+    shared_ptr<Node> A, B;
+    bool same;//node joined with itself (self join), each pair only once
+  };
+
+  struct RepackJob {
+    vector<size_t> path;//index of the entry at each level, from the root to the subtree
+    Node *subtree;
+    size_t height;
+    double utilization;
+    size_t nodes;
+    vector<Entry> data;//data of the leaves and buffers of the subtree, copied before the rebuild
+    shared_ptr<Node> packed;
+    size_t packed_nodes;
+  };
+
+  struct SubtreeShape {
+    size_t data, leaves, nodes;
+  };
+
+  typedef vector<tuple<string, string, double>> JoinBuffer;
+  typedef tuple<double, Node *, size_t> LeafNeighbor;//(distance, node, index of its data: see Node::data_entry)
+
+  shared_ptr<Node> root;//every read-only method takes it once with get_root, a repack publishes a new one with an atomic store
+  size_t version;//changes with every write, a repack isn't published if the tree changed while it was rebuilt
+
+  size_t buffer_capacity;
+  IdIndex<Node *> id_index;//id of each data -> leaves (or nodes with the buffer) that keep its copies
 
   void insert(Entry &entry);
+  void buffered_insert(Entry &entry);
+  void empty_buffer(shared_ptr<Node> &node, bool whole_subtree = false);
+  void split_overflowed_children(shared_ptr<Node> &node);
+  void split_leaf_in_bulk(shared_ptr<Node> &A, vector<shared_ptr<Node>> &parts);
+  void split_in_halves(shared_ptr<Node> &A, vector<shared_ptr<Node>> &parts);
+  void grow_root_if_overflowed();
+  void move_pending(shared_ptr<Node> &from, shared_ptr<Node> &to);
+  void index_data(vector<Entry> &S, Node *from, Node *to);
+  bool erase_from(Node *location, HyperPoint<T, N, Payload> &data);
+  static Entry *entry_of(Node &node, const string &id);
+  bool contains_id(const string &id);
+  static bool same_data(HyperPoint<T, N, Payload> &A, HyperPoint<T, N, Payload> &B);
   shared_ptr<Node> choose_leaf(Entry &entry, stack<shared_ptr<Node>> &parents);
+  size_t choose_child(shared_ptr<Node> &node, HyperPoint<T, N, Payload> &data);
   shared_ptr<Node> split_by_parent_cut(shared_ptr<Node> &A, size_t axis, T optimal_cutline);
   shared_ptr<Node> split_by_saturation(shared_ptr<Node> &A);
+  bool redistribute(shared_ptr<Node> &A, shared_ptr<Node> &parent);
   inline void partition(shared_ptr<Node> &danger_node, size_t &optimal_dim, T &optimal_cutline);
-  inline pair<double, T> sweep(size_t axis, vector<Entry> &S);
-  inline int min_number_splits(vector<Entry> &test_set, size_t axis, T optimal_cutline);
-  inline void push_node_in_queue(HyperPoint<T, N> refdata, shared_ptr<Node> &current, priority_queue<ENTRYDIST, vector<ENTRYDIST>, comparator_ENTRYDIST> &q_NN);
-  static double MINDIST(HyperPoint<T, N> p, HyperRectangle<T, N> r);
-  static double EUCDIST(HyperPoint<T, N> p1, HyperPoint<T, N> p2);
+  inline pair<double, T> sweep(size_t axis, vector<Entry *> &S);
+  inline int min_number_splits(vector<Entry *> &S, size_t axis, T optimal_cutline);
+  static bool separates(vector<Entry *> &S, size_t axis, T cutline);
+  vector<HyperPoint<T, N, Payload>> checked_search(const HyperRectangle<T, N> &W, const AttributePredicate &predicate, QueryControl *control);
+  vector<HyperPoint<T, N, Payload>> checked_kNN_query(HyperPoint<T, N, Payload> refdata, size_t k, const AttributePredicate &predicate, QueryControl *control);
+  void search_subtree(shared_ptr<Node> start, const HyperRectangle<T, N> &W, vector<HyperPoint<T, N, Payload>> &range_query, QueryControl *control = nullptr,
+                      const AttributePredicate *predicate = nullptr);
+  static void search_pending(shared_ptr<Node> &current, const HyperRectangle<T, N> &W, vector<HyperPoint<T, N, Payload>> &range_query,
+                             const AttributePredicate *predicate = nullptr);
+  static const AttributePredicate *filter_of(const AttributePredicate &predicate);
+  static inline bool passes(Entry &entry, const AttributePredicate *predicate);
+  inline void push_node_in_queue(HyperPoint<T, N, Payload> refdata, shared_ptr<Node> &current, priority_queue<ENTRYDIST, vector<ENTRYDIST>, comparator_ENTRYDIST> &q_NN,
+                                 const AttributePredicate *predicate = nullptr);
+  void join_nodes(JoinTask &task, double epsilon, JoinBuffer &buffer, const JoinSink &emit, mutex &emit_lock);
+  void for_each_join_pair(JoinTask &task, double epsilon, const function<void(JoinTask)> &visit);
+  void join_pending(JoinTask &task, double epsilon, JoinBuffer &buffer, const JoinSink &emit, mutex &emit_lock);
+  void join_buffered(Node &buffered, Node &subtree, bool buffered_left, double epsilon, JoinBuffer &buffer);
+  static void flush_join_buffer(JoinBuffer &buffer, const JoinSink &emit, mutex &emit_lock);
+  void leaf_kNN(Node &start, Node &group, size_t k, bool self, vector<vector<LeafNeighbor>> &neighbors);
+  static void collect_data_nodes(shared_ptr<Node> start, vector<shared_ptr<Node>> &data_nodes);
+  shared_ptr<Node> get_root();
+  SubtreeShape find_degraded(shared_ptr<Node> &node, size_t height, vector<size_t> &path, const RepackPolicy &policy, size_t leaf_capacity,
+                             vector<RepackJob> &jobs);
+  static double dead_space(Node &node);
+  static void collect_entries(Node &node, vector<Entry> &S);
+  shared_ptr<Node> pack(vector<Entry> &S, size_t begin, size_t end, size_t height, size_t leaf_capacity, size_t &nodes);
+  static void pack_groups(vector<Entry> &S, size_t begin, size_t end, size_t groups, size_t group_capacity, vector<size_t> &cuts);
+  bool publish(RepackJob &job);
+  vector<HyperPoint<T, N, Payload>> branch_and_bound_skyline(const array<SkylinePreference, N> &preferences, const HyperRectangle<T, N> *W,
+                                                    const function<void(const HyperPoint<T, N, Payload> &)> &emit);
+  static bool dominates(const HyperPoint<T, N, Payload> &A, const array<T, N> &B, const array<SkylinePreference, N> &preferences);
+  static inline double MINDIST(const HyperPoint<T, N, Payload> &p, const HyperRectangle<T, N> &r);
+  static inline double MINDIST(const HyperRectangle<T, N> &r1, const HyperRectangle<T, N> &r2);
+  static inline double DIST(const HyperPoint<T, N, Payload> &p1, const HyperPoint<T, N, Payload> &p2);
+
+  AxisNormalization<T, N> normalization;
+  bool normalized_axes;
 
 public:
   RPlus();
   virtual ~RPlus();
-  void assign(vector<HyperPoint<T, N>> &unpacked_data);
-  vector<HyperPoint<T, N>> search(const HyperRectangle<T, N> &W);
-  vector<HyperPoint<T, N>> kNN_query(HyperPoint<T, N> refdata, size_t k);
+  void set_normalization(const AxisNormalization<T, N> &axes_normalization);
+  void set_insertion_buffer(size_t capacity);
+  void flush_insertion_buffers();
+  void assign(vector<HyperPoint<T, N, Payload>> &unpacked_data);
+  bool erase(HyperPoint<T, N, Payload> data);
+  bool get_by_id(const string &id, HyperPoint<T, N, Payload> &data);
+  bool update(HyperPoint<T, N, Payload> old_data, HyperPoint<T, N, Payload> new_data);
+  vector<HyperPoint<T, N, Payload>> get_all_data();
+  vector<HyperPoint<T, N, Payload>> search(const HyperRectangle<T, N> &W, QueryControl *control = nullptr);
+  vector<HyperPoint<T, N, Payload>> search(const HyperRectangle<T, N> &W, const AttributePredicate &predicate, QueryControl *control = nullptr);
+  vector<HyperPoint<T, N, Payload>> parallel_search(const HyperRectangle<T, N> &W, size_t n_threads = thread::hardware_concurrency());
+  vector<vector<HyperPoint<T, N, Payload>>> batch_search(const vector<HyperRectangle<T, N>> &windows);
+  vector<HyperPoint<T, N, Payload>> kNN_query(HyperPoint<T, N, Payload> refdata, size_t k, QueryControl *control = nullptr);
+  vector<HyperPoint<T, N, Payload>> kNN_query(HyperPoint<T, N, Payload> refdata, size_t k, const AttributePredicate &predicate, QueryControl *control = nullptr);
+  vector<HyperPoint<T, N, Payload>> approximate_kNN_query(HyperPoint<T, N, Payload> refdata, size_t k, const KNNBudget &budget, KNNReport &report);
+  void incremental_kNN(HyperPoint<T, N, Payload> refdata, const function<bool(const HyperPoint<T, N, Payload> &, double)> &visit);
+  vector<HyperPoint<T, N, Payload>> skyline(const array<SkylinePreference, N> &preferences, const function<void(const HyperPoint<T, N, Payload> &)> &emit = nullptr);
+  vector<HyperPoint<T, N, Payload>> skyline(const array<SkylinePreference, N> &preferences, const HyperRectangle<T, N> &W,
+                                   const function<void(const HyperPoint<T, N, Payload> &)> &emit = nullptr);
+  void similarity_join(RPlus &other, double epsilon, const JoinSink &emit, size_t n_threads = thread::hardware_concurrency());
+  void kNN_join(RPlus &other, size_t k, const JoinSink &emit, size_t n_threads = thread::hardware_concurrency());
+  KNNGraph all_kNN_graph(size_t k, size_t n_threads = thread::hardware_concurrency());
+  FrozenRPlus<T, N, Metric> freeze(size_t leaf_bits = 0, size_t child_bits = 0);
+  RepackReport repack(const RepackPolicy &policy = RepackPolicy(), mutex *write_lock = nullptr);
   void read_tree();
 };
 
 //===============================R-PLUS-TREE-IMPLEMENTATION============================================
 
 //BUILDER RPLUS: Create empty root
-template<typename T, size_t N, size_t M, size_t ff>
-RPlus<T, N, M, ff>::RPlus() {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+RPlus<T, N, M, ff, Metric, Payload>::RPlus() {
   try {
     vector<Entry> temp;
     if (N < 2 || M < 2 || M > temp.max_size()) {
@@ -130,6 +258,9 @@ RPlus<T, N, M, ff>::RPlus() {
     }
     else {
       root = make_shared<Node>();
+      version = 0;
+      normalized_axes = false;
+      buffer_capacity = 0;
     }
   }
   catch (const exception &error) {
@@ -139,46 +270,162 @@ RPlus<T, N, M, ff>::RPlus() {
 }
 
 //DESTROYER RPLUS: Simple class destroyer
-template<typename T, size_t N, size_t M, size_t ff>
-RPlus<T, N, M, ff>::~RPlus() {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+RPlus<T, N, M, ff, Metric, Payload>::~RPlus() {
   root.reset();
 }
 
-//RANGE QUERY METHOD: Give an hyperrectangle W and get the entries that overlaps with it.
-template<typename T, size_t N, size_t M, size_t ff>
-vector<HyperPoint<T, N>> RPlus<T, N, M, ff>::search(const HyperRectangle<T, N> &W) {
+/*RANGE QUERY METHOD: Give an hyperrectangle W and get the entries that overlaps with it.
+                     With a control, the dfs stops when the query is cancelled or late (partial answer, control->interrupted).*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::search(const HyperRectangle<T, N> &W, QueryControl *control) {
+  return search(W, AttributePredicate(), control);
+}
+
+/*FILTERED RANGE QUERY METHOD: The data in W whose attributes match the predicate. The subtrees whose summary can't match are
+                              pruned like the ones out of W (RPLUS_ATTRIBUTE_SUMMARIES), so the filter isn't applied after the query.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::search(const HyperRectangle<T, N> &W, const AttributePredicate &predicate, QueryControl *control) {
+  try {
+    return checked_search(W, predicate, control);
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//--CHECKED SEARCH: the filtered range query, its errors are thrown to the caller (search ends the process with them)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::checked_search(const HyperRectangle<T, N> &W, const AttributePredicate &predicate, QueryControl *control) {
+  TRACE_SPAN("search")
+  shared_ptr<Node> current_root = get_root();
+  if (!current_root)
+    throw runtime_error(ERROR_EMPTY_TREE);
+  vector<HyperPoint<T, N, Payload>> range_query;
+  search_subtree(current_root, (normalized_axes) ? normalization.apply(W) : W, range_query, control, filter_of(predicate));
+  return range_query;
+}
+
+/*PARALLEL RANGE QUERY METHOD: Same answer as search, but for wide windows. The top levels are expanded breadth first and every
+                               overlapping subtree becomes a task for a work stealing pool, each worker collects in its own buffer
+                               and the buffers are concatenated at the end. Narrow windows stay single-threaded.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::parallel_search(const HyperRectangle<T, N> &query_window, size_t n_threads) {
+  TRACE_SPAN("parallel_search")
+  try {
+    shared_ptr<Node> current_root = get_root();
+    if (!current_root) {
+      throw runtime_error(ERROR_EMPTY_TREE);
+    }
+    else {
+      HyperRectangle<T, N> W = (normalized_axes) ? normalization.apply(query_window) : query_window;
+      vector<HyperPoint<T, N, Payload>> range_query;
+      vector<shared_ptr<Node>> frontier(1, current_root);
+      bool internal_frontier = !current_root->is_leaf();
+      //expand (single-threaded) until there are enough subtrees to share or the leaves are reached
+      while (internal_frontier && frontier.size() < max(n_threads, size_t(PARALLEL_MIN_SUBTREES))) {
+        vector<shared_ptr<Node>> next_frontier;
+        internal_frontier = false;
+        for (shared_ptr<Node> &current : frontier) {
+          search_pending(current, W, range_query);
+          for (size_t i(0); i < current->get_size(); ++i) {
+            if ((*current)[i].get_mbr().overlaps(W)) {
+              if (current->is_leaf())
+                range_query.push_back((*current)[i].get_data());
+              else {
+                next_frontier.push_back((*current)[i].child);
+                internal_frontier = internal_frontier || !(*current)[i].child->is_leaf();
+              }
+            }
+          }
+        }
+        frontier.swap(next_frontier);
+      }
+      if (n_threads < 2 || frontier.size() < PARALLEL_MIN_SUBTREES) {//small query -> plain dfs
+        for (shared_ptr<Node> &subtree : frontier)
+          search_subtree(subtree, W, range_query);
+      }
+      else {
+        WorkStealingScheduler<shared_ptr<Node>> scheduler(n_threads);
+        vector<vector<HyperPoint<T, N, Payload>>> local_buffers(scheduler.get_workers());
+        scheduler.run(frontier, [&](shared_ptr<Node> &current, size_t worker_id, function<void(shared_ptr<Node>)> &spawn) {
+          if (current->is_leaf() || (*current)[0].child->is_leaf()) {//last internal level -> scan it here
+            search_subtree(current, W, local_buffers[worker_id]);
+            return;
+          }
+          search_pending(current, W, local_buffers[worker_id]);
+          for (size_t i(0); i < current->get_size(); ++i) {
+            if ((*current)[i].get_mbr().overlaps(W))
+              spawn((*current)[i].child);
+          }
+        });
+        for (vector<HyperPoint<T, N, Payload>> &buffer : local_buffers)
+          range_query.insert(range_query.end(), buffer.begin(), buffer.end());
+      }
+      return range_query;
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+/*BATCH RANGE QUERY METHOD: Same answers as one search per window (answer i for windows[i]), with a shared traversal. Each node of
+                            the dfs carries the ids of the windows that still overlap it, every child MBR is tested against those
+                            ids in one pass and only the surviving ids go down, so each node is read at most once per batch
+                            (the upper levels are read once for the whole batch, not once per window).
+                            The id lists of the dfs live in one stack-like buffer: the ids of the node on top are always at its end.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<vector<HyperPoint<T, N, Payload>>> RPlus<T, N, M, ff, Metric, Payload>::batch_search(const vector<HyperRectangle<T, N>> &windows) {
+  TRACE_SPAN("batch_search")
   try {
-    if (!root) {
+    shared_ptr<Node> current_root = get_root();
+    if (!current_root) {
       throw runtime_error(ERROR_EMPTY_TREE);
     }
     else {
-      vector<HyperPoint<T, N>> range_query;
-      unordered_set<string> songs_names;
-      stack<shared_ptr<Node>> dfs_s;
-      dfs_s.push(root);
+      vector<vector<HyperPoint<T, N, Payload>>> range_queries(windows.size());
+      vector<HyperRectangle<T, N>> W;
+      W.reserve(windows.size());
+      for (const HyperRectangle<T, N> &window : windows)
+        W.push_back((normalized_axes) ? normalization.apply(window) : window);
+      vector<uint32_t> active_ids, current_ids;
+      stack<pair<Node *, size_t>> dfs_s;//(node, offset of its ids in active_ids)
+      for (uint32_t id(0); id < uint32_t(W.size()); ++id)
+        active_ids.push_back(id);
+      dfs_s.push(make_pair(current_root.get(), size_t(0)));
       while (!dfs_s.empty()) {
-        shared_ptr<Node> current = dfs_s.top();
+        Node &current = *dfs_s.top().first;
+        current_ids.assign(active_ids.begin() + dfs_s.top().second, active_ids.end());
+        active_ids.resize(dfs_s.top().second);
         dfs_s.pop();
-        for (size_t i(0); i < current->get_size(); ++i) {
-          if ((*current)[i].get_mbr().overlaps(W)) {
-            if (!current->is_leaf())
-              dfs_s.push((*current)[i].child);
-            else {
-#ifdef NON_REPEATED_SONGS
-              size_t temp_songs_names_size = songs_names.size();
-              //try pick data
-              songs_names.insert((*current)[i].data.get_songs_name());
-              if (temp_songs_names_size != songs_names.size())
-                range_query.push_back((*current)[i].data);
-              //end try
-#else
-              range_query.push_back((*current)[i].data);
-#endif // NON_REPEATED_SONGS
+        for (Entry &entry : current.pending) {
+          for (uint32_t id : current_ids) {
+            if (entry.get_mbr().overlaps(W[id]))
+              range_queries[id].push_back(entry.get_data());
+          }
+        }
+        for (size_t i(0); i < current.get_size(); ++i) {
+          const HyperRectangle<T, N> &child_mbr = current[i].get_mbr();
+          if (current.is_leaf()) {
+            for (uint32_t id : current_ids) {
+              if (child_mbr.overlaps(W[id]))
+                range_queries[id].push_back(current[i].get_data());
             }
+            continue;
           }
+          size_t offset = active_ids.size();
+          for (uint32_t id : current_ids) {
+            if (child_mbr.overlaps(W[id]))
+              active_ids.push_back(id);
+          }
+          if (active_ids.size() > offset)
+            dfs_s.push(make_pair(current[i].child.get(), offset));
         }
       }
-      return range_query;
+      return range_queries;
     }
   }
   catch (const exception &error) {
@@ -187,38 +434,221 @@ vector<HyperPoint<T, N>> RPlus<T, N, M, ff>::search(const HyperRectangle<T, N> &
   }
 }
 
+//--SEARCH SUBTREE: dfs from a given node, appends the data that overlaps with W--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::search_subtree(shared_ptr<Node> start, const HyperRectangle<T, N> &W, vector<HyperPoint<T, N, Payload>> &range_query, QueryControl *control,
+                                                const AttributePredicate *predicate) {
+  stack<shared_ptr<Node>> dfs_s;
+  dfs_s.push(start);
+  while (!dfs_s.empty()) {
+    if (control && control->stopped()) {
+      control->interrupted = true;
+      return;
+    }
+    shared_ptr<Node> current = dfs_s.top();
+    dfs_s.pop();
+    search_pending(current, W, range_query, predicate);
+    for (size_t i(0); i < current->get_size(); ++i) {
+      if ((*current)[i].get_mbr().overlaps(W) && passes((*current)[i], predicate)) {
+        if (!current->is_leaf())
+          dfs_s.push((*current)[i].child);
+        else
+          range_query.push_back((*current)[i].get_data());
+      }
+    }
+  }
+}
+
+//--SEARCH PENDING: buffered data of a node that overlaps with W (and matches the predicate)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::search_pending(shared_ptr<Node> &current, const HyperRectangle<T, N> &W, vector<HyperPoint<T, N, Payload>> &range_query,
+                                                const AttributePredicate *predicate) {
+  for (Entry &entry : current->pending) {
+    if (entry.get_mbr().overlaps(W) && passes(entry, predicate))
+      range_query.push_back(entry.get_data());
+  }
+}
+
+//--FILTER OF: the predicate to push down (nullptr if it accepts every song), only the song attributes can be filtered--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+const AttributePredicate *RPlus<T, N, M, ff, Metric, Payload>::filter_of(const AttributePredicate &predicate) {
+  if (predicate.accepts_all())
+    return nullptr;
+  if (!is_same<Payload, SongAttributes>::value)
+    throw runtime_error(ERROR_PREDICATE_PAYLOAD);
+  return &predicate;
+}
+
+//--PASSES: without predicate always, a data if it matches, a subtree if its summary may match (always without summaries)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::passes(Entry &entry, const AttributePredicate *predicate) {
+  if constexpr (is_same<Payload, SongAttributes>::value) {
+    if (!predicate)
+      return true;
+    if (entry.is_in_leaf())
+      return predicate->matches(entry.data.get_attributes());
+#ifdef RPLUS_ATTRIBUTE_SUMMARIES
+    return predicate->may_match(entry.child->summary);
+#else
+    return true;
+#endif
+  }
+  else
+    return true;//filter_of never gives a predicate for other payloads
+}
+
 /*KNN METHOD: k-Nearest Neighbors query using branch and bound algorithm with MINDIST function.
-  ref(PAPER KNN) */
-template<typename T, size_t N, size_t M, size_t ff>
-vector<HyperPoint<T, N>> RPlus<T, N, M, ff>::kNN_query(HyperPoint<T, N> refdata, size_t k) {
+  ref(PAPER KNN)
+  With a control, the search stops before expanding a node when the query is cancelled or late (the nearest found so far).*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::kNN_query(HyperPoint<T, N, Payload> refdata, size_t k, QueryControl *control) {
+  return kNN_query(refdata, k, AttributePredicate(), control);
+}
+
+/*FILTERED KNN METHOD: The k nearest data whose attributes match the predicate, in one pass. The entries that can't match never
+                      enter the queue (data by its attributes, subtrees by their summary), so no result is fetched to be dropped.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::kNN_query(HyperPoint<T, N, Payload> refdata, size_t k, const AttributePredicate &predicate, QueryControl *control) {
+  try {
+    return checked_kNN_query(refdata, k, predicate, control);
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+/*--CHECKED KNN QUERY: the filtered kNN, its errors are thrown to the caller (kNN_query ends the process with them). The answer
+                       grows with the data found, so a k larger than the tree costs nothing--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::checked_kNN_query(HyperPoint<T, N, Payload> refdata, size_t k, const AttributePredicate &predicate,
+                                                                       QueryControl *control) {
+  TRACE_SPAN("kNN_query")
+  shared_ptr<Node> current_root = get_root();
+  if (!current_root)
+    throw runtime_error(ERROR_EMPTY_TREE);
+  priority_queue<ENTRYDIST, vector<ENTRYDIST>, comparator_ENTRYDIST> best_branchs_queue;
+  vector<HyperPoint<T, N, Payload>> kNN;
+  const AttributePredicate *filter = filter_of(predicate);
+  if (normalized_axes)
+    normalization.apply(refdata);
+  push_node_in_queue(refdata, current_root, best_branchs_queue, filter);
+  while (kNN.size() < k && !best_branchs_queue.empty()) {
+    ENTRYDIST closest_entry = best_branchs_queue.top();
+    best_branchs_queue.pop();
+    if (!closest_entry.entry.is_in_leaf()) {
+      if (control && control->stopped()) {
+        control->interrupted = true;
+        break;
+      }
+      push_node_in_queue(refdata, closest_entry.entry.child, best_branchs_queue, filter);
+    }
+    else
+      kNN.push_back(closest_entry.entry.get_data());
+  }
+  return kNN;
+}
+
+/*INCREMENTAL KNN METHOD: The data in increasing distance to refdata (distance browsing), one by one, until visit returns false or
+                         every data was given. The queue stays between the visits, so k isn't chosen beforehand and no data is read
+                         twice. The distance given with each data is the one between the keys (normalized with normalized axes).*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::incremental_kNN(HyperPoint<T, N, Payload> refdata, const function<bool(const HyperPoint<T, N, Payload> &, double)> &visit) {
+  TRACE_SPAN("incremental_kNN")
   try {
-    if (!root) {
+    shared_ptr<Node> current_root = get_root();
+    if (!current_root) {
       throw runtime_error(ERROR_EMPTY_TREE);
     }
     else {
       priority_queue<ENTRYDIST, vector<ENTRYDIST>, comparator_ENTRYDIST> best_branchs_queue;
-      vector<HyperPoint<T, N>> kNN(k);
-      unordered_set<string> songs_names;
-      push_node_in_queue(refdata, root, best_branchs_queue);
-      size_t i = size_t(0);
-      while (i < k && !best_branchs_queue.empty()) {
+      if (normalized_axes)
+        normalization.apply(refdata);
+      push_node_in_queue(refdata, current_root, best_branchs_queue);
+      while (!best_branchs_queue.empty()) {
         ENTRYDIST closest_entry = best_branchs_queue.top();
         best_branchs_queue.pop();
         if (!closest_entry.entry.is_in_leaf())
           push_node_in_queue(refdata, closest_entry.entry.child, best_branchs_queue);
-        else {
-#ifdef NON_REPEATED_SONGS
-          size_t temp_songs_names_size = songs_names.size();
-          //try pick k(i) nn
-          songs_names.insert(closest_entry.entry.data.get_songs_name());
-          if (temp_songs_names_size != songs_names.size())
-            kNN[i++] = closest_entry.entry.data;
-          //end try
-#else
-          kNN[i++] = closest_entry.entry.data;
-#endif // NON_REPEATED_SONGS
+        else if (!visit(closest_entry.entry.get_data(), closest_entry.distance))
+          break;
+      }
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+/*APPROXIMATE KNN METHOD: Branch and bound over the nodes only, the data of each visited leaf goes to a max-heap with the k best.
+                         A node is pruned if MINDIST * (1 + epsilon) >= k-th distance, so every answer is at most (1 + epsilon)
+                         times farther than the true one, and the budget of visited nodes/time bounds the latency.
+                         The report says if the answer is guaranteed exact.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::approximate_kNN_query(HyperPoint<T, N, Payload> refdata, size_t k, const KNNBudget &budget, KNNReport &report) {
+  TRACE_SPAN("approximate_kNN_query")
+  report.exact = true;
+  report.budget_exhausted = false;
+  report.visited_nodes = 0;
+  report.elapsed_ms = 0.0;
+  if (k == 0)
+    return vector<HyperPoint<T, N, Payload>>();//nothing to look for, the empty answer is exact (and the heap below is never empty)
+  try {
+    shared_ptr<Node> current = get_root();
+    if (!current) {
+      throw runtime_error(ERROR_EMPTY_TREE);
+    }
+    else {
+      chrono::time_point<chrono::high_resolution_clock> start_time = chrono::high_resolution_clock::now();
+      priority_queue<ENTRYDIST, vector<ENTRYDIST>, comparator_ENTRYDIST> best_branchs_queue;
+      priority_queue<pair<double, size_t>> k_best;//(distance, index in candidates), the worst on top
+      vector<HyperPoint<T, N, Payload>> candidates;
+      if (normalized_axes)
+        normalization.apply(refdata);
+      while (current) {
+        ++report.visited_nodes;
+        for (size_t i(0); i < current->get_size() + current->pending.size(); ++i) {//entries and then buffered data
+          Entry &entry = (i < current->get_size()) ? (*current)[i] : current->pending[i - current->get_size()];
+          if (!entry.is_in_leaf()) {
+            best_branchs_queue.push(ENTRYDIST(refdata, entry));
+            continue;
+          }
+          double distance = DIST(refdata, entry.data);
+          if (k_best.size() < k) {
+            k_best.push(make_pair(distance, candidates.size()));
+            candidates.push_back(entry.get_data());
+          }
+          else if (distance < k_best.top().first) {
+            size_t slot = k_best.top().second;
+            k_best.pop();
+            candidates[slot] = entry.get_data();
+            k_best.push(make_pair(distance, slot));
+          }
+        }
+        current.reset();
+        double kth_distance = (k_best.size() < k) ? numeric_limits<double>::max() : k_best.top().first;
+        if (best_branchs_queue.empty() || best_branchs_queue.top().distance >= kth_distance)
+          break;//nothing left can improve the answer -> exact
+        if (best_branchs_queue.top().distance * (1.0 + budget.epsilon) >= kth_distance) {
+          report.exact = false;
+          break;
+        }
+        if ((budget.max_visited_nodes > 0 && report.visited_nodes >= budget.max_visited_nodes) ||
+            (budget.max_time.count() > 0 && chrono::high_resolution_clock::now() - start_time >= budget.max_time)) {
+          report.exact = false;
+          report.budget_exhausted = true;
+          break;
         }
+        current = best_branchs_queue.top().entry.child;
+        best_branchs_queue.pop();
+      }
+      vector<HyperPoint<T, N, Payload>> kNN(k_best.size());
+      for (size_t i(k_best.size()); i > 0; --i) {//the worst leaves the heap first
+        kNN[i - 1] = candidates[k_best.top().second];
+        k_best.pop();
       }
+      report.elapsed_ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start_time).count();
       return kNN;
     }
   }
@@ -228,42 +658,495 @@ vector<HyperPoint<T, N>> RPlus<T, N, M, ff>::kNN_query(HyperPoint<T, N> refdata,
   }
 }
 
+//SKYLINE METHOD: Skyline of the whole tree (see the skyline in a window)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::skyline(const array<SkylinePreference, N> &preferences, const function<void(const HyperPoint<T, N, Payload> &)> &emit) {
+  return branch_and_bound_skyline(preferences, nullptr, emit);
+}
+
+/*SKYLINE METHOD: Pareto frontier of the data in W, each axis is minimized, maximized or ignored (preferences). Branch and bound
+                  skyline (BBS): the entries leave a min-heap by the score of their best corner (sum of the values, negated for
+                  SKYLINE_MAX), a data that isn't dominated by the skyline found so far is in the skyline (every possible dominator
+                  has a lower score, so it already left the heap) and a node whose best corner is dominated is pruned.
+                  Progressive: emit receives each data as soon as it is confirmed.
+  ref: D. Papadias, Y. Tao, G. Fu, B. Seeger, "An Optimal and Progressive Algorithm for Skyline Queries", SIGMOD 2003*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::skyline(const array<SkylinePreference, N> &preferences, const HyperRectangle<T, N> &query_window,
+                                                             const function<void(const HyperPoint<T, N, Payload> &)> &emit) {
+  HyperRectangle<T, N> W = (normalized_axes) ? normalization.apply(query_window) : query_window;
+  return branch_and_bound_skyline(preferences, &W, emit);
+}
+
+//--BRANCH AND BOUND SKYLINE: BBS in the space of the tree, only inside W if there is a window--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::branch_and_bound_skyline(const array<SkylinePreference, N> &preferences, const HyperRectangle<T, N> *W,
+                                                                              const function<void(const HyperPoint<T, N, Payload> &)> &emit) {
+  TRACE_SPAN("skyline")
+  vector<HyperPoint<T, N, Payload>> frontier, skyline_data;//frontier in the space of the tree (dominance tests), skyline_data as given
+  //best corner of the part of the MBR inside W and its score
+  auto best_corner = [&](const HyperRectangle<T, N> &mbr, array<T, N> &corner) {
+    double score = 0.0;
+    for (size_t i(0); i < N; ++i) {
+      if (preferences[i] == SKYLINE_MAX)
+        corner[i] = (W) ? min(mbr.get_top_right()[i], W->get_top_right()[i]) : mbr.get_top_right()[i];
+      else
+        corner[i] = (W) ? max(mbr.get_bottom_left()[i], W->get_bottom_left()[i]) : mbr.get_bottom_left()[i];
+      if (preferences[i] != SKYLINE_IGNORE)
+        score += (preferences[i] == SKYLINE_MIN) ? double(corner[i]) : -double(corner[i]);
+    }
+    return score;
+  };
+  auto dominated = [&](const array<T, N> &corner) {
+    for (HyperPoint<T, N, Payload> &confirmed : frontier) {
+      if (dominates(confirmed, corner, preferences))
+        return true;
+    }
+    return false;
+  };
+  priority_queue<pair<double, Entry *>, vector<pair<double, Entry *>>, greater<pair<double, Entry *>>> bbs_heap;
+  array<T, N> corner;
+  auto push_node = [&](Node &current) {
+    for (size_t i(0); i < current.get_size() + current.pending.size(); ++i) {//entries and then buffered data
+      Entry &entry = (i < current.get_size()) ? current[i] : current.pending[i - current.get_size()];
+      if (W && !entry.get_mbr().overlaps(*W))
+        continue;
+      double score = best_corner(entry.get_mbr(), corner);
+      if (!dominated(corner))
+        bbs_heap.push(make_pair(score, &entry));
+    }
+  };
+  shared_ptr<Node> current_root = get_root();
+  push_node(*current_root);
+  while (!bbs_heap.empty()) {
+    Entry &entry = *bbs_heap.top().second;
+    bbs_heap.pop();
+    best_corner(entry.get_mbr(), corner);
+    if (dominated(corner))//the skyline grew since the entry was pushed
+      continue;
+    if (!entry.is_in_leaf()) {
+      push_node(*entry.child);
+      continue;
+    }
+    frontier.push_back(entry.data);
+    skyline_data.push_back(entry.get_data());
+    if (emit)
+      emit(skyline_data.back());
+  }
+  return skyline_data;
+}
+
+/*SIMILARITY JOIN METHOD: Streams every pair (data of this tree, data of other) with distance <= epsilon. Both trees are traversed
+                         at the same time and a pair of nodes is only expanded if the MINDIST between their MBRs is <= epsilon, so
+                         the cost follows the size of the output. The pairs of top-level nodes are shared by a work stealing pool.
+                         Self join: pass the same tree as other, each unordered pair is given once.
+                         emit is called by one worker at a time (in blocks of JOIN_FLUSH_SIZE pairs).
+                         The buffered data (insertion buffers) is joined where it waits, see join_pending.
+                         With normalized axes, epsilon is measured in the normalized space (both trees must use the same one).*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::similarity_join(RPlus &other, double epsilon, const JoinSink &emit, size_t n_threads) {
+  TRACE_SPAN("similarity_join")
+  try {
+    shared_ptr<Node> current_root = get_root(), other_root = other.get_root();
+    if (!current_root || !other_root) {
+      throw runtime_error(ERROR_EMPTY_TREE);
+    }
+    else {
+      mutex emit_lock;
+      JoinTask top_level = { current_root, (this == &other) ? current_root : other_root, this == &other };
+      WorkStealingScheduler<JoinTask> scheduler(n_threads);
+      vector<JoinBuffer> local_buffers(scheduler.get_workers());
+      vector<JoinTask> seeds;
+      if (current_root->is_leaf() || top_level.B->is_leaf())
+        seeds.push_back(top_level);
+      else {
+        join_pending(top_level, epsilon, local_buffers[0], emit, emit_lock);
+        for_each_join_pair(top_level, epsilon, [&seeds](JoinTask pair_task) { seeds.push_back(pair_task); });
+      }
+      scheduler.run(seeds, [&](JoinTask &task, size_t worker_id, function<void(JoinTask)> &spawn) {
+        if (task.A->is_leaf() || task.B->is_leaf() || (*task.A)[0].child->is_leaf() || (*task.B)[0].child->is_leaf())
+          join_nodes(task, epsilon, local_buffers[worker_id], emit, emit_lock);
+        else {
+          join_pending(task, epsilon, local_buffers[worker_id], emit, emit_lock);
+          for_each_join_pair(task, epsilon, spawn);
+        }
+      });
+      for (JoinBuffer &buffer : local_buffers)
+        flush_join_buffer(buffer, emit, emit_lock);
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+/*KNN JOIN METHOD: For each data of this tree streams its k nearest neighbors in other (itself excluded in a self join), the
+                   leaves (and buffers) of this tree are shared by a work stealing pool and each one is answered in one traversal
+                   (leaf_kNN) that also reads the buffers of other.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::kNN_join(RPlus &other, size_t k, const JoinSink &emit, size_t n_threads) {
+  TRACE_SPAN("kNN_join")
+  try {
+    shared_ptr<Node> current_root = get_root(), other_root = (this == &other) ? current_root : other.get_root();
+    if (!current_root || !other_root) {
+      throw runtime_error(ERROR_EMPTY_TREE);
+    }
+    else {
+      mutex emit_lock;
+      vector<shared_ptr<Node>> leaves;
+      collect_data_nodes(current_root, leaves);
+      WorkStealingScheduler<shared_ptr<Node>> scheduler(n_threads);
+      vector<JoinBuffer> local_buffers(scheduler.get_workers());
+      scheduler.run(leaves, [&](shared_ptr<Node> &leaf, size_t worker_id, function<void(shared_ptr<Node>)> &) {
+        vector<vector<LeafNeighbor>> neighbors;
+        other.leaf_kNN(*other_root, *leaf, k, this == &other, neighbors);
+        for (size_t i(0); i < leaf->data_count(); ++i) {
+          for (LeafNeighbor &neighbor : neighbors[i])
+            local_buffers[worker_id].emplace_back(leaf->data_entry(i).data.get_songs_name(), get<1>(neighbor)->data_entry(get<2>(neighbor)).data.get_songs_name(),
+                                                  get<0>(neighbor));
+        }
+        if (local_buffers[worker_id].size() >= JOIN_FLUSH_SIZE)
+          flush_join_buffer(local_buffers[worker_id], emit, emit_lock);
+      });
+      for (JoinBuffer &buffer : local_buffers)
+        flush_join_buffer(buffer, emit, emit_lock);
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+/*ALL KNN GRAPH METHOD: k nearest neighbors of every data in the tree (itself excluded) as a CSR graph. The queries are grouped by
+                        leaf: one traversal per leaf with a bound shared by its neighbor points, and the leaves are shared by a work
+                        stealing pool. The data of each insertion buffer is one more group. Every data has min(k, size - 1) neighbors.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+KNNGraph RPlus<T, N, M, ff, Metric, Payload>::all_kNN_graph(size_t k, size_t n_threads) {
+  try {
+    shared_ptr<Node> current_root = get_root();
+    if (!current_root) {
+      throw runtime_error(ERROR_EMPTY_TREE);
+    }
+    else {
+      KNNGraph graph;
+      vector<shared_ptr<Node>> leaves;
+      unordered_map<const Node *, size_t> leaf_base;//position in graph.ids of the first data of each leaf (or buffer)
+      collect_data_nodes(current_root, leaves);
+      for (shared_ptr<Node> &leaf : leaves) {
+        leaf_base[leaf.get()] = graph.ids.size();
+        for (size_t i(0); i < leaf->data_count(); ++i)
+          graph.ids.push_back(leaf->data_entry(i).data.get_songs_name());
+      }
+      size_t n_data = graph.ids.size(), k_used = min(k, (n_data > 0) ? n_data - 1 : size_t(0));
+      graph.offsets.resize(n_data + 1);
+      for (size_t i(0); i <= n_data; ++i)
+        graph.offsets[i] = i * k_used;
+      graph.neighbors.resize(n_data * k_used);
+      graph.distances.resize(n_data * k_used);
+      WorkStealingScheduler<shared_ptr<Node>> scheduler(n_threads);
+      scheduler.run(leaves, [&](shared_ptr<Node> &leaf, size_t, function<void(shared_ptr<Node>)> &) {
+        vector<vector<LeafNeighbor>> neighbors;
+        leaf_kNN(*current_root, *leaf, k_used, true, neighbors);
+        for (size_t i(0); i < leaf->data_count(); ++i) {
+          size_t slot = graph.offsets[leaf_base.at(leaf.get()) + i];
+          for (LeafNeighbor &neighbor : neighbors[i]) {
+            graph.neighbors[slot] = uint32_t(leaf_base.at(get<1>(neighbor)) + get<2>(neighbor));
+            graph.distances[slot++] = float(get<0>(neighbor));
+          }
+        }
+      });
+      return graph;
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//--JOIN NODES: synchronous dfs over a pair of nodes, the pairs of data within epsilon go to the buffer--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::join_nodes(JoinTask &task, double epsilon, JoinBuffer &buffer, const JoinSink &emit, mutex &emit_lock) {
+  if (task.A->is_leaf() && task.B->is_leaf()) {
+    for (size_t i(0); i < task.A->get_size(); ++i) {
+      Entry &left = (*task.A)[i];
+      for (size_t j((task.same) ? i + 1 : 0); j < task.B->get_size(); ++j) {
+        Entry &right = (*task.B)[j];
+        double distance = DIST(left.data, right.data);
+        if (distance <= epsilon)
+          buffer.emplace_back(left.data.get_songs_name(), right.data.get_songs_name(), distance);
+      }
+    }
+    if (buffer.size() >= JOIN_FLUSH_SIZE)
+      flush_join_buffer(buffer, emit, emit_lock);
+  }
+  else {
+    join_pending(task, epsilon, buffer, emit, emit_lock);
+    for_each_join_pair(task, epsilon, [&](JoinTask pair_task) { join_nodes(pair_task, epsilon, buffer, emit, emit_lock); });
+  }
+}
+
+/*--FOR EACH JOIN PAIR: pairs of children (MBR-pair pruning by epsilon) of a pair of nodes, if only one of them is a leaf
+                        then only the other one goes down--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::for_each_join_pair(JoinTask &task, double epsilon, const function<void(JoinTask)> &visit) {
+  if (task.A->is_leaf()) {
+    for (size_t j(0); j < task.B->get_size(); ++j) {
+      if (MINDIST(task.A->mbr, (*task.B)[j].get_mbr()) <= epsilon)
+        visit(JoinTask{ task.A, (*task.B)[j].child, false });
+    }
+  }
+  else if (task.B->is_leaf()) {
+    for (size_t i(0); i < task.A->get_size(); ++i) {
+      if (MINDIST((*task.A)[i].get_mbr(), task.B->mbr) <= epsilon)
+        visit(JoinTask{ (*task.A)[i].child, task.B, false });
+    }
+  }
+  else {
+    for (size_t i(0); i < task.A->get_size(); ++i) {
+      for (size_t j((task.same) ? i : 0); j < task.B->get_size(); ++j) {
+        if (MINDIST((*task.A)[i].get_mbr(), (*task.B)[j].get_mbr()) <= epsilon)
+          visit(JoinTask{ (*task.A)[i].child, (*task.B)[j].child, task.same && i == j });
+      }
+    }
+  }
+}
+
+/*--JOIN PENDING: the pairs of a task with the buffered data of its internal nodes, the ones the pairs of children don't give: the
+                 buffer of A with the whole B, and the buffer of B with the children of A (with A if it is a leaf). In a self join,
+                 the buffer with itself and with each child--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::join_pending(JoinTask &task, double epsilon, JoinBuffer &buffer, const JoinSink &emit, mutex &emit_lock) {
+  if (task.same) {
+    vector<Entry> &pending = task.A->pending;
+    for (size_t i(0); i < pending.size(); ++i) {
+      for (size_t j(i + 1); j < pending.size(); ++j) {
+        double distance = DIST(pending[i].data, pending[j].data);
+        if (distance <= epsilon)
+          buffer.emplace_back(pending[i].data.get_songs_name(), pending[j].data.get_songs_name(), distance);
+      }
+    }
+    for (size_t i(0); i < task.A->get_size() && !pending.empty(); ++i)
+      join_buffered(*task.A, *(*task.A)[i].child, true, epsilon, buffer);
+  }
+  else {
+    if (!task.A->is_leaf())
+      join_buffered(*task.A, *task.B, true, epsilon, buffer);
+    if (!task.B->is_leaf() && task.A->is_leaf())
+      join_buffered(*task.B, *task.A, false, epsilon, buffer);
+    for (size_t i(0); !task.B->is_leaf() && !task.A->is_leaf() && !task.B->pending.empty() && i < task.A->get_size(); ++i)
+      join_buffered(*task.B, *(*task.A)[i].child, false, epsilon, buffer);
+  }
+  if (buffer.size() >= JOIN_FLUSH_SIZE)
+    flush_join_buffer(buffer, emit, emit_lock);
+}
+
+/*--JOIN BUFFERED: each data of the buffer of one node against the subtree of another node (its buffers too), one dfs per data that
+                   only enters the children within epsilon. buffered_left -> the buffered data is the left one of the pairs--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::join_buffered(Node &buffered, Node &subtree, bool buffered_left, double epsilon, JoinBuffer &buffer) {
+  stack<Node *> dfs_s;
+  for (Entry &entry : buffered.pending) {
+    if (MINDIST(entry.data, subtree.mbr) <= epsilon)
+      dfs_s.push(&subtree);
+    while (!dfs_s.empty()) {
+      Node &current = *dfs_s.top();
+      dfs_s.pop();
+      for (size_t j(0); j < current.data_count(); ++j) {
+        HyperPoint<T, N, Payload> &other_data = current.data_entry(j).data;
+        double distance = DIST(entry.data, other_data);
+        if (distance > epsilon)
+          continue;
+        if (buffered_left)
+          buffer.emplace_back(entry.data.get_songs_name(), other_data.get_songs_name(), distance);
+        else
+          buffer.emplace_back(other_data.get_songs_name(), entry.data.get_songs_name(), distance);
+      }
+      for (size_t i(0); i < current.get_size() && !current.is_leaf(); ++i) {
+        if (MINDIST(entry.data, current[i].get_mbr()) <= epsilon)
+          dfs_s.push(current[i].child.get());
+      }
+    }
+  }
+}
+
+//--FLUSH JOIN BUFFER: streams the pairs of a worker to the sink, one worker at a time--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::flush_join_buffer(JoinBuffer &buffer, const JoinSink &emit, mutex &emit_lock) {
+  lock_guard<mutex> guard(emit_lock);
+  for (tuple<string, string, double> &matching_pair : buffer)
+    emit(get<0>(matching_pair), get<1>(matching_pair), get<2>(matching_pair));
+  buffer.clear();
+}
+
+/*--LEAF KNN: k nearest neighbors in this tree of every data of a leaf or a buffer (the group), with one best first traversal ordered
+             by the MINDIST to the group's MBR. A node farther than the worst k-th distance of the group is pruned, and inside a
+             leaf (or buffer) each data also skips it by its own k-th distance. self -> the group is in this tree, skip each data itself--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::leaf_kNN(Node &start, Node &group, size_t k, bool self, vector<vector<LeafNeighbor>> &neighbors) {
+  typedef pair<double, Node *> NodeDist;
+  size_t group_size = group.data_count();
+  vector<priority_queue<LeafNeighbor>> k_best(group_size);//the worst on top
+  priority_queue<NodeDist, vector<NodeDist>, greater<NodeDist>> best_first;
+  double bound = numeric_limits<double>::max();
+  neighbors.assign(group_size, vector<LeafNeighbor>());
+  if (k == 0 || group_size == 0)
+    return;
+  HyperRectangle<T, N> group_mbr = group.data_entry(0).get_mbr();//the MBR of a buffer's node also covers its subtree
+  for (size_t g(1); g < group_size; ++g)
+    group_mbr.adjust(group.data_entry(g).get_mbr());
+  best_first.push(make_pair(0.0, &start));
+  while (!best_first.empty() && best_first.top().first <= bound) {
+    Node *current = best_first.top().second;
+    best_first.pop();
+    if (!current->is_leaf()) {
+      for (size_t i(0); i < current->get_size(); ++i) {
+        double distance = MINDIST(group_mbr, (*current)[i].get_mbr());
+        if (distance <= bound)
+          best_first.push(make_pair(distance, (*current)[i].child.get()));
+      }
+      if (current->pending.empty())
+        continue;
+    }
+    bound = 0.0;
+    for (size_t g(0); g < group_size; ++g) {
+      HyperPoint<T, N, Payload> &query_data = group.data_entry(g).data;
+      double kth_distance = (k_best[g].size() < k) ? numeric_limits<double>::max() : get<0>(k_best[g].top());
+      if (MINDIST(query_data, current->mbr) <= kth_distance) {
+        for (size_t j(0); j < current->data_count(); ++j) {
+          if (self && current == &group && g == j)
+            continue;
+          double distance = DIST(query_data, current->data_entry(j).data);
+          if (k_best[g].size() < k)
+            k_best[g].push(make_tuple(distance, current, j));
+          else if (distance < get<0>(k_best[g].top())) {
+            k_best[g].pop();
+            k_best[g].push(make_tuple(distance, current, j));
+          }
+        }
+      }
+      bound = max(bound, (k_best[g].size() < k) ? numeric_limits<double>::max() : get<0>(k_best[g].top()));
+    }
+  }
+  for (size_t g(0); g < group_size; ++g) {
+    neighbors[g].resize(k_best[g].size());
+    for (size_t r(k_best[g].size()); r > 0; --r) {
+      neighbors[g][r - 1] = k_best[g].top();
+      k_best[g].pop();
+    }
+  }
+}
+
+//--COLLECT DATA NODES: every leaf and every internal node with buffered data under start (dfs order, neighbor leaves stay close)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::collect_data_nodes(shared_ptr<Node> start, vector<shared_ptr<Node>> &data_nodes) {
+  stack<shared_ptr<Node>> dfs_s;
+  dfs_s.push(start);
+  while (!dfs_s.empty()) {
+    shared_ptr<Node> current = dfs_s.top();
+    dfs_s.pop();
+    if (current->is_leaf() || !current->pending.empty())
+      data_nodes.push_back(current);
+    if (current->is_leaf())
+      continue;
+    for (size_t i(0); i < current->get_size(); ++i)
+      dfs_s.push((*current)[i].child);
+  }
+}
+
+//--DOMINATES: A is at least as good as B in every axis that isn't ignored and better in one of them--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::dominates(const HyperPoint<T, N, Payload> &A, const array<T, N> &B, const array<SkylinePreference, N> &preferences) {
+  bool better = false;
+  for (size_t i(0); i < N; ++i) {
+    if (preferences[i] == SKYLINE_IGNORE || A[i] == B[i])
+      continue;
+    if ((A[i] < B[i]) != (preferences[i] == SKYLINE_MIN))
+      return false;
+    better = true;
+  }
+  return better;
+}
+
 //--PUSH EACH ENTRY OF A NODE IN THE PRIORITY QUEUE--
-template<typename T, size_t N, size_t M, size_t ff>
-void RPlus<T, N, M, ff>::push_node_in_queue(HyperPoint<T, N> refdata, shared_ptr<Node> &current, priority_queue<ENTRYDIST, vector<ENTRYDIST>, comparator_ENTRYDIST> &q_NN) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::push_node_in_queue(HyperPoint<T, N, Payload> refdata, shared_ptr<Node> &current, priority_queue<ENTRYDIST, vector<ENTRYDIST>, comparator_ENTRYDIST> &q_NN,
+                                                    const AttributePredicate *predicate) {
   for (size_t i = size_t(0); i < current->get_size(); ++i) {
+    if (!passes((*current)[i], predicate))
+      continue;
     ENTRYDIST packed_entry(refdata, (*current)[i]);
     q_NN.push(packed_entry);
   }
+  for (Entry &buffered_entry : current->pending) {//buffered data is compared as leaf data
+    if (!passes(buffered_entry, predicate))
+      continue;
+    ENTRYDIST packed_entry(refdata, buffered_entry);
+    q_NN.push(packed_entry);
+  }
 }
 
-//ASSIGN METHOD: "Massive" insertion(1x1x(size of unpacked_data vector)). Give a list of hyperpoints (data) to insert in the R+
-template<typename T, size_t N, size_t M, size_t ff>
-void RPlus<T, N, M, ff>::assign(vector<HyperPoint<T, N>> &unpacked_data) {
-  size_t step_insert(1);
-  for (HyperPoint<T, N> &hp : unpacked_data) {
-    Entry data_entry(hp);
-    insert(data_entry);
-#ifdef VISUALIZE_INSERT_COUNT
-    SAY(step_insert)
-      ++step_insert;
-#endif // VISUALIZE_INSERT_COUNT
+/*SET NORMALIZATION METHOD: Per-axis offset and scale applied once to the data in assign and to the query objects, the
+                           entries keep the given coordinates beside the normalized key and the queries return those.
+                           Only for an empty tree, floating point data and finite scales > 0.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::set_normalization(const AxisNormalization<T, N> &axes_normalization) {
+  static_assert(is_floating_point<T>::value, "The normalization of the axes needs a floating point data type.");
+  try {
+    if (root->get_size() > 0) {
+      throw runtime_error(ERROR_NORMALIZATION);
+    }
+    else if (!axes_normalization.is_valid()) {
+      throw runtime_error(ERROR_NORMALIZATION_SCALE);
+    }
+    else {
+      normalization = axes_normalization;
+      normalized_axes = true;
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
 
+//ASSIGN METHOD: "Massive" insertion(1x1x(size of unpacked_data vector)). Give a list of hyperpoints (data) to insert in the R+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::assign(vector<HyperPoint<T, N, Payload>> &unpacked_data) {
+  TRACE_SPAN("assign")
+  ++version;
+  for (HyperPoint<T, N, Payload> &hp : unpacked_data) {
+#ifdef NON_REPEATED_SONGS
+    if (contains_id(hp.get_songs_name()))
+      continue;
+#endif // NON_REPEATED_SONGS
+    Entry data_entry = (normalized_axes) ? Entry(hp, normalization) : Entry(hp);
+    if (buffer_capacity > 0)
+      buffered_insert(data_entry);
+    else
+      insert(data_entry);
   }
 }
 
 //INSERTION METHOD: Single insertion (1x1), need assign method to be called because it is private.
-template<typename T, size_t N, size_t M, size_t ff>
-void RPlus<T, N, M, ff>::insert(Entry &entry) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::insert(Entry &entry) {
+  TRACE_SPAN("insert")
   stack<shared_ptr<Node>> parents;
-  shared_ptr<Node> &candidate_node = choose_leaf(entry, parents);
+  shared_ptr<Node> candidate_node = choose_leaf(entry, parents);
   //if saturated node ->split, else -> simple insert
   candidate_node->add(entry);
+  id_index.insert(entry.data.get_songs_name(), candidate_node.get());
   if (candidate_node->get_size() > M) {
     parents.push(candidate_node);
     while (parents.top()->get_size() > M) {
-      shared_ptr<Node> &current_to_split = parents.top();
+      shared_ptr<Node> current_to_split = parents.top();
       parents.pop();
+#ifdef RPLUS_SIBLING_REDISTRIBUTION
+      if (!parents.empty() && redistribute(current_to_split, parents.top()))
+        return;//a sibling took the overflow, the parent keeps its size
+#endif // RPLUS_SIBLING_REDISTRIBUTION
       Entry new_entry(split_by_saturation(current_to_split));
 
       if (!parents.empty()) {//parent is an internal node
@@ -274,33 +1157,347 @@ void RPlus<T, N, M, ff>::insert(Entry &entry) {
         shared_ptr<Node> new_root = make_shared<Node>();
         Entry root_entry(root);
         new_root->add(root_entry); new_root->add(new_entry);
-        root = new_root;
+        atomic_store(&root, new_root);//the queries may be loading it (see get_root)
         return;
       }
     }
   }
 }
 
+/*ERASE METHOD: Removes one data with the same name and coordinates from the leaf (or the buffer) that keeps it, returns false if
+                it isn't in the R+. The id index gives the nodes of the copies of the id in O(1), each one is checked until
+                the data is found. The MBRs are not shrunk, they still cover their subtrees.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::erase(HyperPoint<T, N, Payload> data) {
+  TRACE_SPAN("erase")
+  ++version;
+  if (normalized_axes)
+    normalization.apply(data);
+  return id_index.find_any(data.get_songs_name(), [&](Node *location) { return erase_from(location, data); });
+}
+
+/*GET BY ID METHOD: Exact-id lookup in O(1) (id index -> nodes, then a scan of at most M entries and the buffer of each one). One of
+                   the copies if the id repeats, false if the id isn't in the R+.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::get_by_id(const string &id, HyperPoint<T, N, Payload> &data) {
+  return id_index.find_any(id, [&](Node *location) {
+    Entry *entry = entry_of(*location, id);
+    if (entry)
+      data = entry->get_data();
+    return entry != nullptr;
+  });
+}
+
+//UPDATE METHOD: Moves a data to its new version (erase + insert), returns false (and inserts nothing) if the old data isn't in the R+.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::update(HyperPoint<T, N, Payload> old_data, HyperPoint<T, N, Payload> new_data) {
+  if (!erase(old_data))
+    return false;
+  vector<HyperPoint<T, N, Payload>> new_version(1, new_data);
+  assign(new_version);
+  return true;
+}
+
+//GET ALL DATA METHOD: Every data of the R+ (leaves and buffers) in original units, for example to write a checkpoint.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+vector<HyperPoint<T, N, Payload>> RPlus<T, N, M, ff, Metric, Payload>::get_all_data() {
+  vector<HyperPoint<T, N, Payload>> all_data;
+  stack<shared_ptr<Node>> dfs_s;
+  dfs_s.push(get_root());
+  while (!dfs_s.empty()) {
+    shared_ptr<Node> current = dfs_s.top();
+    dfs_s.pop();
+    for (Entry &entry : current->pending)
+      all_data.push_back(entry.get_data());
+    for (size_t i(0); i < current->get_size(); ++i) {
+      if (current->is_leaf())
+        all_data.push_back((*current)[i].get_data());
+      else
+        dfs_s.push((*current)[i].child);
+    }
+  }
+  return all_data;
+}
+
+/*SET INSERTION BUFFER METHOD: Buffered (lazy) insertion for write-heavy ingestion, buffer-tree style. The data of assign waits in
+                              a buffer of the root and, when a buffer reaches the capacity, its data is pushed down one level in
+                              one batch (to the buffers of the children or, over the leaves, into the leaves) and the overflowed
+                              children are split once per batch. Queries also read the buffers. capacity = 0 -> 1x1 insertion.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::set_insertion_buffer(size_t capacity) {
+  if (capacity == 0)
+    flush_insertion_buffers();
+  buffer_capacity = capacity;
+}
+
+//FLUSH INSERTION BUFFERS METHOD: Pushes down every buffered data until all of it is in the leaves
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::flush_insertion_buffers() {
+  TRACE_SPAN("flush_insertion_buffers")
+  if (buffer_capacity == 0)
+    return;//nothing is ever buffered (set_insertion_buffer(0) flushes first), so the read-only callers don't write
+  ++version;
+  if (root->is_leaf())
+    return;
+  empty_buffer(root, true);
+  grow_root_if_overflowed();
+}
+
+//--BUFFERED INSERT: the entry waits in the root's buffer, the root's MBR covers it from now--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::buffered_insert(Entry &entry) {
+  if (root->is_leaf()) {//no internal node to keep a buffer yet
+    insert(entry);
+    return;
+  }
+  root->pending.push_back(entry);
+  root->cover(entry);
+  id_index.insert(entry.data.get_songs_name(), root.get());
+  if (root->pending.size() >= buffer_capacity) {
+    empty_buffer(root);
+    grow_root_if_overflowed();
+  }
+}
+
+/*--EMPTY BUFFER: distributes the buffer of an internal node among its children (choose_child), then the full buffers of the
+                  children (every buffer of the subtree if whole_subtree) are emptied too (recursively), and at the end each
+                  overflowed child is split until it respects M--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::empty_buffer(shared_ptr<Node> &node, bool whole_subtree) {
+  TRACE_SPAN("empty_buffer")
+  vector<Entry> moving;
+  moving.swap(node->pending);
+  vector<vector<Entry>> per_child(node->get_size());
+  for (Entry &entry : moving)
+    per_child[choose_child(node, entry.data)].push_back(entry);
+  for (size_t i(0); i < per_child.size(); ++i) {
+    if (per_child[i].empty())
+      continue;
+    shared_ptr<Node> child = (*node)[i].child;
+    index_data(per_child[i], node.get(), child.get());
+    if (child->is_leaf()) {
+      child->add(per_child[i]);
+      continue;
+    }
+    for (Entry &entry : per_child[i]) {
+      child->pending.push_back(entry);
+      child->cover(entry);
+    }
+  }
+  for (size_t i(0); i < node->get_size(); ++i) {
+    shared_ptr<Node> child = (*node)[i].child;
+    if (!child->is_leaf() && (whole_subtree || child->pending.size() >= buffer_capacity))
+      empty_buffer(child, whole_subtree);
+  }
+  split_overflowed_children(node);
+}
+
+/*--SPLIT OVERFLOWED CHILDREN: each child with more than M entries (it took a whole batch) is cut in one pass into parts that respect
+                               M, not one split by saturation per ff entries (O(n^2 / ff) for a batch of n). The child keeps the first
+                               part and the other ones are new children of node--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::split_overflowed_children(shared_ptr<Node> &node) {
+  size_t children = node->get_size();
+  for (size_t i(0); i < children; ++i) {
+    shared_ptr<Node> child = (*node)[i].child;
+    if (child->get_size() <= M)
+      continue;
+    vector<shared_ptr<Node>> parts;
+    if (child->is_leaf())
+      split_leaf_in_bulk(child, parts);
+    else
+      split_in_halves(child, parts);
+    for (size_t p(1); p < parts.size(); ++p) {
+      Entry new_entry(parts[p]);
+      node->add(new_entry);
+    }
+    for (shared_ptr<Node> &part : parts) {//the batch grew the arrays of the child beyond M
+      part->entries.resize(M);
+      part->entries.shrink_to_fit();
+    }
+  }
+}
+
+/*--SPLIT LEAF IN BULK: the data of an overflowed leaf is cut by pack_groups (sorted cuts in the axis of the widest spread) in groups
+                        filled to BUFFER_LEAF_FILL, each group is a leaf (A is the first one)--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::split_leaf_in_bulk(shared_ptr<Node> &A, vector<shared_ptr<Node>> &parts) {
+  vector<Entry> S(A->entries.begin(), A->entries.begin() + A->get_size());
+  size_t leaf_capacity = max(ff, size_t(double(M) * BUFFER_LEAF_FILL));
+  vector<size_t> cuts;
+  pack_groups(S, 0, S.size(), (S.size() + leaf_capacity - 1) / leaf_capacity, M, cuts);
+  size_t group_begin = 0;
+  for (size_t group_end : cuts) {
+    shared_ptr<Node> part = (parts.empty()) ? A : make_shared<Node>();
+    vector<Entry> group(S.begin() + group_begin, S.begin() + group_end);
+    part->resize(0);
+    part->add(group);
+    index_data(group, A.get(), part.get());
+    parts.push_back(part);
+    group_begin = group_end;
+  }
+}
+
+/*--SPLIT IN HALVES: an overflowed internal node is cut by split_by_parent_cut and each half is cut again until it respects M. The
+                     cutline is the high bound of a child in the middle half of some axis (ranks n/4 to 3n/4) that crosses the fewest
+                     children (fewest downward splits, like min_number_splits), then the most balanced one. O(N n log n) per cut.
+                     If no cutline separates the children, split by saturation--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::split_in_halves(shared_ptr<Node> &A, vector<shared_ptr<Node>> &parts) {
+  if (A->get_size() <= M) {
+    parts.push_back(A);
+    return;
+  }
+  size_t n = A->get_size(), axis = 0, fewest_splits = numeric_limits<size_t>::max(), best_balance = 0;
+  T cutline = T(0);
+  vector<T> lows(n), highs(n);
+  for (size_t current_dim(0); current_dim < N; ++current_dim) {
+    for (size_t i(0); i < n; ++i) {
+      lows[i] = ENTRY_LOW((*A)[i], current_dim);
+      highs[i] = ENTRY_HIGH((*A)[i], current_dim);
+    }
+    sort(lows.begin(), lows.end());
+    sort(highs.begin(), highs.end());
+    for (size_t rank(n / 4); rank <= 3 * n / 4 && rank < n; ++rank) {
+      T candidate = highs[rank];
+      size_t left = size_t(upper_bound(highs.begin(), highs.end(), candidate) - highs.begin());//high <= cutline
+      size_t starting = size_t(lower_bound(lows.begin(), lows.end(), candidate) - lows.begin());//low < cutline
+      if (left == n)
+        continue;//nothing on the right
+      size_t splits = starting - min(starting, left), balance = min(left + splits, n - left);
+      if (splits < fewest_splits || (splits == fewest_splits && balance > best_balance)) {
+        fewest_splits = splits;
+        best_balance = balance;
+        axis = current_dim;
+        cutline = candidate;
+      }
+    }
+  }
+  shared_ptr<Node> B = (fewest_splits != numeric_limits<size_t>::max()) ? split_by_parent_cut(A, axis, cutline) : split_by_saturation(A);
+  if (A->get_size() == 0 || B->get_size() == 0) {//only buffered data crossed the cutline -> back together, split by saturation
+    for (size_t i(0); i < B->get_size(); ++i)
+      A->add((*B)[i]);
+    move_pending(B, A);
+    B = split_by_saturation(A);
+  }
+  split_in_halves(A, parts);
+  split_in_halves(B, parts);
+}
+
+//--MOVE PENDING: the buffered data of a node goes to the buffer of another one (and its MBR)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::move_pending(shared_ptr<Node> &from, shared_ptr<Node> &to) {
+  index_data(from->pending, from.get(), to.get());
+  for (Entry &entry : from->pending) {
+    to->pending.push_back(entry);
+    to->cover(entry);
+  }
+  from->pending.clear();
+}
+
+//--ERASE FROM: removes the data from the buffer or the entries (if leaf) of one node, and the node from the values of its id--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::erase_from(Node *location, HyperPoint<T, N, Payload> &data) {
+  bool erased = false;
+  for (size_t i(0); i < location->pending.size() && !erased; ++i) {
+    if (same_data(location->pending[i].data, data)) {
+      location->pending[i] = location->pending.back();
+      location->pending.pop_back();
+      erased = true;
+    }
+  }
+  for (size_t i(0); i < location->get_size() && location->is_leaf() && !erased; ++i) {
+    if (same_data((*location)[i].data, data)) {
+      (*location)[i] = (*location)[location->get_size() - 1];
+      location->resize(location->get_size() - 1);
+      erased = true;
+    }
+  }
+  if (erased)
+    id_index.erase(data.get_songs_name(), location);
+  return erased;
+}
+
+//--ENTRY OF: the data of the node (entries if leaf, or buffer) with the id, nullptr if there isn't one--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+typename RPlus<T, N, M, ff, Metric, Payload>::Entry *RPlus<T, N, M, ff, Metric, Payload>::entry_of(Node &node, const string &id) {
+  for (size_t i(0); i < node.get_size() + node.pending.size(); ++i) {
+    Entry &entry = (i < node.get_size()) ? node[i] : node.pending[i - node.get_size()];
+    if (entry.is_in_leaf() && entry.data.get_songs_name() == id)
+      return &entry;
+  }
+  return nullptr;
+}
+
+//--CONTAINS ID: some copy of the id is in the R+ (the index only keeps hashes, the name is verified in the node)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::contains_id(const string &id) {
+  return id_index.find_any(id, [&](Node *location) { return entry_of(*location, id) != nullptr; });
+}
+
+//--INDEX DATA: the data of the set (not the children) moved from one node to another one, each copy moves its own value of the id--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::index_data(vector<Entry> &S, Node *from, Node *to) {
+  if (from == to)
+    return;
+  for (Entry &entry : S) {
+    if (entry.is_in_leaf())
+      id_index.move(entry.data.get_songs_name(), from, to);
+  }
+}
+
+//--SAME DATA: same name and same coordinates--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::same_data(HyperPoint<T, N, Payload> &A, HyperPoint<T, N, Payload> &B) {
+  if (A.get_songs_name() != B.get_songs_name())
+    return false;
+  for (size_t i(0); i < N; ++i) {
+    if (A[i] != B[i])
+      return false;
+  }
+  return true;
+}
+
+//--GROW ROOT IF OVERFLOWED: new root over the old one while the root has more than M entries--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::grow_root_if_overflowed() {
+  while (root->get_size() > M) {
+    shared_ptr<Node> new_root = make_shared<Node>();
+    Entry root_entry(root);
+    new_root->add(root_entry);
+    atomic_store(&root, new_root);
+    split_overflowed_children(root);
+  }
+}
+
 //CHOOSE LEAF METHOD: Search the node to place the new entry and build a parent's path for split upward propagation
-template<typename T, size_t N, size_t M, size_t ff>
-shared_ptr<typename RPlus<T, N, M, ff>::Node> RPlus<T, N, M, ff>::choose_leaf(Entry &entry, stack<shared_ptr<Node>> &parents) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+shared_ptr<typename RPlus<T, N, M, ff, Metric, Payload>::Node> RPlus<T, N, M, ff, Metric, Payload>::choose_leaf(Entry &entry, stack<shared_ptr<Node>> &parents) {
+  TRACE_SPAN("choose_leaf")
   shared_ptr<Node> candidate_node = root;
   while (!candidate_node->is_leaf()) {
     parents.push(candidate_node);
-    shared_ptr<Node> temp = candidate_node;
-    for (size_t i(0); i < temp->get_size(); ++i) {
-      candidate_node = (*temp)[i].child;
-      if ((*temp)[i].get_mbr().contains(entry.data))
-        break;
-    }
+    candidate_node->cover(entry);//the cached MBRs of the path must cover the new data
+    candidate_node = (*candidate_node)[choose_child(candidate_node, entry.data)].child;
   }
   return candidate_node;
 }
 
+//CHOOSE CHILD METHOD: The first child whose MBR contains the data, the last one if none contains it
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+size_t RPlus<T, N, M, ff, Metric, Payload>::choose_child(shared_ptr<Node> &node, HyperPoint<T, N, Payload> &data) {
+  for (size_t i(0); i < node->get_size(); ++i) {
+    if ((*node)[i].get_mbr().contains(data))
+      return i;
+  }
+  return node->get_size() - 1;
+}
+
 /*SPLIT BY PARENT'S CUT METHOD: Division of a node A in given axis and optimal cutline,
                                 then do downward propagation of the split by parent's cut.*/
-template<typename T, size_t N, size_t M, size_t ff>
-shared_ptr<typename RPlus<T, N, M, ff>::Node> RPlus<T, N, M, ff>::split_by_parent_cut(shared_ptr<Node> &A, size_t axis, T cutline) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+shared_ptr<typename RPlus<T, N, M, ff, Metric, Payload>::Node> RPlus<T, N, M, ff, Metric, Payload>::split_by_parent_cut(shared_ptr<Node> &A, size_t axis, T cutline) {
+  TRACE_SPAN("split_by_parent_cut")
   shared_ptr<Node> B = make_shared<Node>();
   vector<Entry> set_A, set_B;
   for (size_t i(0); i < A->get_size(); ++i) {
@@ -318,42 +1515,215 @@ shared_ptr<typename RPlus<T, N, M, ff>::Node> RPlus<T, N, M, ff>::split_by_paren
       }
     }
     else {
-      if (GET_BOUNDARIES(entry).second[axis] <= cutline)
+      if (ENTRY_HIGH(entry, axis) <= cutline)
         set_A.push_back(entry);
-      else if (GET_BOUNDARIES(entry).first[axis] >= cutline)
+      else if (ENTRY_LOW(entry, axis) >= cutline)
         set_B.push_back(entry);
       else {
-        set_B.emplace_back(split_by_parent_cut(entry.child, axis, cutline));
-        set_A.emplace_back(entry.child);
+        shared_ptr<Node> right_part = split_by_parent_cut(entry.child, axis, cutline);
+        if (right_part->get_size() == 0)//only buffered data crossed the cutline -> it stays in the left part
+          move_pending(right_part, entry.child);
+        else if (entry.child->get_size() == 0)
+          move_pending(entry.child, right_part);
+        if (entry.child->get_size() > 0)
+          set_A.emplace_back(entry.child);
+        if (right_part->get_size() > 0)
+          set_B.emplace_back(right_part);
       }
     }
   }
+  vector<Entry> pending_A, pending_B;
+  for (Entry &entry : A->pending)
+    ((entry.data[axis] <= cutline) ? pending_A : pending_B).push_back(entry);
   A->resize(0); A->add(set_A);
   B->resize(0); B->add(set_B);
+  A->pending.swap(pending_A);
+  B->pending.swap(pending_B);
+  index_data(set_B, A.get(), B.get());
+  index_data(B->pending, A.get(), B.get());
+  for (Entry &entry : A->pending)
+    A->cover(entry);
+  for (Entry &entry : B->pending)
+    B->cover(entry);
   return B;
 }
 
 /*SPLIT BY SATURATION METHOD: When a parent node was affected by split, this could be
                               saturated (size of the node > M), so is neccessary a split
                               with a new partition line.*/
-template<typename T, size_t N, size_t M, size_t ff>
-shared_ptr<typename RPlus<T, N, M, ff>::Node> RPlus<T, N, M, ff>::split_by_saturation(shared_ptr<Node> &A) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+shared_ptr<typename RPlus<T, N, M, ff, Metric, Payload>::Node> RPlus<T, N, M, ff, Metric, Payload>::split_by_saturation(shared_ptr<Node> &A) {
+  TRACE_SPAN("split_by_saturation")
   size_t axis;
   T cutline;
   partition(A, axis, cutline);
-  return split_by_parent_cut(A, axis, cutline);
+  shared_ptr<Node> B = split_by_parent_cut(A, axis, cutline);
+  if (A->get_size() == 0 || B->get_size() == 0) {//repeated points, no cutline separates the children -> split by halves
+    vector<Entry> S(A->entries.begin(), A->entries.begin() + A->get_size());
+    size_t from_A = S.size();
+    S.insert(S.end(), B->entries.begin(), B->entries.begin() + B->get_size());
+    vector<Entry> first_half(S.begin(), S.begin() + S.size() / 2), second_half(S.begin() + S.size() / 2, S.end());
+    A->resize(0); A->add(first_half);
+    B->resize(0); B->add(second_half);
+    for (size_t i(0); i < S.size(); ++i) {//the data changes of node if its half isn't the side of the cut where it was
+      if (S[i].is_in_leaf())
+        id_index.move(S[i].data.get_songs_name(), (i < from_A) ? A.get() : B.get(), (i < S.size() / 2) ? A.get() : B.get());
+    }
+    move_pending(B, A);
+    for (Entry &entry : A->pending)
+      A->cover(entry);
+  }
+  return B;
+}
+
+/*REDISTRIBUTE METHOD: An overflowed node A gives entries to a sibling B (same parent, free slots, no buffer) instead of splitting.
+                      The entries at the top (or bottom) of A in some axis move across a cutline: they can't cross the ones that
+                      stay, and the new MBR of B can't overlap what stays in A nor the other siblings. Half of the difference of
+                      sizes moves (at least 1), the sibling and axis that move more entries are chosen.
+                      False if no sibling can take entries -> split by saturation.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::redistribute(shared_ptr<Node> &A, shared_ptr<Node> &parent) {
+  TRACE_SPAN("redistribute")
+  size_t size = A->get_size();
+  if (!A->pending.empty() || size < 2)
+    return false;
+  size_t widest_target = 0;
+  for (size_t s(0); s < parent->get_size(); ++s) {
+    Node &B = *(*parent)[s].child;
+    if (&B != A.get() && B.get_size() + 1 < size && B.pending.empty())
+      widest_target = max(widest_target, min((size - B.get_size()) / 2, M - B.get_size()));
+  }
+  if (widest_target == 0)
+    return false;//every sibling is full
+  //orders: (axis < N) top of A first | (axis >= N) bottom of A first, moved[m] = bounds of the m first, kept[m] = bounds of the others
+  typedef pair<array<T, N>, array<T, N>> Bounds;//plain corners, the boxes are built many times here
+  auto bounds_of = [](Entry *entry) {
+    Bounds bounds;
+    for (size_t i(0); i < N; ++i) {
+      bounds.first[i] = ENTRY_LOW((*entry), i);
+      bounds.second[i] = ENTRY_HIGH((*entry), i);
+    }
+    return bounds;
+  };
+  auto adjust = [](Bounds &bounds, const Bounds &other) {
+    for (size_t i(0); i < N; ++i) {
+      bounds.first[i] = min(bounds.first[i], other.first[i]);
+      bounds.second[i] = max(bounds.second[i], other.second[i]);
+    }
+  };
+  auto overlaps = [](const Bounds &X, const Bounds &Y) {
+    for (size_t i(0); i < N; ++i) {
+      if (X.first[i] > Y.second[i] || X.second[i] < Y.first[i])
+        return false;
+    }
+    return true;
+  };
+  //the order of an axis is only built when a sibling can take at least its first entry (most overflows try few or no axis)
+  array<vector<Entry *>, 2 * N> orders;
+  array<vector<Bounds>, 2 * N> moved, kept;
+  array<vector<bool>, 2 * N> separated;//the m first are strictly beyond the others
+  array<Bounds, 2 * N> first;
+  for (size_t axis(0); axis < 2 * N; ++axis) {
+    size_t dim = axis % N, chosen = 0;
+    for (size_t i(1); i < size; ++i) {
+      if ((axis < N) ? ENTRY_LOW((*A)[i], dim) > ENTRY_LOW((*A)[chosen], dim) : ENTRY_HIGH((*A)[i], dim) < ENTRY_HIGH((*A)[chosen], dim))
+        chosen = i;
+    }
+    first[axis] = bounds_of(&(*A)[chosen]);
+  }
+  auto build_order = [&](size_t axis) {
+    size_t dim = axis % N;
+    vector<Entry *> &order = orders[axis];
+    for (size_t i(0); i < size; ++i)
+      order.push_back(&(*A)[i]);
+    if (axis < N)
+      sort(order.begin(), order.end(), [dim](const Entry *X, const Entry *Y) { return ENTRY_LOW((*X), dim) > ENTRY_LOW((*Y), dim); });
+    else
+      sort(order.begin(), order.end(), [dim](const Entry *X, const Entry *Y) { return ENTRY_HIGH((*X), dim) < ENTRY_HIGH((*Y), dim); });
+    moved[axis].resize(size);
+    kept[axis].resize(size);
+    separated[axis].assign(size, false);
+    moved[axis][1] = bounds_of(order[0]);
+    for (size_t m(2); m < size; ++m) {
+      moved[axis][m] = moved[axis][m - 1];
+      adjust(moved[axis][m], bounds_of(order[m - 1]));
+    }
+    kept[axis][size - 1] = bounds_of(order[size - 1]);
+    for (size_t m(size - 1); m > 0; --m) {
+      if (m < size - 1) {
+        kept[axis][m] = kept[axis][m + 1];
+        adjust(kept[axis][m], bounds_of(order[m]));
+      }
+      separated[axis][m] = (axis < N) ? ENTRY_LOW((*order[m - 1]), dim) > kept[axis][m].second[dim]
+                                      : ENTRY_HIGH((*order[m - 1]), dim) < kept[axis][m].first[dim];
+    }
+  };
+  vector<Bounds> siblings;
+  for (size_t s(0); s < parent->get_size(); ++s)
+    siblings.push_back(bounds_of(&(*parent)[s]));
+  size_t best_sibling = 0, best_axis = 0, best_moved = 0;
+  for (size_t s(0); s < parent->get_size(); ++s) {
+    Node &B = *(*parent)[s].child;
+    if (&B == A.get() || B.get_size() + 1 >= size || !B.pending.empty())
+      continue;
+    size_t target = min((size - B.get_size()) / 2, M - B.get_size());
+    auto overlaps_others = [&](const Bounds &B_grown) {
+      for (size_t o(0); o < parent->get_size(); ++o) {
+        if ((*parent)[o].child != A && o != s && overlaps(siblings[o], B_grown))
+          return true;
+      }
+      return false;
+    };
+    for (size_t axis(0); axis < 2 * N && best_moved < target; ++axis) {
+      Bounds B_grown = siblings[s];
+      adjust(B_grown, first[axis]);
+      if (overlaps_others(B_grown))
+        continue;//B grows more with more entries, no count of this axis fits
+      if (orders[axis].empty())
+        build_order(axis);
+      for (size_t m(target); m > best_moved; --m) {
+        if (!separated[axis][m])
+          continue;
+        B_grown = siblings[s];
+        adjust(B_grown, moved[axis][m]);
+        if (overlaps(B_grown, kept[axis][m]) || overlaps_others(B_grown))
+          continue;
+        best_sibling = s;
+        best_axis = axis;
+        best_moved = m;
+        break;
+      }
+    }
+    if (best_moved == widest_target)
+      break;
+  }
+  if (best_moved == 0)
+    return false;
+  shared_ptr<Node> &B = (*parent)[best_sibling].child;
+  vector<Entry> moved_set, kept_set;
+  for (size_t i(0); i < size; ++i)
+    ((i < best_moved) ? moved_set : kept_set).push_back(*orders[best_axis][i]);
+  A->resize(0); A->add(kept_set);//the MBR of A shrinks to the entries that stay
+  B->add(moved_set);
+  index_data(moved_set, A.get(), B.get());
+  return true;
 }
 
 //PARTITION METHOD: Returns the best(min. cost) cutline and axis to split a saturated node using sweep.
-template<typename T, size_t N, size_t M, size_t ff>
-void RPlus<T, N, M, ff>::partition(shared_ptr<Node> &danger_node, size_t &optimal_dim, T &optimal_cutline) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::partition(shared_ptr<Node> &danger_node, size_t &optimal_dim, T &optimal_cutline) {
+  TRACE_SPAN("partition")
   double cheapest_cost = numeric_limits<double>::max();
   optimal_dim = size_t(0);
   optimal_cutline = 0;
   //sweep and find the best partition cutline/axis
-  vector<Entry> S(danger_node->entries);
+  vector<Entry *> S;//the sweeps sort pointers, the entries aren't copied
+  for (size_t i(0); i < danger_node->get_size(); ++i)
+    S.push_back(&(*danger_node)[i]);
   for (size_t current_dim(0); current_dim < N; ++current_dim) {
     pair<double, T> cost_and_cutline = sweep(current_dim, S);
+    if (!danger_node->is_leaf() && !separates(S, current_dim, cost_and_cutline.second))
+      continue;//every child would stay on the same side -> empty node
     double temp_min_cost = cheapest_cost;
     cheapest_cost = min(cost_and_cutline.first, cheapest_cost);
     if (cheapest_cost != temp_min_cost) {
@@ -361,70 +1731,413 @@ void RPlus<T, N, M, ff>::partition(shared_ptr<Node> &danger_node, size_t &optima
       optimal_dim = current_dim;
     }
   }
+  if (cheapest_cost == numeric_limits<double>::max()) {//no sweep cutline separates the children -> middle of the widest axis
+    T widest_extent = T(-1);
+    for (size_t current_dim(0); current_dim < N; ++current_dim) {
+      T low = ENTRY_LOW((*S[0]), current_dim), high = ENTRY_HIGH((*S[0]), current_dim);
+      for (Entry *entry : S) {
+        low = min(low, ENTRY_LOW((*entry), current_dim));
+        high = max(high, ENTRY_HIGH((*entry), current_dim));
+      }
+      if (high - low > widest_extent) {
+        widest_extent = high - low;
+        optimal_dim = current_dim;
+        optimal_cutline = low + (high - low) / 2;
+      }
+    }
+  }
+}
+
+//--SEPARATES: true if the cutline leaves some child on each side (no empty node after the split)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::separates(vector<Entry *> &S, size_t axis, T cutline) {
+  bool left = false, right = false;
+  for (Entry *entry : S) {
+    left = left || ENTRY_LOW((*entry), axis) < cutline || ENTRY_HIGH((*entry), axis) <= cutline;
+    right = right || ENTRY_HIGH((*entry), axis) > cutline;
+  }
+  return left && right;
 }
 
 /*SWEEP METHOD: Using sweep line method, this algorithm returns the cost and cutline for a given axis and an entry set.
                 ALG: partial sort(sweep line) + pick first ff entries + take the ff entry's max bound in the given axis as cutline.*/
-template<typename T, size_t N, size_t M, size_t ff>
-pair<double, T> RPlus<T, N, M, ff>::sweep(size_t axis, vector<Entry> &S) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+pair<double, T> RPlus<T, N, M, ff, Metric, Payload>::sweep(size_t axis, vector<Entry *> &S) {
+  TRACE_SPAN("sweep")
   comparator_ENTRYSINGLEDIM comparator(axis);
   partial_sort(S.begin(), S.begin() + ff, S.end(), comparator);//sort the first ff entries to "sweep" -> O((M + 1) log ff)
-  vector<Entry> grouped_test(S.begin(), S.begin() + ff);//picking the ff first entries of the sorted set
-  T optimal_cutline = GET_BOUNDARIES(grouped_test.back()).second[axis];
-  return make_pair(min_number_splits(grouped_test, axis, optimal_cutline), optimal_cutline);
+  T optimal_cutline = ENTRY_HIGH((*S[ff - 1]), axis);//the ff first entries of the sorted set are the group
+  return make_pair(min_number_splits(S, axis, optimal_cutline), optimal_cutline);
 }
 
-//MIN NUMBER OF SPLITS METHOD: Counts how many entries for a given set intersecs (need split) with a given cutline in given axis.
-template<typename T, size_t N, size_t M, size_t ff>
-int RPlus<T, N, M, ff>::min_number_splits(vector<Entry> &test_set, size_t axis, T optimal_cutline) {
+//MIN NUMBER OF SPLITS METHOD: Counts how many entries of the group (ff first of the sorted set) intersecs (need split) with a given cutline in given axis.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+int RPlus<T, N, M, ff, Metric, Payload>::min_number_splits(vector<Entry *> &S, size_t axis, T optimal_cutline) {
   int cost = 0;
-  if (!test_set[0].is_in_leaf()) {
-    for (Entry &entry : test_set) {
-      if (GET_BOUNDARIES(entry).first[axis] < optimal_cutline && GET_BOUNDARIES(entry).second[axis] > optimal_cutline)
+  if (!S[0]->is_in_leaf()) {
+    for (size_t i(0); i < ff; ++i) {
+      if (ENTRY_LOW((*S[i]), axis) < optimal_cutline && ENTRY_HIGH((*S[i]), axis) > optimal_cutline)
         ++cost;
     }
   }
   else {
-    for (Entry &entry : test_set) {
-      if (entry.data[axis] == optimal_cutline)
+    for (size_t i(0); i < ff; ++i) {
+      if (S[i]->data[axis] == optimal_cutline)
         ++cost;
     }
   }
   return cost;
 }
 
-//MINDIST METHOD: Calculates the distance between an hyperpoint and the nearest side of an hyperrectangle.
-template<typename T, size_t N, size_t M, size_t ff>
-double RPlus<T, N, M, ff>::MINDIST(HyperPoint<T, N> p, HyperRectangle<T, N> r) {
-  double sum = 0.0;
-  for (size_t i = size_t(0); i < N; ++i) {
-    if (p[i] < r.get_boundaries().first[i])
-      sum += pow(p[i] - r.get_boundaries().first[i], 2);
-    else if (p[i] > r.get_boundaries().second[i])
-      sum += pow(p[i] - r.get_boundaries().second[i], 2);
+//MINDIST METHOD: Distance between an hyperpoint and the nearest side of an hyperrectangle, given by the Metric policy.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+double RPlus<T, N, M, ff, Metric, Payload>::MINDIST(const HyperPoint<T, N, Payload> &p, const HyperRectangle<T, N> &r) {
+  return Metric::MINDIST(p, r);
+}
+
+//MINDIST METHOD (RECTANGLES): Distance between the nearest sides of two hyperrectangles, given by the Metric policy.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+double RPlus<T, N, M, ff, Metric, Payload>::MINDIST(const HyperRectangle<T, N> &r1, const HyperRectangle<T, N> &r2) {
+  return Metric::MINDIST(r1, r2);
+}
+
+//DIST METHOD: Distance between two hyperpoints, given by the Metric policy.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+double RPlus<T, N, M, ff, Metric, Payload>::DIST(const HyperPoint<T, N, Payload> &p1, const HyperPoint<T, N, Payload> &p2) {
+  return Metric::DIST(p1, p2);
+}
+
+/*FREEZE METHOD: Read-only compact copy of the tree for query-only periods. BFS over the nodes: the children of each node are
+                appended together, so in the frozen array they are consecutive and addressed by the offset of the first one,
+                and the data of the leaves is appended leaf by leaf in one contiguous array.
+                With leaf_bits > 0 the leaves are compressed too (codes of leaf_bits bits per coordinate) and with child_bits
+                (8 or 16) the MBRs of the children are quantized relative to their parent (and only the root keeps a full MBR), see FrozenRPlus.
+                The buffered data isn't pushed down (freeze doesn't write): the buffer of a node becomes one more frozen leaf, its
+                last child.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+FrozenRPlus<T, N, Metric> RPlus<T, N, M, ff, Metric, Payload>::freeze(size_t leaf_bits, size_t child_bits) {
+  FrozenRPlus<T, N, Metric> frozen;
+  frozen.normalization = normalization;
+  frozen.normalized_axes = normalized_axes;
+  shared_ptr<Node> current_root = get_root();
+  if (!current_root)
+    return frozen;
+  queue<pair<shared_ptr<Node>, bool>> bfs_q;//(node, only its buffer as a leaf)
+  bfs_q.push(make_pair(current_root, false));
+  frozen.nodes.resize(1);
+  for (size_t frozen_index(0); !bfs_q.empty(); ++frozen_index) {
+    shared_ptr<Node> current = bfs_q.front().first;
+    bool buffer_leaf = bfs_q.front().second;
+    bfs_q.pop();
+    HyperRectangle<T, N> bounds = (buffer_leaf) ? current->pending[0].get_mbr() : current->mbr;
+    for (size_t i(0); i < current->pending.size() && buffer_leaf; ++i)
+      bounds.adjust(current->pending[i].get_mbr());
+    for (size_t i(0); i < N; ++i) {
+      frozen.nodes[frozen_index].bottom_left[i] = bounds.get_bottom_left()[i];
+      frozen.nodes[frozen_index].top_right[i] = bounds.get_top_right()[i];
+    }
+    frozen.nodes[frozen_index].count = uint32_t((buffer_leaf) ? current->pending.size() : current->get_size());
+    frozen.nodes[frozen_index].leaf = buffer_leaf || current->is_leaf();
+    if (frozen.nodes[frozen_index].leaf) {
+      frozen.nodes[frozen_index].first = uint32_t(frozen.names.size());
+      for (size_t i(0); i < frozen.nodes[frozen_index].count; ++i) {
+        Entry &entry = current->data_entry(i);
+        for (size_t axis(0); axis < N; ++axis)
+          frozen.coordinates.push_back(entry.data[axis]);
+        if (normalized_axes) {
+          HyperPoint<T, N, Payload> given_data = entry.get_data();
+          for (size_t axis(0); axis < N; ++axis)
+            frozen.original_coordinates.push_back(given_data[axis]);
+        }
+        frozen.names.push_back(entry.data.get_songs_name());
+        frozen.attributes.push_back(entry.data.get_attributes());
+      }
+    }
+    else {
+      frozen.nodes[frozen_index].first = uint32_t(frozen.nodes.size());
+      frozen.nodes[frozen_index].count += uint32_t(!current->pending.empty());
+      frozen.nodes.resize(frozen.nodes.size() + frozen.nodes[frozen_index].count);
+      for (size_t i(0); i < current->get_size(); ++i)
+        bfs_q.push(make_pair((*current)[i].child, false));
+      if (!current->pending.empty())
+        bfs_q.push(make_pair(current, true));
+    }
   }
-  return sqrt(sum);
+  if (child_bits > 0)
+    frozen.quantize_children(child_bits);//before the leaves, their codes are relative to the decoded boxes
+  if (leaf_bits > 0)
+    frozen.compress_leaves(leaf_bits);
+  return frozen;
 }
 
-//EUCDIST METHOD: Simple function to calculate euclidean distance between two hyperpoints
-template<typename T, size_t N, size_t M, size_t ff>
-double RPlus<T, N, M, ff>::EUCDIST(HyperPoint<T, N> p1, HyperPoint<T, N> p2) {
-  double d = 0.0;
+/*REPACK METHOD: Incremental maintenance for trees that drift after many 1x1 insertions (low utilization, thin slabs of the cuts).
+                 (1) The degraded subtrees (see RepackPolicy) are found and their data is copied, (2) each one is rebuilt offline
+                 as a packed subtree of the same height (top-down: the data is cut in the axis of the widest spread into as many
+                 groups as children, so the children never overlap) and (3) it is published by path copying: the nodes from the
+                 root to its parent are copied with the new child and the new root is stored atomically.
+                 With a write_lock (the lock of the writers, see RepackingRPlus) only (1) and (3) hold it, the rebuild doesn't,
+                 and the queries never wait: they keep the root they took (old version) until they end.
+                 If the tree changed during the rebuild nothing is published (skipped), the next round finds it again.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+RepackReport RPlus<T, N, M, ff, Metric, Payload>::repack(const RepackPolicy &policy, mutex *write_lock) {
+  TRACE_SPAN("repack")
+  chrono::time_point<chrono::high_resolution_clock> start_time = chrono::high_resolution_clock::now();
+  RepackReport report = RepackReport();
+  vector<RepackJob> jobs;
+  size_t scanned_version;
+  size_t leaf_capacity = min(M, max(size_t(1), size_t(ceil(double(M) * policy.fill))));
+  {
+    unique_lock<mutex> guard = (write_lock) ? unique_lock<mutex>(*write_lock) : unique_lock<mutex>();
+    size_t height = 0;
+    for (Node *current = root.get(); !current->is_leaf(); current = (*current)[0].child.get())
+      ++height;
+    vector<size_t> path;
+    if (height > 1)
+      find_degraded(root, height, path, policy, leaf_capacity, jobs);
+    report.candidates = jobs.size();
+    sort(jobs.begin(), jobs.end(), [](const RepackJob &A, const RepackJob &B) { return A.utilization < B.utilization; });
+    if (jobs.size() > policy.max_jobs)
+      jobs.resize(policy.max_jobs);
+    for (RepackJob &job : jobs)
+      collect_entries(*job.subtree, job.data);
+    scanned_version = version;
+  }
+  for (RepackJob &job : jobs) {
+    job.packed_nodes = 0;
+    job.packed = pack(job.data, 0, job.data.size(), job.height, leaf_capacity, job.packed_nodes);
+  }
+  {
+    unique_lock<mutex> guard = (write_lock) ? unique_lock<mutex>(*write_lock) : unique_lock<mutex>();
+    for (RepackJob &job : jobs) {
+      if (version != scanned_version || !publish(job)) {
+        ++report.skipped;
+        continue;
+      }
+      ++report.repacked;
+      report.moved_data += job.data.size();
+      report.nodes_before += job.nodes;
+      report.nodes_after += job.packed_nodes;
+    }
+    if (report.repacked > 0)
+      ++version;
+  }
+  report.elapsed_ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start_time).count();
+  return report;
+}
+
+/*--GET ROOT: the current root for a read-only method (atomic load, a repack may publish a new root at the same time). The queries,
+             joins, all_kNN_graph, freeze, get_all_data and read_tree take it once and only traverse that version, the writers
+             (and repack) read root directly because they hold the lock of the writers, the only one under which it changes--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+shared_ptr<typename RPlus<T, N, M, ff, Metric, Payload>::Node> RPlus<T, N, M, ff, Metric, Payload>::get_root() {
+  return atomic_load(&root);
+}
+
+/*--FIND DEGRADED: data, leaves and nodes of the subtree (postorder). An internal node under the root that is degraded, small enough
+                   and whose packed version saves leaves (so a packed subtree isn't rebuilt again and again) becomes a job and
+                   replaces the jobs found inside it, so the jobs are the highest degraded subtrees--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+typename RPlus<T, N, M, ff, Metric, Payload>::SubtreeShape RPlus<T, N, M, ff, Metric, Payload>::find_degraded(shared_ptr<Node> &node, size_t height, vector<size_t> &path,
+                                                                                          const RepackPolicy &policy, size_t leaf_capacity,
+                                                                                          vector<RepackJob> &jobs) {
+  SubtreeShape shape = { node->get_size(), 1, 1 };
+  if (node->is_leaf())
+    return shape;
+  size_t first_job = jobs.size();
+  shape.data = node->pending.size();
+  shape.leaves = 0;
+  for (size_t i(0); i < node->get_size(); ++i) {
+    path.push_back(i);
+    SubtreeShape child_shape = find_degraded((*node)[i].child, height - 1, path, policy, leaf_capacity, jobs);
+    path.pop_back();
+    shape.data += child_shape.data;
+    shape.leaves += child_shape.leaves;
+    shape.nodes += child_shape.nodes;
+  }
+  double utilization = double(shape.data) / double(shape.leaves * M);
+  if (!path.empty() && shape.data > 0 && shape.data <= policy.max_subtree_data && (shape.data + leaf_capacity - 1) / leaf_capacity < shape.leaves &&
+      (utilization < policy.min_utilization || dead_space(*node) > policy.max_dead_space)) {
+    jobs.resize(first_job);//rebuilt with this one
+    RepackJob job;
+    job.path = path;
+    job.subtree = node.get();
+    job.height = height;
+    job.utilization = utilization;
+    job.nodes = shape.nodes;
+    jobs.push_back(job);
+  }
+  return shape;
+}
+
+//--DEAD SPACE: part of the MBR of an internal node that isn't covered by its children (their volumes relative to the node's one)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+double RPlus<T, N, M, ff, Metric, Payload>::dead_space(Node &node) {
+  const HyperPoint<T, N, Payload> &low = node.mbr.get_bottom_left(), &high = node.mbr.get_top_right();
+  double covered = 0.0;
+  for (size_t i(0); i < node.get_size(); ++i) {
+    const HyperRectangle<T, N> &child_mbr = node[i].get_mbr();
+    double fraction = 1.0;
+    for (size_t axis(0); axis < N; ++axis) {
+      double extent = double(high[axis]) - double(low[axis]);
+      if (extent > 0.0)
+        fraction *= (double(child_mbr.get_top_right()[axis]) - double(child_mbr.get_bottom_left()[axis])) / extent;
+    }
+    covered += fraction;
+  }
+  return max(0.0, 1.0 - covered);
+}
+
+//--COLLECT ENTRIES: the data of the leaves and of the buffers of a subtree--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::collect_entries(Node &node, vector<Entry> &S) {
+  S.insert(S.end(), node.pending.begin(), node.pending.end());
+  for (size_t i(0); i < node.get_size(); ++i) {
+    if (node.is_leaf())
+      S.push_back(node[i]);
+    else
+      collect_entries(*node[i].child, S);
+  }
+}
+
+/*--PACK: packed subtree of the given height with the data S[begin, end). The leaves are filled to leaf_capacity and each internal
+          node has the fewest children that keeps the height (never more than M), the data is cut in groups by pack_groups--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+shared_ptr<typename RPlus<T, N, M, ff, Metric, Payload>::Node> RPlus<T, N, M, ff, Metric, Payload>::pack(vector<Entry> &S, size_t begin, size_t end, size_t height,
+                                                                                     size_t leaf_capacity, size_t &nodes) {
+  shared_ptr<Node> node = make_shared<Node>();
+  ++nodes;
+  if (height == 0) {
+    for (size_t i(begin); i < end; ++i)
+      node->add(S[i]);
+    return node;
+  }
+  size_t n = end - begin, leaves = (n + leaf_capacity - 1) / leaf_capacity;
+  size_t child_capacity = M;//data that fits in a full subtree of height - 1
+  for (size_t level(1); level < height && child_capacity <= n; ++level)
+    child_capacity *= M;
+  auto power = [&](size_t base) {
+    size_t result = 1;
+    for (size_t level(0); level < height && result < leaves; ++level)
+      result *= base;
+    return result;
+  };
+  size_t groups = 1;
+  while (groups < M && (power(groups) < leaves || (n + groups - 1) / groups > child_capacity))
+    ++groups;
+  groups = min(groups, n);
+  vector<size_t> cuts;
+  pack_groups(S, begin, end, groups, child_capacity, cuts);
+  size_t group_begin = begin;
+  for (size_t group_end : cuts) {
+    shared_ptr<Node> child = pack(S, group_begin, group_end, height - 1, leaf_capacity, nodes);
+    Entry child_entry(child);
+    node->add(child_entry);
+    group_begin = group_end;
+  }
+  return node;
+}
+
+/*--PACK GROUPS: cuts S[begin, end) in groups of similar size (the end of each one goes to cuts). Binary cuts in the axis of the
+                 widest spread, moved (at most a quarter of a group) to a change of value so equal coordinates stay together--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::pack_groups(vector<Entry> &S, size_t begin, size_t end, size_t groups, size_t group_capacity, vector<size_t> &cuts) {
+  if (groups == 1) {
+    cuts.push_back(end);
+    return;
+  }
+  size_t axis = 0;
+  double widest = -1.0;
   for (size_t i(0); i < N; ++i) {
-    d += pow(p1[i] - p2[i], 2);
+    T low = S[begin].data[i], high = S[begin].data[i];
+    for (size_t j(begin + 1); j < end; ++j) {
+      low = min(low, S[j].data[i]);
+      high = max(high, S[j].data[i]);
+    }
+    if (double(high) - double(low) > widest) {
+      widest = double(high) - double(low);
+      axis = i;
+    }
   }
-  return sqrt(d);
+  sort(S.begin() + begin, S.begin() + end, [axis](const Entry &A, const Entry &B) { return A.data[axis] < B.data[axis]; });
+  size_t left_groups = groups / 2, right_groups = groups - left_groups;
+  size_t cut = begin + (end - begin) * left_groups / groups, slack = (end - begin) / (4 * groups);
+  auto valid_cut = [&](size_t position) {
+    return position >= begin + left_groups && position + right_groups <= end && position - begin <= left_groups * group_capacity &&
+      end - position <= right_groups * group_capacity && S[position - 1].data[axis] < S[position].data[axis];
+  };
+  for (size_t d(0); d <= slack; ++d) {
+    if (d <= cut - begin && valid_cut(cut - d)) {
+      cut -= d;
+      break;
+    }
+    if (cut + d < end && valid_cut(cut + d)) {
+      cut += d;
+      break;
+    }
+  }
+  pack_groups(S, begin, cut, left_groups, group_capacity, cuts);
+  pack_groups(S, cut, end, right_groups, group_capacity, cuts);
+}
+
+/*--PUBLISH: the packed subtree replaces the job's subtree. The nodes of the path are copied (the copies share every other child),
+             the id index points to the new leaves and copies, and the new root is stored atomically. False if the path changed--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::publish(RepackJob &job) {
+  vector<shared_ptr<Node>> path_nodes(1, root);
+  for (size_t level(0); level < job.path.size(); ++level) {
+    Node &current = *path_nodes.back();
+    if (current.is_leaf() || job.path[level] >= current.get_size())
+      return false;
+    path_nodes.push_back(current[job.path[level]].child);
+  }
+  if (path_nodes.back().get() != job.subtree)
+    return false;
+  stack<Node *> dfs_s;
+  dfs_s.push(job.subtree);
+  while (!dfs_s.empty()) {//the copies of the data leave the nodes of the old subtree...
+    Node &current = *dfs_s.top();
+    dfs_s.pop();
+    for (Entry &entry : current.pending)
+      id_index.erase(entry.data.get_songs_name(), &current);
+    for (size_t i(0); i < current.get_size(); ++i) {
+      if (current.is_leaf())
+        id_index.erase(current[i].data.get_songs_name(), &current);
+      else
+        dfs_s.push(current[i].child.get());
+    }
+  }
+  dfs_s.push(job.packed.get());
+  while (!dfs_s.empty()) {//...and are kept by the packed leaves
+    Node &current = *dfs_s.top();
+    dfs_s.pop();
+    for (size_t i(0); i < current.get_size(); ++i) {
+      if (current.is_leaf())
+        id_index.insert(current[i].data.get_songs_name(), &current);
+      else
+        dfs_s.push(current[i].child.get());
+    }
+  }
+  shared_ptr<Node> replacement = job.packed;
+  for (size_t level(job.path.size()); level > 0; --level) {
+    shared_ptr<Node> copy = make_shared<Node>(*path_nodes[level - 1]);
+    (*copy)[job.path[level - 1]].child = replacement;
+    index_data(copy->pending, path_nodes[level - 1].get(), copy.get());
+    replacement = copy;
+  }
+  atomic_store(&root, replacement);
+  return true;
 }
 
 //READ TREE METHOD: Using bfs, read the levels of the tree since the root.
-template<typename T, size_t N, size_t M, size_t ff>
-void RPlus<T, N, M, ff>::read_tree() {
-  if (root) {
-    root->print_node(true);
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::read_tree() {
+  shared_ptr<Node> current_root = get_root();
+  if (current_root) {
+    current_root->print_node(true);
     queue<shared_ptr<Node>> bfs_q;
-    for (size_t i(0); i < root->get_size(); ++i) {
-      if ((*root)[i].child)
-        bfs_q.push((*root)[i].child);
+    for (size_t i(0); i < current_root->get_size(); ++i) {
+      if ((*current_root)[i].child)
+        bfs_q.push((*current_root)[i].child);
     }
     while (!bfs_q.empty()) {
       for (size_t i(0); i < bfs_q.front()->get_size(); ++i) {
@@ -441,20 +2154,20 @@ void RPlus<T, N, M, ff>::read_tree() {
 
 //========================================NODE-IMPLEMENTATION==========================================
 
-template<typename T, size_t N, size_t M, size_t ff>
-RPlus<T, N, M, ff>::Node::Node() {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+RPlus<T, N, M, ff, Metric, Payload>::Node::Node() {
   entries.resize(M);
   size = size_t(0);
 }
 
-template<typename T, size_t N, size_t M, size_t ff>
-bool RPlus<T, N, M, ff>::Node::is_leaf() {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::Node::is_leaf() {
   return entries[0].is_in_leaf();
 }
 
 //Access to the entries of a node by index
-template<typename T, size_t N, size_t M, size_t ff>
-typename RPlus<T, N, M, ff>::Entry& RPlus<T, N, M, ff>::Node::operator[](size_t index) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+typename RPlus<T, N, M, ff, Metric, Payload>::Entry& RPlus<T, N, M, ff, Metric, Payload>::Node::operator[](size_t index) {
   try {
     if (index >= size) {
       throw runtime_error(ERROR_NODE_OFR);
@@ -469,48 +2182,74 @@ typename RPlus<T, N, M, ff>::Entry& RPlus<T, N, M, ff>::Node::operator[](size_t
   }
 }
 
+//Data kept by the node itself: the entries of a leaf, the buffer of an internal node
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+size_t RPlus<T, N, M, ff, Metric, Payload>::Node::data_count() {
+  return (is_leaf()) ? size : pending.size();
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+typename RPlus<T, N, M, ff, Metric, Payload>::Entry& RPlus<T, N, M, ff, Metric, Payload>::Node::data_entry(size_t index) {
+  return (is_leaf()) ? (*this)[index] : pending[index];
+}
+
 //add single entry
-template<typename T, size_t N, size_t M, size_t ff>
-void RPlus<T, N, M, ff>::Node::add(Entry &new_entry) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::Node::add(Entry &new_entry) {
   if (size == 0) {
     entries.resize(M);
     mbr = new_entry.get_mbr();
+#ifdef RPLUS_ATTRIBUTE_SUMMARIES
+    if constexpr (is_same<Payload, SongAttributes>::value)
+      summary = (new_entry.is_in_leaf()) ? AttributeSummary(new_entry.data.get_attributes()) : new_entry.child->summary;
+#endif
     entries[size++] = new_entry;
   }
   else {
     if (size >= M) {
       entries.resize(size + 1);
+      cover(new_entry);
       entries[size++] = new_entry;//saturated - temporaly break the rule : M entries per node as max
     }
     else {
-      mbr.adjust(new_entry.get_mbr());
+      cover(new_entry);
       entries[size++] = new_entry;
     }
   }
 }
 
+//The MBR (and the summary of the attributes) grows to cover the entry
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::Node::cover(Entry &entry) {
+  mbr.adjust(entry.get_mbr());
+#ifdef RPLUS_ATTRIBUTE_SUMMARIES
+  if constexpr (is_same<Payload, SongAttributes>::value)
+    summary.adjust((entry.is_in_leaf()) ? AttributeSummary(entry.data.get_attributes()) : entry.child->summary);
+#endif
+}
+
 //add many entries
-template<typename T, size_t N, size_t M, size_t ff>
-void RPlus<T, N, M, ff>::Node::add(vector<Entry> &S) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::Node::add(vector<Entry> &S) {
   for (Entry &entry : S) {
     add(entry);
   }
 }
 
 //Returns how many active entries has the node
-template<typename T, size_t N, size_t M, size_t ff>
-size_t RPlus<T, N, M, ff>::Node::get_size() {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+size_t RPlus<T, N, M, ff, Metric, Payload>::Node::get_size() {
   return size;
 }
 
 //Change how many active entries has the node
-template<typename T, size_t N, size_t M, size_t ff>
-void RPlus<T, N, M, ff>::Node::resize(size_t new_size) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::Node::resize(size_t new_size) {
   size = new_size;
 }
 
-template<typename T, size_t N, size_t M, size_t ff>
-void RPlus<T, N, M, ff>::Node::print_node(bool rp_root) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::Node::print_node(bool rp_root) {
   cout << "\tNODE : size(" << size << ") = [" << endl;
   cout << "\t\tA. ID : " << this << endl;
   cout << "\t\tB. Type : " << ((rp_root) ? "ROOT" : ((is_leaf()) ? "LEAF" : "INTERNAL")) << endl;
@@ -525,47 +2264,63 @@ void RPlus<T, N, M, ff>::Node::print_node(bool rp_root) {
 
 //=======================================ENTRY-IMPLEMENTATION==========================================
 
-template<typename T, size_t N, size_t M, size_t ff>
-RPlus<T, N, M, ff>::Entry::Entry() {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+RPlus<T, N, M, ff, Metric, Payload>::Entry::Entry() {
   //smart pointers did the job
 }
 
 //Entry for root and internal nodes
-template<typename T, size_t N, size_t M, size_t ff>
-RPlus<T, N, M, ff>::Entry::Entry(shared_ptr<Node> &child) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+RPlus<T, N, M, ff, Metric, Payload>::Entry::Entry(const shared_ptr<Node> &child) {
   this->child = child;
 }
 
 //Entry for leaves
-template<typename T, size_t N, size_t M, size_t ff>
-RPlus<T, N, M, ff>::Entry::Entry(HyperPoint<T, N> &data) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+RPlus<T, N, M, ff, Metric, Payload>::Entry::Entry(HyperPoint<T, N, Payload> &data) {
   this->data = data;
+  mbr = make_hyper_rect(data);
+}
+
+//Entry for leaves of a tree with normalized axes: the key is the normalized data, the given coordinates are kept beside it
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+RPlus<T, N, M, ff, Metric, Payload>::Entry::Entry(const HyperPoint<T, N, Payload> &given_data, const AxisNormalization<T, N> &normalization) {
+  array<T, N> coordinates;
+  for (size_t i(0); i < N; ++i)
+    coordinates[i] = given_data[i];
+  original = make_shared<const array<T, N>>(coordinates);
+  data = given_data;
+  normalization.apply(data);
+  mbr = make_hyper_rect(data);
 }
 
-//Copy for entry
-template<typename T, size_t N, size_t M, size_t ff>
-typename RPlus<T, N, M, ff>::Entry& RPlus<T, N, M, ff>::Entry::operator=(const Entry &other) {
-  child = other.child;
-  data = other.data;
-  return *this;
+//Data of a leaf entry as it was given (exact coordinates, not reverted from the normalized key)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+HyperPoint<T, N, Payload> RPlus<T, N, M, ff, Metric, Payload>::Entry::get_data() const {
+  HyperPoint<T, N, Payload> given_data = data;
+  if (original) {
+    for (size_t i(0); i < N; ++i)
+      given_data[i] = (*original)[i];
+  }
+  return given_data;
 }
 
-//If the entry is in a leaf node -> returns data made hyperrectangle (0 volume), else -> returns MBR of its child
-template<typename T, size_t N, size_t M, size_t ff>
-HyperRectangle<T, N> RPlus<T, N, M, ff>::Entry::get_mbr() {
+//If the entry is in a leaf node -> returns the cached data made hyperrectangle (0 volume), else -> returns MBR of its child (no copies)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+const HyperRectangle<T, N>& RPlus<T, N, M, ff, Metric, Payload>::Entry::get_mbr() const {
   if (!is_in_leaf()) {
     return child->mbr;
   }
-  return make_hyper_rect(data);
+  return mbr;
 }
 
-template<typename T, size_t N, size_t M, size_t ff>
-bool RPlus<T, N, M, ff>::Entry::is_in_leaf() {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+bool RPlus<T, N, M, ff, Metric, Payload>::Entry::is_in_leaf() const {
   return !child;
 }
 
-template<typename T, size_t N, size_t M, size_t ff>
-void RPlus<T, N, M, ff>::Entry::show_entry(size_t index) {
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+void RPlus<T, N, M, ff, Metric, Payload>::Entry::show_entry(size_t index) {
   cout << "\t\t" << char(192) << "->Entry<" << index << ">{\n";
   if (is_in_leaf())
     cout << "\t\t" << char(175) << " Data : ", data.show_data(), cout << "\t\t" << char(175) << " Song\'s name : " << data.get_songs_name() << endl;
@@ -573,4 +2328,6 @@ void RPlus<T, N, M, ff>::Entry::show_entry(size_t index) {
     cout << "\t\t" << char(175) << " Boundaries(child) : \n", get_mbr().show_rect();
   cout << "\t\t" << char(175) << " Child : " << child << endl;
   cout << "\t\t}\n";
-}
\ No newline at end of file
+}
+
+#endif //SOURCE_RPLUS_TREE_HPP
@@ -0,0 +1,244 @@
+#ifndef SOURCE_RPLUS_ASYNC_HPP
+#define SOURCE_RPLUS_ASYNC_HPP
+
+#include <RPlusTree.hpp>
+
+#include <condition_variable>
+#include <future>
+#include <shared_mutex>
+
+#define ASYNC_MAX_QUEUE 4096//Waiting queries before new ones are rejected (load shedding keeps the tail latency bounded)
+#define ASYNC_MAX_K 1048576//Largest k of kNN_async (the answer is built in memory by a worker)
+
+#define ERROR_ASYNC_THREADS "The asynchronous R+ Tree needs at least one worker thread."
+#define ERROR_ASYNC_STOPPED "The asynchronous R+ Tree is stopping, the query was not run."
+#define ERROR_ASYNC_QUEUE "The queue of the asynchronous R+ Tree is full, the query was rejected."
+#define ERROR_ASYNC_ARGUMENTS "The query has a coordinate that isn't finite or a k greater than ASYNC_MAX_K, it was not run."
+
+enum QueryStatus { QUERY_OK, QUERY_CANCELLED, QUERY_DEADLINE_EXCEEDED, QUERY_REJECTED, QUERY_FAILED };
+
+//Answer of an asynchronous query: the data only if status = QUERY_OK (cancelled or late queries may keep a partial answer)
+template<typename T, size_t N>
+struct QueryResult {
+  QueryStatus status;
+  vector<HyperPoint<T, N>> data;
+  string error;
+};
+
+/*TEMPLATE PARAMETERS: (1)data type | (2)number of dimensions | (3)max entries per node | (4)fill factor(by default = 2)
+                      | (5)distance policy(by default = L2Metric)
+  Approach: Front-end for an event loop. search_async and kNN_async return at once with a future, the query runs in a pool of
+            worker threads (many readers of the tree at the same time, assign/erase/update wait for them).
+  Deadline and cancellation: each query may have a QueryControl (timeout + cancel()), it is checked when the query leaves the
+                             queue and by the tree between node expansions, so a late or abandoned query stops using CPU.
+  Errors: the future gets a status (rejected when the queue is full, failed with the message of the error) and the
+          process is never terminated by a query: the arguments are checked before queueing and the workers run the variants
+          of the queries that throw (checked_search, checked_kNN_query) instead of the ones that end the process.*/
+template<typename T, size_t N, size_t M, size_t ff = 2, typename Metric = L2Metric>
+class AsyncRPlus {
+private:
+  typedef shared_ptr<promise<QueryResult<T, N>>> ResultPromise;
+
+  struct PendingQuery {
+    ResultPromise result;
+    shared_ptr<QueryControl> control;//alive until the query ends, even if the caller dropped it
+    function<vector<HyperPoint<T, N>>(QueryControl *)> query;
+  };
+
+  RPlus<T, N, M, ff, Metric> &tree;
+  shared_mutex tree_lock;
+
+  vector<thread> workers;
+  deque<PendingQuery> queue;
+  mutex queue_lock;
+  condition_variable queue_changed;
+  bool stopping;
+
+  future<QueryResult<T, N>> submit(shared_ptr<QueryControl> control,
+                                   function<vector<HyperPoint<T, N>>(QueryControl *)> query);
+  static void finish(ResultPromise &result, QueryStatus status, vector<HyperPoint<T, N>> data = vector<HyperPoint<T, N>>(),
+                     const string &error = string());
+  void run(PendingQuery &pending);
+  void work();
+  static bool finite(const HyperPoint<T, N> &point);
+
+public:
+  AsyncRPlus(RPlus<T, N, M, ff, Metric> &indexed_tree, size_t n_threads = thread::hardware_concurrency());
+  virtual ~AsyncRPlus();
+  size_t get_waiting();
+  void assign(vector<HyperPoint<T, N>> &unpacked_data);
+  bool erase(HyperPoint<T, N> data);
+  bool update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data);
+  future<QueryResult<T, N>> search_async(const HyperRectangle<T, N> &W, shared_ptr<QueryControl> control = nullptr);
+  future<QueryResult<T, N>> kNN_async(HyperPoint<T, N> refdata, size_t k, shared_ptr<QueryControl> control = nullptr);
+};
+
+//===============================ASYNC-R-PLUS-IMPLEMENTATION===========================================
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+AsyncRPlus<T, N, M, ff, Metric>::AsyncRPlus(RPlus<T, N, M, ff, Metric> &indexed_tree, size_t n_threads) : tree(indexed_tree) {
+  try {
+    if (n_threads == 0) {
+      throw runtime_error(ERROR_ASYNC_THREADS);
+    }
+    else {
+      stopping = false;
+      for (size_t i(0); i < n_threads; ++i)
+        workers.push_back(thread(&AsyncRPlus::work, this));
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//The queries still waiting are given back as rejected, the running ones end normally
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+AsyncRPlus<T, N, M, ff, Metric>::~AsyncRPlus() {
+  {
+    lock_guard<mutex> guard(queue_lock);
+    stopping = true;
+  }
+  queue_changed.notify_all();
+  for (thread &worker : workers)
+    worker.join();
+}
+
+//Queries waiting for a worker
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+size_t AsyncRPlus<T, N, M, ff, Metric>::get_waiting() {
+  lock_guard<mutex> guard(queue_lock);
+  return queue.size();
+}
+
+//ASSIGN METHOD: Waits until the running queries end and inserts the data (the queries wait for the insertion)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void AsyncRPlus<T, N, M, ff, Metric>::assign(vector<HyperPoint<T, N>> &unpacked_data) {
+  unique_lock<shared_mutex> guard(tree_lock);
+  tree.assign(unpacked_data);
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool AsyncRPlus<T, N, M, ff, Metric>::erase(HyperPoint<T, N> data) {
+  unique_lock<shared_mutex> guard(tree_lock);
+  return tree.erase(data);
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool AsyncRPlus<T, N, M, ff, Metric>::update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data) {
+  unique_lock<shared_mutex> guard(tree_lock);
+  return tree.update(old_data, new_data);
+}
+
+//ASYNC RANGE QUERY METHOD: range query in the pool, the future gets the answer or why there is no answer
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+future<QueryResult<T, N>> AsyncRPlus<T, N, M, ff, Metric>::search_async(const HyperRectangle<T, N> &W, shared_ptr<QueryControl> control) {
+  HyperRectangle<T, N> window = W;
+  if (!finite(W.get_bottom_left()) || !finite(W.get_top_right())) {
+    ResultPromise result = make_shared<promise<QueryResult<T, N>>>();
+    finish(result, QUERY_FAILED, vector<HyperPoint<T, N>>(), ERROR_ASYNC_ARGUMENTS);
+    return result->get_future();
+  }
+  return submit(control, [this, window](QueryControl *query_control) {
+    return tree.checked_search(window, AttributePredicate(), query_control);
+  });
+}
+
+//ASYNC KNN METHOD: kNN in the pool, the future gets the answer or why there is no answer
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+future<QueryResult<T, N>> AsyncRPlus<T, N, M, ff, Metric>::kNN_async(HyperPoint<T, N> refdata, size_t k, shared_ptr<QueryControl> control) {
+  if (!finite(refdata) || k > ASYNC_MAX_K) {
+    ResultPromise result = make_shared<promise<QueryResult<T, N>>>();
+    finish(result, QUERY_FAILED, vector<HyperPoint<T, N>>(), ERROR_ASYNC_ARGUMENTS);
+    return result->get_future();
+  }
+  return submit(control, [this, refdata, k](QueryControl *query_control) {
+    return tree.checked_kNN_query(refdata, k, AttributePredicate(), query_control);
+  });
+}
+
+//--SUBMIT: queues the query (or rejects it when the queue is full)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+future<QueryResult<T, N>> AsyncRPlus<T, N, M, ff, Metric>::submit(shared_ptr<QueryControl> control,
+                                                                  function<vector<HyperPoint<T, N>>(QueryControl *)> query) {
+  ResultPromise result = make_shared<promise<QueryResult<T, N>>>();
+  future<QueryResult<T, N>> answer = result->get_future();
+  if (!control)
+    control = make_shared<QueryControl>();
+  {
+    lock_guard<mutex> guard(queue_lock);
+    if (stopping || queue.size() >= ASYNC_MAX_QUEUE) {
+      finish(result, QUERY_REJECTED, vector<HyperPoint<T, N>>(), (stopping) ? ERROR_ASYNC_STOPPED : ERROR_ASYNC_QUEUE);
+      return answer;
+    }
+    queue.push_back(PendingQuery{ result, control, move(query) });
+  }
+  queue_changed.notify_one();
+  return answer;
+}
+
+//--RUN: a query that left the queue, it isn't run if it was abandoned or got late while waiting--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void AsyncRPlus<T, N, M, ff, Metric>::run(PendingQuery &pending) {
+  QueryControl &control = *pending.control;
+  if (control.stopped()) {
+    finish(pending.result, (control.cancelled.load()) ? QUERY_CANCELLED : QUERY_DEADLINE_EXCEEDED);
+    return;
+  }
+  try {
+    shared_lock<shared_mutex> guard(tree_lock);
+    vector<HyperPoint<T, N>> data = pending.query(&control);
+    if (control.interrupted)
+      finish(pending.result, (control.cancelled.load()) ? QUERY_CANCELLED : QUERY_DEADLINE_EXCEEDED, move(data));
+    else
+      finish(pending.result, QUERY_OK, move(data));
+  }
+  catch (const exception &error) {
+    finish(pending.result, QUERY_FAILED, vector<HyperPoint<T, N>>(), error.what());
+  }
+}
+
+//--FINISH: sets the value of the future--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void AsyncRPlus<T, N, M, ff, Metric>::finish(ResultPromise &result, QueryStatus status, vector<HyperPoint<T, N>> data, const string &error) {
+  QueryResult<T, N> query_result;
+  query_result.status = status;
+  query_result.data = move(data);
+  query_result.error = error;
+  result->set_value(move(query_result));
+}
+
+//--FINITE: no NaN nor infinite coordinate (always true for integral types)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool AsyncRPlus<T, N, M, ff, Metric>::finite(const HyperPoint<T, N> &point) {
+  for (size_t i(0); i < N; ++i) {
+    if (!isfinite(double(point[i])))
+      return false;
+  }
+  return true;
+}
+
+//--WORK: loop of each worker (when the executor stops, the queue is drained with rejections)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void AsyncRPlus<T, N, M, ff, Metric>::work() {
+  while (true) {
+    PendingQuery pending;
+    bool rejected;
+    {
+      unique_lock<mutex> guard(queue_lock);
+      queue_changed.wait(guard, [this]() { return stopping || !queue.empty(); });
+      if (queue.empty())
+        return;
+      pending = move(queue.front());
+      queue.pop_front();
+      rejected = stopping;
+    }
+    if (rejected)
+      finish(pending.result, QUERY_REJECTED, vector<HyperPoint<T, N>>(), ERROR_ASYNC_STOPPED);
+    else
+      run(pending);
+  }
+}
+
+#endif //SOURCE_RPLUS_ASYNC_HPP
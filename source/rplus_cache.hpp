@@ -0,0 +1,326 @@
+#ifndef SOURCE_RPLUS_CACHE_HPP
+#define SOURCE_RPLUS_CACHE_HPP
+
+#include <RPlusTree.hpp>
+
+#include <cstring>
+#include <list>
+#include <shared_mutex>
+
+#define CACHE_DEFAULT_CAPACITY 4096//Cached results of queries
+#define CACHE_SKETCH_ROWS 4//Rows (hash functions) of the count-min sketch of TinyLFU
+#define CACHE_SKETCH_MAX 15//Max count of a cell (4 bits of frequency are enough to tell hot keys from cold keys)
+
+#define ERROR_CACHE_CAPACITY "The capacity of the query cache should be greater than 0."
+
+enum CachePolicy { CACHE_LRU, CACHE_TINY_LFU };
+
+/*Count-min sketch with aging (TinyLFU): approximate frequency of the last keys seen. After sample_size increments every cell is
+  halved, so the frequencies follow the recent popularity and not the whole history.*/
+class FrequencySketch {
+private:
+  vector<uint8_t> cells;//CACHE_SKETCH_ROWS rows of width cells
+  size_t width, increments, sample_size;
+
+  inline size_t cell(size_t row, size_t key_hash) const;
+
+public:
+  FrequencySketch(size_t capacity = 1);
+  void increment(size_t key_hash);
+  uint8_t estimate(size_t key_hash) const;
+};
+
+inline FrequencySketch::FrequencySketch(size_t capacity) {
+  width = 1;
+  while (width < capacity)
+    width <<= 1;
+  cells.assign(CACHE_SKETCH_ROWS * width, 0);
+  increments = 0;
+  sample_size = 10 * width;
+}
+
+//--CELL: one position per row, the rows use different mixes of the same hash--
+inline size_t FrequencySketch::cell(size_t row, size_t key_hash) const {
+  uint64_t mixed = (uint64_t(key_hash) + row) * 0x9E3779B97F4A7C15ull;
+  mixed ^= mixed >> 32;
+  return row * width + size_t(mixed & (width - 1));
+}
+
+inline void FrequencySketch::increment(size_t key_hash) {
+  for (size_t row(0); row < CACHE_SKETCH_ROWS; ++row) {
+    uint8_t &count = cells[cell(row, key_hash)];
+    if (count < CACHE_SKETCH_MAX)
+      ++count;
+  }
+  if (++increments == sample_size) {//aging
+    for (uint8_t &count : cells)
+      count >>= 1;
+    increments /= 2;
+  }
+}
+
+inline uint8_t FrequencySketch::estimate(size_t key_hash) const {
+  uint8_t frequency = CACHE_SKETCH_MAX;
+  for (size_t row(0); row < CACHE_SKETCH_ROWS; ++row)
+    frequency = min(frequency, cells[cell(row, key_hash)]);
+  return frequency;
+}
+
+/*TEMPLATE PARAMETERS: (1)data type | (2)number of dimensions | (3)max entries per node | (4)fill factor(by default = 2)
+                      | (5)distance policy(by default = L2Metric)
+  Approach: RPlus + cache of query results in front of kNN_query and search. The key is the query (refdata and k, or the window),
+            the value is the result and the region it depends on: the kNN ball (refdata, distance of the k-th neighbor) or the window.
+  Eviction: LRU list. With CACHE_TINY_LFU a new result only takes the place of the LRU result when its query was asked more often
+            (frequency sketch), so a scan of cold queries doesn't flush the hot ones.
+  Invalidation: each write (a whole assign, an erase, an update) makes one pass over the cache and drops the results whose region
+                meets the bounding box of the changed data (a kNN result with less than k neighbors depends on the whole space).
+                The other results are still exact.
+  Concurrency: the queries read the tree together (shared lock of the tree, the writes wait for them) and the cache lock is only
+               taken to look up and to store a result, never during the traversal.
+  Don't write to get_tree() directly: those changes don't invalidate the cache.*/
+template<typename T, size_t N, size_t M, size_t ff = 2, typename Metric = L2Metric>
+class CachedRPlus {
+private:
+  struct CachedResult {
+    string key;
+    vector<HyperPoint<T, N>> result;
+    bool is_kNN;
+    HyperPoint<T, N> center;//kNN: refdata (space of the tree)
+    double radius;//kNN: distance of the k-th neighbor
+    HyperRectangle<T, N> window;//range query: window (original units)
+  };
+
+  RPlus<T, N, M, ff, Metric> tree;
+  AxisNormalization<T, N> normalization;
+  bool normalized_axes;
+
+  shared_mutex tree_lock;//queries share it, writes take it alone
+  mutex cache_lock;//everything below
+  list<CachedResult> recency;//most recently used first
+  unordered_map<string, typename list<CachedResult>::iterator> cached;
+  FrequencySketch sketch;
+  CachePolicy policy;
+  size_t capacity, hits, misses;
+
+  static string make_key(char kind, const HyperPoint<T, N> &first, const HyperPoint<T, N> &second, size_t k);
+  bool lookup(const string &key, vector<HyperPoint<T, N>> &result);
+  void store(CachedResult &&cached_result);
+  void invalidate(vector<HyperPoint<T, N>> &changed);
+
+public:
+  CachedRPlus(size_t cache_capacity = CACHE_DEFAULT_CAPACITY, CachePolicy cache_policy = CACHE_TINY_LFU);
+  RPlus<T, N, M, ff, Metric>& get_tree();
+  void set_normalization(const AxisNormalization<T, N> &axes_normalization);
+  void assign(vector<HyperPoint<T, N>> &unpacked_data);
+  bool erase(HyperPoint<T, N> data);
+  bool update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data);
+  void clear_cache();
+  size_t get_cached();
+  double get_hit_ratio();
+  vector<HyperPoint<T, N>> search(const HyperRectangle<T, N> &W);
+  vector<HyperPoint<T, N>> kNN_query(HyperPoint<T, N> refdata, size_t k);
+};
+
+//===============================CACHED-R-PLUS-IMPLEMENTATION==========================================
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+CachedRPlus<T, N, M, ff, Metric>::CachedRPlus(size_t cache_capacity, CachePolicy cache_policy) : sketch(cache_capacity) {
+  try {
+    if (cache_capacity == 0) {
+      throw runtime_error(ERROR_CACHE_CAPACITY);
+    }
+    else {
+      capacity = cache_capacity;
+      policy = cache_policy;
+      hits = misses = 0;
+      normalized_axes = false;
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//The tree behind the cache (only to read it or to set its insertion buffer)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+RPlus<T, N, M, ff, Metric>& CachedRPlus<T, N, M, ff, Metric>::get_tree() {
+  return tree;
+}
+
+//The kNN balls are measured in the space of the tree, so the cache keeps the same normalization
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void CachedRPlus<T, N, M, ff, Metric>::set_normalization(const AxisNormalization<T, N> &axes_normalization) {
+  unique_lock<shared_mutex> tree_guard(tree_lock);
+  lock_guard<mutex> guard(cache_lock);
+  tree.set_normalization(axes_normalization);
+  normalization = axes_normalization;
+  normalized_axes = true;
+}
+
+//ASSIGN METHOD: Inserts the data in the tree and drops the cached results that the batch could change (one pass over the cache)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void CachedRPlus<T, N, M, ff, Metric>::assign(vector<HyperPoint<T, N>> &unpacked_data) {
+  unique_lock<shared_mutex> tree_guard(tree_lock);
+  tree.assign(unpacked_data);
+  invalidate(unpacked_data);
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool CachedRPlus<T, N, M, ff, Metric>::erase(HyperPoint<T, N> data) {
+  unique_lock<shared_mutex> tree_guard(tree_lock);
+  if (!tree.erase(data))
+    return false;
+  vector<HyperPoint<T, N>> changed(1, data);
+  invalidate(changed);
+  return true;
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool CachedRPlus<T, N, M, ff, Metric>::update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data) {
+  unique_lock<shared_mutex> tree_guard(tree_lock);
+  if (!tree.update(old_data, new_data))
+    return false;
+  vector<HyperPoint<T, N>> changed(1, old_data);
+  invalidate(changed);
+  changed[0] = new_data;//one pass per version: a box around both would drop everything between them
+  invalidate(changed);
+  return true;
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void CachedRPlus<T, N, M, ff, Metric>::clear_cache() {
+  lock_guard<mutex> guard(cache_lock);
+  recency.clear();
+  cached.clear();
+}
+
+//Number of cached results
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+size_t CachedRPlus<T, N, M, ff, Metric>::get_cached() {
+  lock_guard<mutex> guard(cache_lock);
+  return cached.size();
+}
+
+//Hits / queries since the creation of the cache
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+double CachedRPlus<T, N, M, ff, Metric>::get_hit_ratio() {
+  lock_guard<mutex> guard(cache_lock);
+  return (hits + misses == 0) ? 0.0 : double(hits) / double(hits + misses);
+}
+
+//RANGE QUERY METHOD: cached result of the same window, otherwise range query in the tree (the window is the region of the result)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> CachedRPlus<T, N, M, ff, Metric>::search(const HyperRectangle<T, N> &W) {
+  shared_lock<shared_mutex> tree_guard(tree_lock);
+  CachedResult cached_result;
+  cached_result.key = make_key('W', W.get_bottom_left(), W.get_top_right(), 0);
+  if (lookup(cached_result.key, cached_result.result))
+    return cached_result.result;
+  cached_result.result = tree.search(W);
+  cached_result.is_kNN = false;
+  cached_result.window = W;
+  vector<HyperPoint<T, N>> range_query = cached_result.result;
+  store(move(cached_result));
+  return range_query;
+}
+
+/*KNN METHOD: cached result of the same refdata and k, otherwise kNN in the tree. The region of the result is the ball around refdata
+              with the distance of the k-th neighbor (measured like the tree does, in its space).*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> CachedRPlus<T, N, M, ff, Metric>::kNN_query(HyperPoint<T, N> refdata, size_t k) {
+  shared_lock<shared_mutex> tree_guard(tree_lock);
+  CachedResult cached_result;
+  cached_result.key = make_key('K', refdata, refdata, k);
+  if (lookup(cached_result.key, cached_result.result))
+    return cached_result.result;
+  cached_result.result = tree.kNN_query(refdata, k);
+  cached_result.is_kNN = true;
+  cached_result.center = refdata;
+  if (normalized_axes)
+    normalization.apply(cached_result.center);
+  cached_result.radius = numeric_limits<double>::infinity();//less than k neighbors: any new data is a neighbor
+  if (k > 0 && cached_result.result.size() == k) {
+    HyperPoint<T, N> kth_neighbor = cached_result.result.back();
+    if (normalized_axes)
+      normalization.apply(kth_neighbor);
+    cached_result.radius = Metric::DIST(cached_result.center, kth_neighbor);
+  }
+  vector<HyperPoint<T, N>> kNN = cached_result.result;
+  store(move(cached_result));
+  return kNN;
+}
+
+//--MAKE KEY: kind of query + k + the bytes of the coordinates (the name of the hyperpoint doesn't change the answer)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+string CachedRPlus<T, N, M, ff, Metric>::make_key(char kind, const HyperPoint<T, N> &first, const HyperPoint<T, N> &second, size_t k) {
+  string key(1 + sizeof(size_t) + 2 * N * sizeof(T), kind);
+  char *bytes = &key[1];
+  memcpy(bytes, &k, sizeof(size_t));
+  bytes += sizeof(size_t);
+  for (size_t i(0); i < N; ++i, bytes += 2 * sizeof(T)) {
+    T low = first[i], high = second[i];
+    memcpy(bytes, &low, sizeof(T));
+    memcpy(bytes + sizeof(T), &high, sizeof(T));
+  }
+  return key;
+}
+
+//--LOOKUP: a hit moves the result to the front of the LRU list, every query counts in the frequency sketch--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool CachedRPlus<T, N, M, ff, Metric>::lookup(const string &key, vector<HyperPoint<T, N>> &result) {
+  lock_guard<mutex> guard(cache_lock);
+  if (policy == CACHE_TINY_LFU)
+    sketch.increment(hash<string>()(key));
+  typename unordered_map<string, typename list<CachedResult>::iterator>::iterator found = cached.find(key);
+  if (found == cached.end()) {
+    ++misses;
+    return false;
+  }
+  ++hits;
+  recency.splice(recency.begin(), recency, found->second);
+  result = found->second->result;
+  return true;
+}
+
+/*--STORE: a full cache evicts its LRU result (TinyLFU: only if the new query is more frequent than that result). Nothing is stored
+           if a query that ran at the same time already stored the same key--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void CachedRPlus<T, N, M, ff, Metric>::store(CachedResult &&cached_result) {
+  lock_guard<mutex> guard(cache_lock);
+  if (cached.count(cached_result.key))
+    return;
+  if (cached.size() == capacity) {
+    CachedResult &victim = recency.back();
+    if (policy == CACHE_TINY_LFU && sketch.estimate(hash<string>()(cached_result.key)) <= sketch.estimate(hash<string>()(victim.key)))
+      return;
+    cached.erase(victim.key);
+    recency.pop_back();
+  }
+  recency.push_front(move(cached_result));
+  cached[recency.front().key] = recency.begin();
+}
+
+/*--INVALIDATE: one pass over the cache for a whole write, drops the cached results whose region meets the bounding box of the changed
+                data (a window that overlaps it, a kNN ball whose MINDIST to it is <= radius)--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void CachedRPlus<T, N, M, ff, Metric>::invalidate(vector<HyperPoint<T, N>> &changed) {
+  lock_guard<mutex> guard(cache_lock);
+  if (changed.empty())
+    return;
+  HyperRectangle<T, N> box = make_hyper_rect(changed[0]);
+  for (HyperPoint<T, N> &data : changed)
+    box.adjust(make_hyper_rect(data));
+  HyperRectangle<T, N> box_in_tree = (normalized_axes) ? normalization.apply(box) : box;
+  for (typename list<CachedResult>::iterator it = recency.begin(); it != recency.end();) {
+    bool touched = (it->is_kNN) ? Metric::MINDIST(it->center, box_in_tree) <= it->radius : it->window.overlaps(box);
+    if (touched) {
+      cached.erase(it->key);
+      it = recency.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+
+#endif //SOURCE_RPLUS_CACHE_HPP
@@ -0,0 +1,654 @@
+#ifndef SOURCE_RPLUS_FROZEN_HPP
+#define SOURCE_RPLUS_FROZEN_HPP
+
+#include <rplus_utils.hpp>
+
+#define FROZEN_CACHE_LINE 64
+#define FROZEN_MAX_LEAF_BITS 16//Max bits per coordinate of a compressed leaf
+#define FROZEN_DECODE_BLOCK 64//Data decoded together in a compressed leaf
+#define FROZEN_CHILD_CODE_LINES 16//Max cache lines of child codes per node with quantized children (bounds the packed fanout)
+
+#define ERROR_FROZEN_CHILD_BITS "The bits of the quantized child MBRs should be 8 or 16 (0 = full MBRs)."
+#define ERROR_FROZEN_LEAF_BITS "The bits per coordinate of the compressed leaves should be between 1 and 16 (0 = not compressed)."
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric, typename Payload>
+class RPlus;
+
+/*TEMPLATE PARAMETERS: (1)data type | (2)number of dimensions | (3)distance policy(by default = L2Metric)
+  Approach: Read-only copy of a built RPlus (RPlus::freeze), no shared_ptr and no vector<Entry> per node. All the nodes live in one
+            array of cache-line aligned nodes in BFS order: the children of a node are consecutive, so a node only keeps the offset
+            of its first child. The data of the leaves is contiguous too (coordinates in one array, names and attributes in others).
+  Compressed leaves (freeze with leaf_bits > 0): each coordinate is also kept as a code of leaf_bits bits relative to the MBR of its
+            leaf (bit-packed, N * leaf_bits bits per data), the queries read the codes and the exact coordinates become a side store:
+            a range query only reads them for data whose cell crosses the window, a kNN only for data whose cell is nearer than the
+            k-th distance. The answers are the same as without compression.
+  Quantized child MBRs (freeze with child_bits = 8 or 16): only the root keeps its full MBR, the nodes are 12 bytes (no MBR) and
+            the MBR of each child is kept as codes relative to the box decoded for its parent (low code rounded down, high code
+            rounded up, so the decoded box covers the real one and so every box of its subtree), 2 * N * child_bits / 8 bytes each.
+            The traversal decodes the boxes on the way down, and the compressed leaves are relative to the decoded box of the leaf.
+            A node takes its grandchildren as children while they fit in FROZEN_CHILD_CODE_LINES cache lines of codes, so the
+            fanout grows, the height drops and the memory drops (get_total_bytes).
+  Operations that you are able to do: range query(search), k-nearest neighbors query(kNN_query).*/
+template<typename T, size_t N, typename Metric = L2Metric>
+class FrozenRPlus {
+private:
+  struct alignas(FROZEN_CACHE_LINE) FrozenNode {
+    array<T, N> bottom_left, top_right;
+    uint32_t first;//internal: position of the first child in nodes | leaf: position of the first data
+    uint32_t count;
+    bool leaf;
+  };
+
+  struct QuantizedNode {
+    uint32_t first;//internal: position of the first child in quantized_nodes | leaf: position of the first data
+    uint32_t count;
+    bool leaf;
+  };
+
+  struct QuantizedVisit {//a node with the box decoded for it
+    uint32_t node;
+    array<T, N> low, high;
+  };
+
+  vector<FrozenNode> nodes;//nodes[0] is the root (empty with quantized children)
+  vector<QuantizedNode> quantized_nodes;//only with quantized children: quantized_nodes[0] is the root
+  array<T, N> root_low, root_high;//only with quantized children: the full MBR of the root, the other boxes are decoded from it
+  vector<T> coordinates;//N values per data
+  vector<T> original_coordinates;//only with normalized axes: N values per data as they were given (coordinates keeps the normalized ones)
+  vector<string> names;
+  vector<SongAttributes> attributes;
+  AxisNormalization<T, N> normalization;
+  bool normalized_axes;
+
+  size_t leaf_bits;//0 = leaves not compressed
+  size_t child_bits;//0 = children pruned with their full MBRs
+  vector<uint8_t> child_bounds;//2 * N codes per node but the root (low codes, high codes) relative to its parent, child_bits / 8 bytes each
+  vector<uint64_t> packed_codes;//N codes per data, leaf_bits each, same order as coordinates
+
+  static inline bool overlaps(const array<T, N> &node_low, const array<T, N> &node_high, const array<T, N> &low, const array<T, N> &high);
+  inline HyperPoint<T, N> make_result(size_t data_index);
+  void compress_leaves(size_t bits);
+  void quantize_children(size_t bits);
+  template<typename Visit>
+  void for_each_leaf(Visit visit);
+  inline size_t child_code(uint32_t child, size_t bound);
+  inline void child_steps(const array<T, N> &parent_low, const array<T, N> &parent_high, array<double, N> &step);
+  inline void child_box(const array<T, N> &parent_low, const array<T, N> &parent_high, uint32_t child, const array<double, N> &step,
+                        array<T, N> &low, array<T, N> &high);
+  void search_quantized(const array<T, N> &low, const array<T, N> &high, vector<HyperPoint<T, N>> &range_query);
+  template<typename Visit>
+  void kNN_quantized(const array<T, N> &ref, Visit visit);
+  inline void decode_codes(size_t first_code, size_t count, uint32_t *codes);
+  void search_leaf(uint32_t first, uint32_t count, const array<T, N> &leaf_low, const array<T, N> &leaf_high, const array<T, N> &low,
+                   const array<T, N> &high, vector<HyperPoint<T, N>> &range_query);
+  template<typename Visit>
+  double scan_leaf(uint32_t first, uint32_t count, const array<T, N> &leaf_low, const array<T, N> &leaf_high, const array<T, N> &ref,
+                   double kth_distance, Visit visit);
+  void search_compressed_leaf(uint32_t first, uint32_t count, const array<T, N> &leaf_low, const array<T, N> &leaf_high, const array<T, N> &low,
+                              const array<T, N> &high, vector<HyperPoint<T, N>> &range_query);
+  template<typename Visit>
+  double scan_compressed_leaf(uint32_t first, uint32_t count, const array<T, N> &leaf_low, const array<T, N> &leaf_high, const array<T, N> &ref,
+                              double kth_distance, Visit visit);
+
+  template<typename, size_t, size_t, size_t, typename, typename>
+  friend class RPlus;
+
+public:
+  FrozenRPlus();
+  size_t get_size();
+  size_t get_leaf_bytes();
+  size_t get_child_bound_bytes();
+  size_t get_total_bytes();
+  size_t get_height();
+  vector<HyperPoint<T, N>> search(const HyperRectangle<T, N> &W);
+  vector<HyperPoint<T, N>> kNN_query(HyperPoint<T, N> refdata, size_t k);
+};
+
+//===============================FROZEN-R-PLUS-IMPLEMENTATION==========================================
+
+template<typename T, size_t N, typename Metric>
+FrozenRPlus<T, N, Metric>::FrozenRPlus() {
+  normalized_axes = false;
+  leaf_bits = 0;
+  child_bits = 0;
+}
+
+//Number of data in the frozen tree
+template<typename T, size_t N, typename Metric>
+size_t FrozenRPlus<T, N, Metric>::get_size() {
+  return names.size();
+}
+
+//Bytes read by the queries for the coordinates of the leaves (the codes if compressed, the exact side store isn't counted)
+template<typename T, size_t N, typename Metric>
+size_t FrozenRPlus<T, N, Metric>::get_leaf_bytes() {
+  return (leaf_bits > 0) ? packed_codes.size() * sizeof(uint64_t) : coordinates.size() * sizeof(T);
+}
+
+//Bytes of the bounds of the children, read by the traversal to prune them (the codes if quantized, else the MBRs in the frozen nodes)
+template<typename T, size_t N, typename Metric>
+size_t FrozenRPlus<T, N, Metric>::get_child_bound_bytes() {
+  return (child_bits > 0) ? child_bounds.size() : (nodes.empty() ? 0 : (nodes.size() - 1) * 2 * N * sizeof(T));
+}
+
+//Memory of the frozen tree: nodes (and the MBR of the root if quantized), coordinates (and codes), child codes, names and attributes
+template<typename T, size_t N, typename Metric>
+size_t FrozenRPlus<T, N, Metric>::get_total_bytes() {
+  size_t total = nodes.size() * sizeof(FrozenNode) + quantized_nodes.size() * sizeof(QuantizedNode) + ((child_bits > 0) ? 2 * N * sizeof(T) : 0) +
+    (coordinates.size() + original_coordinates.size()) * sizeof(T) + packed_codes.size() * sizeof(uint64_t) + child_bounds.size() +
+    attributes.size() * sizeof(SongAttributes) + names.size() * sizeof(string);
+  for (const string &name : names)
+    total += (name.capacity() > string().capacity()) ? name.capacity() : 0;//only names that don't fit inside the string
+  return total;
+}
+
+//Levels of nodes from the root to the leaves (0 if empty, the longest path if quantized: the packed levels differ between subtrees)
+template<typename T, size_t N, typename Metric>
+size_t FrozenRPlus<T, N, Metric>::get_height() {
+  size_t height = 0;
+  if (child_bits > 0) {
+    vector<pair<uint32_t, size_t>> dfs_s(1, make_pair(uint32_t(0), size_t(1)));
+    while (!dfs_s.empty() && !quantized_nodes.empty()) {
+      pair<uint32_t, size_t> current = dfs_s.back();
+      dfs_s.pop_back();
+      height = max(height, current.second);
+      const QuantizedNode &node = quantized_nodes[current.first];
+      for (uint32_t child(node.first); child < node.first + node.count && !node.leaf; ++child)
+        dfs_s.push_back(make_pair(child, current.second + 1));
+    }
+    return height;
+  }
+  for (size_t current(0); current < nodes.size(); current = nodes[current].first) {
+    ++height;
+    if (nodes[current].leaf)
+      break;
+  }
+  return height;
+}
+
+//RANGE QUERY METHOD: dfs over the node offsets, the data of each leaf is read as one contiguous block.
+template<typename T, size_t N, typename Metric>
+vector<HyperPoint<T, N>> FrozenRPlus<T, N, Metric>::search(const HyperRectangle<T, N> &query_window) {
+  vector<HyperPoint<T, N>> range_query;
+  if (nodes.empty() && quantized_nodes.empty())
+    return range_query;
+  pair<HyperPoint<T, N>, HyperPoint<T, N>> bounds = ((normalized_axes) ? normalization.apply(query_window) : query_window).get_boundaries();
+  array<T, N> low, high;
+  for (size_t i(0); i < N; ++i) {
+    low[i] = bounds.first[i];
+    high[i] = bounds.second[i];
+  }
+  if (child_bits > 0) {
+    search_quantized(low, high, range_query);
+    return range_query;
+  }
+  vector<uint32_t> dfs_s(1, 0);
+  while (!dfs_s.empty()) {
+    const FrozenNode &current = nodes[dfs_s.back()];
+    dfs_s.pop_back();
+    if (!overlaps(current.bottom_left, current.top_right, low, high))
+      continue;
+    if (current.leaf)
+      search_leaf(current.first, current.count, current.bottom_left, current.top_right, low, high, range_query);
+    else {
+      for (uint32_t child(current.first); child < current.first + current.count; ++child)
+        dfs_s.push_back(child);
+    }
+  }
+  return range_query;
+}
+
+//KNN METHOD: branch and bound over the node offsets (MINDIST), the data of the visited leaves goes to a max-heap with the k best.
+template<typename T, size_t N, typename Metric>
+vector<HyperPoint<T, N>> FrozenRPlus<T, N, Metric>::kNN_query(HyperPoint<T, N> refdata, size_t k) {
+  vector<HyperPoint<T, N>> kNN;
+  if ((nodes.empty() && quantized_nodes.empty()) || k == 0)
+    return kNN;
+  if (normalized_axes)
+    normalization.apply(refdata);
+  array<T, N> ref;
+  for (size_t i(0); i < N; ++i)
+    ref[i] = refdata[i];
+  priority_queue<pair<double, size_t>> k_best;//(distance, data), the worst on top
+  auto visit = [&k_best, k](double distance, size_t d) {//returns the new k-th distance
+    if (k_best.size() < k)
+      k_best.push(make_pair(distance, d));
+    else if (distance < k_best.top().first) {
+      k_best.pop();
+      k_best.push(make_pair(distance, d));
+    }
+    return (k_best.size() < k) ? numeric_limits<double>::max() : k_best.top().first;
+  };
+  if (child_bits > 0)
+    kNN_quantized(ref, visit);
+  priority_queue<pair<double, uint32_t>, vector<pair<double, uint32_t>>, greater<pair<double, uint32_t>>> best_branchs_queue;
+  if (child_bits == 0)
+    best_branchs_queue.push(make_pair(0.0, uint32_t(0)));
+  while (!best_branchs_queue.empty()) {
+    double kth_distance = (k_best.size() < k) ? numeric_limits<double>::max() : k_best.top().first;
+    if (best_branchs_queue.top().first >= kth_distance)
+      break;
+    const FrozenNode &current = nodes[best_branchs_queue.top().second];
+    best_branchs_queue.pop();
+    if (current.leaf) {
+      scan_leaf(current.first, current.count, current.bottom_left, current.top_right, ref, kth_distance, visit);
+      continue;
+    }
+    for (uint32_t child(current.first); child < current.first + current.count; ++child) {
+      double distance = Metric::template MINDIST<T, N>(ref.data(), nodes[child].bottom_left.data(), nodes[child].top_right.data());
+      if (distance < kth_distance)
+        best_branchs_queue.push(make_pair(distance, child));
+    }
+  }
+  kNN.resize(k_best.size());
+  for (size_t i(k_best.size()); i > 0; --i) {//the worst leaves the heap first
+    kNN[i - 1] = make_result(k_best.top().second);
+    k_best.pop();
+  }
+  return kNN;
+}
+
+//--OVERLAPS: the box of a node (its MBR or the decoded one) against a window given by its corners--
+template<typename T, size_t N, typename Metric>
+bool FrozenRPlus<T, N, Metric>::overlaps(const array<T, N> &node_low, const array<T, N> &node_high, const array<T, N> &low, const array<T, N> &high) {
+  for (size_t i(0); i < N; ++i) {
+    if (node_low[i] > high[i] || node_high[i] < low[i])
+      return false;
+  }
+  return true;
+}
+
+//--MAKE RESULT: hyperpoint (as it was given) of a data of the contiguous arrays--
+template<typename T, size_t N, typename Metric>
+HyperPoint<T, N> FrozenRPlus<T, N, Metric>::make_result(size_t data_index) {
+  const vector<T> &given = (normalized_axes) ? original_coordinates : coordinates;
+  array<T, N> data;
+  for (size_t i(0); i < N; ++i)
+    data[i] = given[data_index * N + i];
+  HyperPoint<T, N> result(data, names[data_index]);
+  result.set_attributes(attributes[data_index]);
+  return result;
+}
+
+/*--COMPRESS LEAVES: code of each coordinate = round((value - low) / step), step = (high - low) / (2^bits - 1) with the box of its
+                    leaf (the decoded one if quantized), the codes are appended bit by bit (one spare word at the end, decode_codes
+                    always reads two words)--*/
+template<typename T, size_t N, typename Metric>
+void FrozenRPlus<T, N, Metric>::compress_leaves(size_t bits) {
+  try {
+    if (bits > FROZEN_MAX_LEAF_BITS) {
+      throw runtime_error(ERROR_FROZEN_LEAF_BITS);
+    }
+    else {
+      leaf_bits = bits;
+      packed_codes.assign((names.size() * N * bits + 63) / 64 + 1, uint64_t(0));
+      double max_code = double((uint64_t(1) << bits) - 1);
+      for_each_leaf([&](uint32_t first, uint32_t count, const array<T, N> &leaf_low, const array<T, N> &leaf_high) {
+        for (size_t d(first); d < first + count; ++d) {
+          for (size_t i(0); i < N; ++i) {
+            double extent = double(leaf_high[i]) - double(leaf_low[i]);
+            double code = (extent > 0.0) ? round((double(coordinates[d * N + i]) - double(leaf_low[i])) / extent * max_code) : 0.0;
+            uint64_t value = uint64_t(min(max(code, 0.0), max_code));
+            size_t position = (d * N + i) * bits;
+            packed_codes[position / 64] |= value << (position % 64);
+            if (position % 64 + bits > 64)
+              packed_codes[position / 64 + 1] |= value >> (64 - position % 64);
+          }
+        }
+      });
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//--DECODE CODES: count consecutive codes since first_code, branch free (two words per code, the shifts never reach 64 bits)--
+template<typename T, size_t N, typename Metric>
+void FrozenRPlus<T, N, Metric>::decode_codes(size_t first_code, size_t count, uint32_t *codes) {
+  const uint64_t mask = (uint64_t(1) << leaf_bits) - 1;
+  const uint64_t *words = packed_codes.data();
+  for (size_t c(0); c < count; ++c) {
+    size_t position = (first_code + c) * leaf_bits, shift = position % 64;
+    uint64_t low_word = words[position / 64], high_word = words[position / 64 + 1];
+    codes[c] = uint32_t(((low_word >> shift) | ((high_word << 1) << (63 - shift))) & mask);
+  }
+}
+
+/*--QUANTIZE CHILDREN: the tree is copied to quantized_nodes (BFS, the children of a node stay consecutive) with codes of the MBR of
+                       each child relative to the box decoded for its parent, decoded with child_box. A code that doesn't cover the
+                       real bound after decoding (rounding) is moved one step out. A node takes the children of its children while
+                       they are internal and their codes fit in FROZEN_CHILD_CODE_LINES cache lines. Only the MBR of the root stays--*/
+template<typename T, size_t N, typename Metric>
+void FrozenRPlus<T, N, Metric>::quantize_children(size_t bits) {
+  try {
+    if (bits != 8 && bits != 16) {
+      throw runtime_error(ERROR_FROZEN_CHILD_BITS);
+    }
+    else {
+      child_bits = bits;
+      size_t code_bytes = bits / 8, max_code = (size_t(1) << bits) - 1;
+      size_t max_fanout = max(size_t(1), FROZEN_CHILD_CODE_LINES * FROZEN_CACHE_LINE / (2 * N * code_bytes));
+      auto store = [&](size_t position, size_t code) {
+        for (size_t byte(0); byte < code_bytes; ++byte)
+          child_bounds[position * code_bytes + byte] = uint8_t(code >> (8 * byte));
+      };
+      root_low = nodes[0].bottom_left;
+      root_high = nodes[0].top_right;
+      quantized_nodes.assign(1, QuantizedNode{ 0, 0, nodes[0].leaf });
+      vector<uint32_t> source(1, 0);//node of the full layout of each quantized node
+      vector<array<T, N>> lows(1, root_low), highs(1, root_high);//decoded boxes
+      child_bounds.clear();
+      for (size_t current(0); current < quantized_nodes.size(); ++current) {
+        const FrozenNode &original = nodes[source[current]];
+        if (original.leaf) {
+          quantized_nodes[current].first = original.first;
+          quantized_nodes[current].count = original.count;
+          continue;
+        }
+        vector<uint32_t> children;
+        for (uint32_t child(original.first); child < original.first + original.count; ++child)
+          children.push_back(child);
+        while (true) {//the grandchildren replace the children while they fit
+          vector<uint32_t> grandchildren;
+          bool internal = true;
+          for (uint32_t child : children) {
+            internal = internal && !nodes[child].leaf;
+            for (uint32_t grandchild(nodes[child].first); internal && grandchild < nodes[child].first + nodes[child].count; ++grandchild)
+              grandchildren.push_back(grandchild);
+          }
+          if (!internal || grandchildren.empty() || grandchildren.size() > max_fanout)
+            break;
+          children.swap(grandchildren);
+        }
+        array<T, N> parent_low = lows[current], parent_high = highs[current];
+        array<double, N> step;
+        child_steps(parent_low, parent_high, step);
+        quantized_nodes[current].first = uint32_t(quantized_nodes.size());
+        quantized_nodes[current].count = uint32_t(children.size());
+        for (uint32_t original_child : children) {
+          uint32_t child = uint32_t(quantized_nodes.size());
+          const FrozenNode &real = nodes[original_child];
+          quantized_nodes.push_back(QuantizedNode{ 0, 0, real.leaf });
+          source.push_back(original_child);
+          child_bounds.resize(size_t(child) * 2 * N * code_bytes, uint8_t(0));
+          array<T, N> low, high;
+          for (size_t i(0); i < N; ++i) {
+            double extent = double(parent_high[i]) - double(parent_low[i]);
+            double scale = (extent > 0.0) ? double(max_code) / extent : 0.0;
+            size_t low_code = size_t(min(max(floor((double(real.bottom_left[i]) - double(parent_low[i])) * scale), 0.0), double(max_code)));
+            size_t high_code = size_t(min(max(ceil((double(real.top_right[i]) - double(parent_low[i])) * scale), 0.0), double(max_code)));
+            store(size_t(child - 1) * 2 * N + i, low_code);
+            store(size_t(child - 1) * 2 * N + N + i, high_code);
+            child_box(parent_low, parent_high, child, step, low, high);
+            while (low_code > 0 && low[i] > real.bottom_left[i]) {
+              store(size_t(child - 1) * 2 * N + i, --low_code);
+              child_box(parent_low, parent_high, child, step, low, high);
+            }
+            while (high_code < max_code && high[i] < real.top_right[i]) {
+              store(size_t(child - 1) * 2 * N + N + i, ++high_code);
+              child_box(parent_low, parent_high, child, step, low, high);
+            }
+          }
+          lows.push_back(low);
+          highs.push_back(high);
+        }
+      }
+      nodes.clear();
+      nodes.shrink_to_fit();
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//--FOR EACH LEAF: visit(first data, count, low, high) with the box of each leaf the queries use (the decoded one if quantized)--
+template<typename T, size_t N, typename Metric>
+template<typename Visit>
+void FrozenRPlus<T, N, Metric>::for_each_leaf(Visit visit) {
+  if (child_bits == 0) {
+    for (const FrozenNode &node : nodes) {
+      if (node.leaf)
+        visit(node.first, node.count, node.bottom_left, node.top_right);
+    }
+    return;
+  }
+  vector<QuantizedVisit> dfs_s(1, QuantizedVisit{ 0, root_low, root_high });
+  while (!dfs_s.empty()) {
+    QuantizedVisit current = dfs_s.back();
+    dfs_s.pop_back();
+    const QuantizedNode &node = quantized_nodes[current.node];
+    if (node.leaf) {
+      visit(node.first, node.count, current.low, current.high);
+      continue;
+    }
+    array<double, N> step;
+    child_steps(current.low, current.high, step);
+    for (uint32_t child(node.first); child < node.first + node.count; ++child) {
+      dfs_s.push_back(QuantizedVisit{ child, array<T, N>(), array<T, N>() });
+      child_box(current.low, current.high, child, step, dfs_s.back().low, dfs_s.back().high);
+    }
+  }
+}
+
+//--CHILD CODE: code of one bound of a child (bound < N: low of the axis bound | bound >= N: high of the axis bound - N)--
+template<typename T, size_t N, typename Metric>
+size_t FrozenRPlus<T, N, Metric>::child_code(uint32_t child, size_t bound) {
+  const uint8_t *code = &child_bounds[(size_t(child - 1) * 2 * N + bound) * (child_bits / 8)];
+  return (child_bits == 16) ? size_t(code[0]) | (size_t(code[1]) << 8) : size_t(code[0]);
+}
+
+//--CHILD STEPS: size of one code step of each axis for the children of a node (its decoded box)--
+template<typename T, size_t N, typename Metric>
+void FrozenRPlus<T, N, Metric>::child_steps(const array<T, N> &parent_low, const array<T, N> &parent_high, array<double, N> &step) {
+  double max_code = double((size_t(1) << child_bits) - 1);
+  for (size_t i(0); i < N; ++i)
+    step[i] = (double(parent_high[i]) - double(parent_low[i])) / max_code;
+}
+
+//--CHILD BOX: decoded box of a child from the decoded box of its parent (code 0 and the max code are the bounds of the parent, exact)--
+template<typename T, size_t N, typename Metric>
+void FrozenRPlus<T, N, Metric>::child_box(const array<T, N> &parent_low, const array<T, N> &parent_high, uint32_t child, const array<double, N> &step,
+                                          array<T, N> &low, array<T, N> &high) {
+  const size_t max_code = (size_t(1) << child_bits) - 1;
+  for (size_t i(0); i < N; ++i) {
+    size_t low_code = child_code(child, i), high_code = child_code(child, N + i);
+    low[i] = (low_code == max_code) ? parent_high[i] : T(double(parent_low[i]) + step[i] * double(low_code));
+    high[i] = (high_code == max_code) ? parent_high[i] : T(double(parent_low[i]) + step[i] * double(high_code));
+  }
+}
+
+/*--SEARCH QUANTIZED: dfs that decodes the boxes on the way down. The window is also turned into codes of each node (one step wider
+                      each side), so most of the children are dropped comparing integers and only the others are decoded--*/
+template<typename T, size_t N, typename Metric>
+void FrozenRPlus<T, N, Metric>::search_quantized(const array<T, N> &low, const array<T, N> &high, vector<HyperPoint<T, N>> &range_query) {
+  if (!overlaps(root_low, root_high, low, high))
+    return;
+  const double max_code = double((size_t(1) << child_bits) - 1);
+  vector<QuantizedVisit> dfs_s(1, QuantizedVisit{ 0, root_low, root_high });
+  while (!dfs_s.empty()) {
+    QuantizedVisit current = dfs_s.back();
+    dfs_s.pop_back();
+    const QuantizedNode &node = quantized_nodes[current.node];
+    if (node.leaf) {
+      search_leaf(node.first, node.count, current.low, current.high, low, high, range_query);
+      continue;
+    }
+    array<int64_t, N> low_limit, high_limit;
+    array<double, N> step;
+    child_steps(current.low, current.high, step);
+    for (size_t i(0); i < N; ++i) {
+      double extent = double(current.high[i]) - double(current.low[i]);
+      double scale = (extent > 0.0) ? max_code / extent : 0.0;
+      low_limit[i] = int64_t(min(max(ceil((double(high[i]) - double(current.low[i])) * scale), -2.0), max_code + 2.0)) + 1;
+      high_limit[i] = int64_t(min(max(floor((double(low[i]) - double(current.low[i])) * scale), -2.0), max_code + 2.0)) - 1;
+    }
+    for (uint32_t child(node.first); child < node.first + node.count; ++child) {
+      bool may_overlap = true;
+      if (child_bits == 8) {
+        const uint8_t *codes = &child_bounds[size_t(child - 1) * 2 * N];
+        for (size_t i(0); i < N; ++i)
+          may_overlap &= (int64_t(codes[i]) <= low_limit[i]) & (int64_t(codes[N + i]) >= high_limit[i]);
+      }
+      else {
+        for (size_t i(0); i < N; ++i)
+          may_overlap &= (int64_t(child_code(child, i)) <= low_limit[i]) & (int64_t(child_code(child, N + i)) >= high_limit[i]);
+      }
+      if (!may_overlap)
+        continue;
+      QuantizedVisit next{ child, array<T, N>(), array<T, N>() };
+      child_box(current.low, current.high, child, step, next.low, next.high);
+      if (overlaps(next.low, next.high, low, high))
+        dfs_s.push_back(next);
+    }
+  }
+}
+
+//--KNN QUANTIZED: branch and bound with MINDIST to the decoded boxes (lower bounds), the boxes of the queued nodes are kept aside--
+template<typename T, size_t N, typename Metric>
+template<typename Visit>
+void FrozenRPlus<T, N, Metric>::kNN_quantized(const array<T, N> &ref, Visit visit) {
+  vector<QuantizedVisit> queued(1, QuantizedVisit{ 0, root_low, root_high });
+  priority_queue<pair<double, size_t>, vector<pair<double, size_t>>, greater<pair<double, size_t>>> best_branchs_queue;//(MINDIST, position in queued)
+  best_branchs_queue.push(make_pair(0.0, size_t(0)));
+  double kth_distance = numeric_limits<double>::max();
+  while (!best_branchs_queue.empty() && best_branchs_queue.top().first < kth_distance) {
+    QuantizedVisit current = queued[best_branchs_queue.top().second];
+    best_branchs_queue.pop();
+    const QuantizedNode &node = quantized_nodes[current.node];
+    if (node.leaf) {
+      kth_distance = scan_leaf(node.first, node.count, current.low, current.high, ref, kth_distance, visit);
+      continue;
+    }
+    array<double, N> step;
+    child_steps(current.low, current.high, step);
+    for (uint32_t child(node.first); child < node.first + node.count; ++child) {
+      QuantizedVisit next{ child, array<T, N>(), array<T, N>() };
+      child_box(current.low, current.high, child, step, next.low, next.high);
+      double distance = Metric::template MINDIST<T, N>(ref.data(), next.low.data(), next.high.data());
+      if (distance < kth_distance) {
+        queued.push_back(next);
+        best_branchs_queue.push(make_pair(distance, queued.size() - 1));
+      }
+    }
+  }
+}
+
+//--SEARCH LEAF: the data of a leaf inside the window (the codes if compressed, else the coordinates)--
+template<typename T, size_t N, typename Metric>
+void FrozenRPlus<T, N, Metric>::search_leaf(uint32_t first, uint32_t count, const array<T, N> &leaf_low, const array<T, N> &leaf_high,
+                                            const array<T, N> &low, const array<T, N> &high, vector<HyperPoint<T, N>> &range_query) {
+  if (leaf_bits > 0) {
+    search_compressed_leaf(first, count, leaf_low, leaf_high, low, high, range_query);
+    return;
+  }
+  for (size_t d(first); d < first + count; ++d) {
+    const T *data = &coordinates[d * N];
+    bool inside = true;
+    for (size_t i(0); i < N; ++i)
+      inside = inside && low[i] <= data[i] && data[i] <= high[i];
+    if (inside)
+      range_query.push_back(make_result(d));
+  }
+}
+
+//--SCAN LEAF: visits the data of a leaf that may be nearer than the k-th distance, returns the new k-th distance--
+template<typename T, size_t N, typename Metric>
+template<typename Visit>
+double FrozenRPlus<T, N, Metric>::scan_leaf(uint32_t first, uint32_t count, const array<T, N> &leaf_low, const array<T, N> &leaf_high,
+                                            const array<T, N> &ref, double kth_distance, Visit visit) {
+  if (leaf_bits > 0)
+    return scan_compressed_leaf(first, count, leaf_low, leaf_high, ref, kth_distance, visit);
+  for (size_t d(first); d < first + count; ++d)
+    kth_distance = visit(Metric::template DIST<T, N>(ref.data(), &coordinates[d * N]), d);
+  return kth_distance;
+}
+
+/*--SEARCH COMPRESSED LEAF: the window becomes two ranges of codes per axis, "possible" (the cell of the code touches the window)
+                            and "sure" (the cell is inside the window). A data out of a possible range is dropped and a data inside
+                            every sure range is taken, both only with its codes; the exact coordinates decide the rest.--*/
+template<typename T, size_t N, typename Metric>
+void FrozenRPlus<T, N, Metric>::search_compressed_leaf(uint32_t first, uint32_t count, const array<T, N> &leaf_low, const array<T, N> &leaf_high,
+                                                       const array<T, N> &low, const array<T, N> &high, vector<HyperPoint<T, N>> &range_query) {
+  const double max_code = double((uint64_t(1) << leaf_bits) - 1), margin = 1e-9;//margin: rounding of the codes
+  array<int64_t, N> possible_low, possible_high, sure_low, sure_high;
+  for (size_t i(0); i < N; ++i) {
+    double extent = double(leaf_high[i]) - double(leaf_low[i]);
+    if (extent <= 0.0) {//every code is 0 and the value is exact
+      bool inside = low[i] <= leaf_low[i] && leaf_low[i] <= high[i];
+      possible_low[i] = sure_low[i] = (inside) ? 0 : 1;
+      possible_high[i] = sure_high[i] = 0;
+      continue;
+    }
+    double from = (double(low[i]) - double(leaf_low[i])) / extent * max_code;
+    double to = (double(high[i]) - double(leaf_low[i])) / extent * max_code;
+    possible_low[i] = int64_t(ceil(max(from - 0.5 - margin, -1.0)));
+    possible_high[i] = int64_t(floor(min(to + 0.5 + margin, max_code + 1.0)));
+    sure_low[i] = int64_t(ceil(max(from + 0.5 + margin, -1.0)));
+    sure_high[i] = int64_t(floor(min(to - 0.5 - margin, max_code + 1.0)));
+  }
+  array<uint32_t, FROZEN_DECODE_BLOCK * N> codes;
+  array<uint8_t, FROZEN_DECODE_BLOCK> possible, sure;
+  for (size_t block(first); block < first + count; block += FROZEN_DECODE_BLOCK) {
+    size_t block_count = min(size_t(FROZEN_DECODE_BLOCK), first + count - block);
+    decode_codes(block * N, block_count * N, codes.data());
+    fill(possible.begin(), possible.begin() + block_count, uint8_t(1));
+    fill(sure.begin(), sure.begin() + block_count, uint8_t(1));
+    for (size_t i(0); i < N; ++i) {
+      for (size_t d(0); d < block_count; ++d) {
+        int64_t code = codes[d * N + i];
+        possible[d] &= uint8_t((possible_low[i] <= code) & (code <= possible_high[i]));
+        sure[d] &= uint8_t((sure_low[i] <= code) & (code <= sure_high[i]));
+      }
+    }
+    for (size_t d(0); d < block_count; ++d) {
+      if (!possible[d])
+        continue;
+      bool inside = sure[d];
+      if (!inside) {//refinement with the side store
+        const T *data = &coordinates[(block + d) * N];
+        inside = true;
+        for (size_t i(0); i < N; ++i)
+          inside = inside && low[i] <= data[i] && data[i] <= high[i];
+      }
+      if (inside)
+        range_query.push_back(make_result(block + d));
+    }
+  }
+}
+
+/*--SCAN COMPRESSED LEAF: MINDIST from ref to the cell of each code is a lower bound of its distance, only the data whose bound is
+                          under the k-th distance is measured with the exact coordinates and visited (visit(distance, data)
+                          gives back the new k-th distance), returns the last k-th distance--*/
+template<typename T, size_t N, typename Metric>
+template<typename Visit>
+double FrozenRPlus<T, N, Metric>::scan_compressed_leaf(uint32_t first, uint32_t count, const array<T, N> &leaf_low, const array<T, N> &leaf_high,
+                                                       const array<T, N> &ref, double kth_distance, Visit visit) {
+  const double max_code = double((uint64_t(1) << leaf_bits) - 1), margin = 1e-9;
+  array<double, N> step;
+  for (size_t i(0); i < N; ++i)
+    step[i] = (double(leaf_high[i]) - double(leaf_low[i])) / max_code;
+  array<uint32_t, FROZEN_DECODE_BLOCK * N> codes;
+  array<T, N> cell_low, cell_high;
+  for (size_t block(first); block < first + count; block += FROZEN_DECODE_BLOCK) {
+    size_t block_count = min(size_t(FROZEN_DECODE_BLOCK), first + count - block);
+    decode_codes(block * N, block_count * N, codes.data());
+    for (size_t d(0); d < block_count; ++d) {
+      for (size_t i(0); i < N; ++i) {
+        double center = double(leaf_low[i]) + codes[d * N + i] * step[i];
+        cell_low[i] = max(leaf_low[i], T(center - (0.5 + margin) * step[i]));
+        cell_high[i] = min(leaf_high[i], T(center + (0.5 + margin) * step[i]));
+      }
+      if (Metric::template MINDIST<T, N>(ref.data(), cell_low.data(), cell_high.data()) >= kth_distance)
+        continue;
+      double distance = Metric::template DIST<T, N>(ref.data(), &coordinates[(block + d) * N]);
+      kth_distance = min(kth_distance, visit(distance, block + d));
+    }
+  }
+  return kth_distance;
+}
+
+#endif //SOURCE_RPLUS_FROZEN_HPP
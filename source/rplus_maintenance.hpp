@@ -0,0 +1,145 @@
+#ifndef SOURCE_RPLUS_MAINTENANCE_HPP
+#define SOURCE_RPLUS_MAINTENANCE_HPP
+
+#include <RPlusTree.hpp>
+
+#include <condition_variable>
+#include <shared_mutex>
+
+#define REPACK_INTERVAL_MS 1000//Time between two maintenance rounds
+
+/*TEMPLATE PARAMETERS: (1)data type | (2)number of dimensions | (3)max entries per node | (4)fill factor(by default = 2)
+                      | (5)distance policy(by default = L2Metric)
+  Approach: Front-end with a background maintenance thread for long-lived trees fed by 1x1 insertions. Every interval the thread
+            runs a repack round (RPlus::repack): degraded subtrees are rebuilt packed and published with an atomic root swap,
+            so the queries stay close to a bulk-loaded tree without full rebuilds.
+  Locks: the queries share tree_lock and the writers hold it alone (like AsyncRPlus). The writers also hold write_lock, the only
+         lock of the maintenance (while it finds the subtrees and while it publishes them), so the queries never wait for it.*/
+template<typename T, size_t N, size_t M, size_t ff = 2, typename Metric = L2Metric>
+class RepackingRPlus {
+private:
+  RPlus<T, N, M, ff, Metric> &tree;
+  shared_mutex tree_lock;
+  mutex write_lock;
+
+  RepackPolicy policy;
+  chrono::milliseconds interval;
+  thread maintainer;
+  mutex state_lock;
+  condition_variable wake;
+  bool stopping;
+  RepackReport last_report;
+  size_t rounds;
+
+  void maintain();
+
+public:
+  RepackingRPlus(RPlus<T, N, M, ff, Metric> &indexed_tree, const RepackPolicy &repack_policy = RepackPolicy(),
+                 chrono::milliseconds repack_interval = chrono::milliseconds(REPACK_INTERVAL_MS));
+  virtual ~RepackingRPlus();
+  void assign(vector<HyperPoint<T, N>> &unpacked_data);
+  bool erase(HyperPoint<T, N> data);
+  bool update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data);
+  vector<HyperPoint<T, N>> search(const HyperRectangle<T, N> &W, QueryControl *control = nullptr);
+  vector<HyperPoint<T, N>> kNN_query(HyperPoint<T, N> refdata, size_t k, QueryControl *control = nullptr);
+  RepackReport repack_now();
+  RepackReport get_last_report();
+  size_t get_rounds();
+};
+
+//===============================REPACKING-R-PLUS-IMPLEMENTATION=======================================
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+RepackingRPlus<T, N, M, ff, Metric>::RepackingRPlus(RPlus<T, N, M, ff, Metric> &indexed_tree, const RepackPolicy &repack_policy,
+                                                    chrono::milliseconds repack_interval) : tree(indexed_tree) {
+  policy = repack_policy;
+  interval = repack_interval;
+  stopping = false;
+  last_report = RepackReport();
+  rounds = 0;
+  maintainer = thread(&RepackingRPlus::maintain, this);
+}
+
+//The maintenance thread ends after the round in progress (a round not yet published is dropped with the old tree untouched)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+RepackingRPlus<T, N, M, ff, Metric>::~RepackingRPlus() {
+  {
+    lock_guard<mutex> guard(state_lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  maintainer.join();
+}
+
+//ASSIGN METHOD: Waits for the running queries (and a publication of the maintenance) and inserts the data
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void RepackingRPlus<T, N, M, ff, Metric>::assign(vector<HyperPoint<T, N>> &unpacked_data) {
+  lock_guard<mutex> write_guard(write_lock);
+  unique_lock<shared_mutex> guard(tree_lock);
+  tree.assign(unpacked_data);
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool RepackingRPlus<T, N, M, ff, Metric>::erase(HyperPoint<T, N> data) {
+  lock_guard<mutex> write_guard(write_lock);
+  unique_lock<shared_mutex> guard(tree_lock);
+  return tree.erase(data);
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool RepackingRPlus<T, N, M, ff, Metric>::update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data) {
+  lock_guard<mutex> write_guard(write_lock);
+  unique_lock<shared_mutex> guard(tree_lock);
+  return tree.update(old_data, new_data);
+}
+
+//RANGE QUERY METHOD: Many at the same time, also while the maintenance rebuilds or publishes a subtree
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> RepackingRPlus<T, N, M, ff, Metric>::search(const HyperRectangle<T, N> &W, QueryControl *control) {
+  shared_lock<shared_mutex> guard(tree_lock);
+  return tree.search(W, control);
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> RepackingRPlus<T, N, M, ff, Metric>::kNN_query(HyperPoint<T, N> refdata, size_t k, QueryControl *control) {
+  shared_lock<shared_mutex> guard(tree_lock);
+  return tree.kNN_query(refdata, k, control);
+}
+
+//REPACK NOW METHOD: One maintenance round in the calling thread (ex.: after a big ingestion), same locks as the background ones
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+RepackReport RepackingRPlus<T, N, M, ff, Metric>::repack_now() {
+  RepackReport report = tree.repack(policy, &write_lock);
+  lock_guard<mutex> guard(state_lock);
+  last_report = report;
+  ++rounds;
+  return report;
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+RepackReport RepackingRPlus<T, N, M, ff, Metric>::get_last_report() {
+  lock_guard<mutex> guard(state_lock);
+  return last_report;
+}
+
+//Maintenance rounds done (background and repack_now)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+size_t RepackingRPlus<T, N, M, ff, Metric>::get_rounds() {
+  lock_guard<mutex> guard(state_lock);
+  return rounds;
+}
+
+//--MAINTAIN: loop of the maintenance thread, one repack round per interval until the destructor wakes it--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void RepackingRPlus<T, N, M, ff, Metric>::maintain() {
+  while (true) {
+    {
+      unique_lock<mutex> guard(state_lock);
+      if (wake.wait_for(guard, interval, [this]() { return stopping; }))
+        return;
+    }
+    repack_now();
+  }
+}
+
+#endif //SOURCE_RPLUS_MAINTENANCE_HPP
@@ -0,0 +1,112 @@
+#ifndef SOURCE_RPLUS_PARALLEL_HPP
+#define SOURCE_RPLUS_PARALLEL_HPP
+
+#include <rplus_utils.hpp>
+
+//This file only contains the parallel tools for R+
+
+#define PARALLEL_MIN_SUBTREES 4//Fewer overlapping subtrees than this and a "parallel" query stays single-threaded
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*WORK STEALING SCHEDULER: Fork-join pool for tree traversals. Each worker owns a deque of tasks: it pushes and pops its own
+                           tasks at the back (depth first, cache friendly) and, when it runs out, steals from the front of
+                           another worker's deque (the oldest task, so usually the biggest subtree).
+  Usage: run(seeds, body), body(task, worker_id, spawn) may call spawn(new_task) to fork more work.*/
+template<typename Task>
+class WorkStealingScheduler {
+public:
+  typedef function<void(Task)> Spawner;
+  typedef function<void(Task &, size_t, Spawner &)> TaskBody;
+
+  WorkStealingScheduler(size_t n_workers = thread::hardware_concurrency());
+  size_t get_workers();
+  void run(vector<Task> &seeds, const TaskBody &body);
+
+private:
+  struct WorkerQueue {
+    deque<Task> tasks;
+    mutex lock;
+  };
+
+  size_t workers;
+  vector<unique_ptr<WorkerQueue>> queues;
+  atomic<size_t> pending;
+
+  bool pop_own(size_t worker_id, Task &task);
+  bool steal(size_t thief_id, Task &task);
+  void work(size_t worker_id, const TaskBody &body);
+};
+
+template<typename Task>
+WorkStealingScheduler<Task>::WorkStealingScheduler(size_t n_workers) {
+  workers = max(n_workers, size_t(1));
+  for (size_t i(0); i < workers; ++i)
+    queues.push_back(make_unique<WorkerQueue>());
+  pending = 0;
+}
+
+template<typename Task>
+size_t WorkStealingScheduler<Task>::get_workers() {
+  return workers;
+}
+
+//RUN METHOD: Deals the seeds round robin, runs every worker until there is no pending task and joins them.
+template<typename Task>
+void WorkStealingScheduler<Task>::run(vector<Task> &seeds, const TaskBody &body) {
+  pending = seeds.size();
+  for (size_t i(0); i < seeds.size(); ++i)
+    queues[i % workers]->tasks.push_back(seeds[i]);
+  vector<thread> pool;
+  for (size_t w(1); w < workers; ++w)
+    pool.emplace_back(&WorkStealingScheduler<Task>::work, this, w, cref(body));
+  work(0, body);//the calling thread is worker 0
+  for (thread &th : pool)
+    th.join();
+}
+
+template<typename Task>
+bool WorkStealingScheduler<Task>::pop_own(size_t worker_id, Task &task) {
+  WorkerQueue &own = *queues[worker_id];
+  lock_guard<mutex> guard(own.lock);
+  if (own.tasks.empty())
+    return false;
+  task = own.tasks.back();
+  own.tasks.pop_back();
+  return true;
+}
+
+template<typename Task>
+bool WorkStealingScheduler<Task>::steal(size_t thief_id, Task &task) {
+  for (size_t offset(1); offset < workers; ++offset) {
+    WorkerQueue &victim = *queues[(thief_id + offset) % workers];
+    lock_guard<mutex> guard(victim.lock);
+    if (!victim.tasks.empty()) {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+//WORK METHOD: Worker loop, a task counts as pending until its body returns so nobody leaves while work can still be forked.
+template<typename Task>
+void WorkStealingScheduler<Task>::work(size_t worker_id, const TaskBody &body) {
+  Spawner spawn = [this, worker_id](Task new_task) {
+    pending.fetch_add(1);
+    WorkerQueue &own = *queues[worker_id];
+    lock_guard<mutex> guard(own.lock);
+    own.tasks.push_back(new_task);
+  };
+  Task task;
+  while (pending.load() > 0) {
+    if (pop_own(worker_id, task) || steal(worker_id, task)) {
+      body(task, worker_id, spawn);
+      pending.fetch_sub(1);
+    }
+    else
+      this_thread::yield();
+  }
+}
+
+#endif //SOURCE_RPLUS_PARALLEL_HPP
@@ -0,0 +1,269 @@
+#ifndef SOURCE_RPLUS_PCA_HPP
+#define SOURCE_RPLUS_PCA_HPP
+
+#include <RPlusTree.hpp>
+
+#define ERROR_PCA_NOT_FITTED "The projection of the reduced R+ Tree must be fitted before inserting or querying."
+#define ERROR_PCA_DIMENSIONS "The number of reduced dimensions should be between 2 and the number of full dimensions."
+
+/*TEMPLATE PARAMETERS: (1)data type | (2)full dimensions | (3)reduced dimensions | (4)max entries per node | (5)fill factor(by default = 2)
+  Approach: Filter and refine. A PCA projection learned on a sample maps every full hyperpoint to a D-dimensional key, the keys
+            are indexed by an RPlus<T, D, M, ff> and the full hyperpoints stay in a side store (the payload of each key is its slot,
+            its name is the one of the full hyperpoint).
+  Exact answers: the rows of the projection are orthonormal, so the euclidean distance between two keys is never greater than the
+                 distance between the full hyperpoints (lower bound). Range query: filter by the bounding box of the projected window,
+                 refine with the full window. kNN: read the keys in increasing distance (incremental kNN of the reduced
+                 tree) until the next key is farther than the current k-th full distance.
+  Normalize the data (AxisNormalization) before fitting, otherwise the axes with large units take all the components.*/
+template<typename T, size_t N, size_t D, size_t M, size_t ff = 2>
+class PCAReducedRPlus {
+private:
+  array<array<double, N>, D> projection;//D principal components, one per row
+  array<double, N> mean;
+  double explained_variance;
+  bool fitted;
+
+  typedef HyperPoint<T, D, size_t> Key;//payload: slot of the full hyperpoint in full_store
+
+  vector<HyperPoint<T, N>> full_store;
+  RPlus<T, D, M, ff, L2Metric, size_t> reduced_tree;
+
+  Key project(HyperPoint<T, N> &point, size_t slot);
+  static void jacobi_eigen(array<array<double, N>, N> &A, array<array<double, N>, N> &V);
+
+public:
+  PCAReducedRPlus();
+  void fit(vector<HyperPoint<T, N>> &sample);
+  double get_explained_variance();
+  void assign(vector<HyperPoint<T, N>> &unpacked_data);
+  vector<HyperPoint<T, N>> search(const HyperRectangle<T, N> &W);
+  vector<HyperPoint<T, N>> kNN_query(HyperPoint<T, N> refdata, size_t k);
+};
+
+//===============================PCA-REDUCED-R-PLUS-IMPLEMENTATION=====================================
+
+template<typename T, size_t N, size_t D, size_t M, size_t ff>
+PCAReducedRPlus<T, N, D, M, ff>::PCAReducedRPlus() {
+  try {
+    if (D < 2 || D > N) {
+      throw runtime_error(ERROR_PCA_DIMENSIONS);
+    }
+    else {
+      mean.fill(0.0);
+      explained_variance = 0.0;
+      fitted = false;
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//FIT METHOD: Learns the mean and the D principal components (eigenvectors of the covariance with the greatest eigenvalues) of a sample.
+template<typename T, size_t N, size_t D, size_t M, size_t ff>
+void PCAReducedRPlus<T, N, D, M, ff>::fit(vector<HyperPoint<T, N>> &sample) {
+  if (sample.empty())
+    return;
+  mean.fill(0.0);
+  for (HyperPoint<T, N> &point : sample) {
+    for (size_t i(0); i < N; ++i)
+      mean[i] += double(point[i]) / double(sample.size());
+  }
+  array<array<double, N>, N> covariance, eigenvectors;
+  for (array<double, N> &row : covariance)
+    row.fill(0.0);
+  for (HyperPoint<T, N> &point : sample) {
+    for (size_t i(0); i < N; ++i) {
+      for (size_t j(i); j < N; ++j)
+        covariance[i][j] += (double(point[i]) - mean[i]) * (double(point[j]) - mean[j]) / double(sample.size());
+    }
+  }
+  for (size_t i(0); i < N; ++i) {
+    for (size_t j(0); j < i; ++j)
+      covariance[i][j] = covariance[j][i];
+  }
+  jacobi_eigen(covariance, eigenvectors);//covariance is now diagonal (eigenvalues), columns of eigenvectors are the components
+  array<size_t, N> order;
+  double total_variance = 0.0;
+  for (size_t i(0); i < N; ++i) {
+    order[i] = i;
+    total_variance += covariance[i][i];
+  }
+  sort(order.begin(), order.end(), [&covariance](size_t a, size_t b) { return covariance[a][a] > covariance[b][b]; });
+  explained_variance = 0.0;
+  for (size_t d(0); d < D; ++d) {
+    for (size_t i(0); i < N; ++i)
+      projection[d][i] = eigenvectors[i][order[d]];
+    explained_variance += covariance[order[d]][order[d]];
+  }
+  explained_variance = (total_variance > 0.0) ? explained_variance / total_variance : 1.0;
+  fitted = true;
+}
+
+//Fraction of the variance of the sample kept by the D components (the closer to 1, the better the filter)
+template<typename T, size_t N, size_t D, size_t M, size_t ff>
+double PCAReducedRPlus<T, N, D, M, ff>::get_explained_variance() {
+  return explained_variance;
+}
+
+//ASSIGN METHOD: Stores the full hyperpoints in the side store and inserts their projected keys in the reduced R+
+template<typename T, size_t N, size_t D, size_t M, size_t ff>
+void PCAReducedRPlus<T, N, D, M, ff>::assign(vector<HyperPoint<T, N>> &unpacked_data) {
+  try {
+    if (!fitted) {
+      throw runtime_error(ERROR_PCA_NOT_FITTED);
+    }
+    else {
+      vector<Key> keys;
+      keys.reserve(unpacked_data.size());
+      for (HyperPoint<T, N> &hp : unpacked_data) {
+        keys.push_back(project(hp, full_store.size()));
+        full_store.push_back(hp);
+      }
+      reduced_tree.assign(keys);
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+/*RANGE QUERY METHOD: Filter -> range query in the reduced R+ with the bounding box of the projected window (per component, the
+                      min/max of a linear function over a box is on its corners), refine -> full window over the side store.*/
+template<typename T, size_t N, size_t D, size_t M, size_t ff>
+vector<HyperPoint<T, N>> PCAReducedRPlus<T, N, D, M, ff>::search(const HyperRectangle<T, N> &W) {
+  try {
+    if (!fitted) {
+      throw runtime_error(ERROR_PCA_NOT_FITTED);
+    }
+    else {
+      pair<HyperPoint<T, N>, HyperPoint<T, N>> bounds = W.get_boundaries();
+      array<T, D> low_key, high_key;
+      for (size_t d(0); d < D; ++d) {
+        double low = 0.0, high = 0.0, magnitude = 0.0;
+        for (size_t i(0); i < N; ++i) {
+          double from_low = projection[d][i] * (double(bounds.first[i]) - mean[i]);
+          double from_high = projection[d][i] * (double(bounds.second[i]) - mean[i]);
+          low += min(from_low, from_high);
+          high += max(from_low, from_high);
+          magnitude += fabs(from_low) + fabs(from_high);
+        }
+        double slack = 1e-9 * (magnitude + 1.0);//rounding of the keys must not lose points on the border
+        low_key[d] = T(low - slack);
+        high_key[d] = T(high + slack);
+      }
+      HyperPoint<T, D> low_point(low_key), high_point(high_key);
+      vector<Key> candidates = reduced_tree.search(HyperRectangle<T, D>(low_point, high_point));
+      vector<HyperPoint<T, N>> range_query;
+      for (Key &key : candidates) {
+        HyperPoint<T, N> &full_point = full_store[key.get_attributes()];
+        if (HyperRectangle<T, N>(bounds.first, bounds.second).contains(full_point))
+          range_query.push_back(full_point);
+      }
+      return range_query;
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+/*KNN METHOD: Multi-step kNN. The keys come in increasing distance from the incremental kNN of the reduced tree and each one is
+              refined with the full distance (a max-heap keeps the k best). It stops at the first key that isn't nearer than the
+              k-th full distance: every key not read is farther, and its distance is a lower bound of the full one.*/
+template<typename T, size_t N, size_t D, size_t M, size_t ff>
+vector<HyperPoint<T, N>> PCAReducedRPlus<T, N, D, M, ff>::kNN_query(HyperPoint<T, N> refdata, size_t k) {
+  try {
+    if (!fitted) {
+      throw runtime_error(ERROR_PCA_NOT_FITTED);
+    }
+    else {
+      vector<HyperPoint<T, N>> kNN;
+      if (k == 0)
+        return kNN;
+      vector<pair<double, size_t>> refined;//(full distance, slot), the k-th best on top
+      reduced_tree.incremental_kNN(project(refdata, 0), [&](const Key &key, double key_distance) {
+        if (refined.size() == k && key_distance >= refined.front().first)
+          return false;
+        size_t slot = key.get_attributes();
+        refined.push_back(make_pair(L2Metric::DIST(refdata, full_store[slot]), slot));
+        push_heap(refined.begin(), refined.end());
+        if (refined.size() > k) {
+          pop_heap(refined.begin(), refined.end());
+          refined.pop_back();
+        }
+        return true;
+      });
+      sort_heap(refined.begin(), refined.end());
+      for (pair<double, size_t> &best : refined)
+        kNN.push_back(full_store[best.second]);
+      return kNN;
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//--PROJECT: key of a full hyperpoint (centered and multiplied by the components) with the slot of the hyperpoint as payload--
+template<typename T, size_t N, size_t D, size_t M, size_t ff>
+typename PCAReducedRPlus<T, N, D, M, ff>::Key PCAReducedRPlus<T, N, D, M, ff>::project(HyperPoint<T, N> &point, size_t slot) {
+  array<T, D> components;
+  for (size_t d(0); d < D; ++d) {
+    double component = 0.0;
+    for (size_t i(0); i < N; ++i)
+      component += projection[d][i] * (double(point[i]) - mean[i]);
+    components[d] = T(component);
+  }
+  Key key(components, point.get_songs_name());
+  key.set_attributes(slot);
+  return key;
+}
+
+//--JACOBI EIGEN: cyclic Jacobi rotations over a symmetric matrix, A ends diagonal (eigenvalues) and V keeps the eigenvectors by column--
+template<typename T, size_t N, size_t D, size_t M, size_t ff>
+void PCAReducedRPlus<T, N, D, M, ff>::jacobi_eigen(array<array<double, N>, N> &A, array<array<double, N>, N> &V) {
+  for (size_t i(0); i < N; ++i) {
+    V[i].fill(0.0);
+    V[i][i] = 1.0;
+  }
+  for (size_t sweep_count(0); sweep_count < 100; ++sweep_count) {
+    double off_diagonal = 0.0;
+    for (size_t p(0); p < N; ++p) {
+      for (size_t q(p + 1); q < N; ++q)
+        off_diagonal += A[p][q] * A[p][q];
+    }
+    if (off_diagonal < 1e-22)
+      break;
+    for (size_t p(0); p < N; ++p) {
+      for (size_t q(p + 1); q < N; ++q) {
+        if (fabs(A[p][q]) < 1e-300)
+          continue;
+        double theta = (A[q][q] - A[p][p]) / (2.0 * A[p][q]);
+        double t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+        double c = 1.0 / sqrt(t * t + 1.0), s = t * c;
+        for (size_t r(0); r < N; ++r) {//A = A * J
+          double a_rp = A[r][p], a_rq = A[r][q];
+          A[r][p] = c * a_rp - s * a_rq;
+          A[r][q] = s * a_rp + c * a_rq;
+        }
+        for (size_t r(0); r < N; ++r) {//A = J^T * A
+          double a_pr = A[p][r], a_qr = A[q][r];
+          A[p][r] = c * a_pr - s * a_qr;
+          A[q][r] = s * a_pr + c * a_qr;
+        }
+        for (size_t r(0); r < N; ++r) {//V = V * J
+          double v_rp = V[r][p], v_rq = V[r][q];
+          V[r][p] = c * v_rp - s * v_rq;
+          V[r][q] = s * v_rp + c * v_rq;
+        }
+      }
+    }
+  }
+}
+
+#endif //SOURCE_RPLUS_PCA_HPP
@@ -0,0 +1,262 @@
+#ifndef SOURCE_RPLUS_PIPELINE_HPP
+#define SOURCE_RPLUS_PIPELINE_HPP
+
+#include <rplus_utils.hpp>
+
+#define PIPELINE_CHUNK_LINES 1024//Lines read (and data parsed and inserted) together
+#define PIPELINE_QUEUE_CHUNKS 8//Chunks waiting between two stages, with the chunk size it bounds the memory of the pipeline
+#define PIPELINE_MAX_BACKOFF_US 1000//Longest sleep of a stage waiting for its queue (idle feeds don't burn a core)
+#define PIPELINE_IDLE_FLUSH_MS 10.0//A partial chunk of a slow or paused feed waits about this long for more lines before it goes on
+
+#define ERROR_PIPELINE_FILE "The file of the ingestion pipeline couldn't be opened."
+#define ERROR_PIPELINE_FEATURES "The value of N is not enough for the given features."
+
+/*Bounded lock-free queue for one producer thread and one consumer thread (ring of a power of 2 slots, head and tail in their own
+  cache lines). push waits while the queue is full (backpressure), pop waits while it is empty and returns false when the producer
+  closed it and nothing is left (pop_within also gives up after a timeout). The time spent waiting is added to the given counter
+  (milliseconds).*/
+template<typename Item>
+class SpscQueue {
+private:
+  vector<Item> slots;
+  size_t mask;
+  alignas(64) atomic<size_t> head;//next slot to pop (consumer)
+  alignas(64) atomic<size_t> tail;//next slot to push (producer)
+  atomic<bool> closed;
+
+  static void back_off(size_t &attempts) {
+    if (++attempts < 64)
+      this_thread::yield();
+    else
+      this_thread::sleep_for(chrono::microseconds(min(size_t(PIPELINE_MAX_BACKOFF_US), attempts - 63)));
+  }
+
+public:
+  SpscQueue(size_t capacity) {
+    size_t slot_count = 1;
+    while (slot_count < max(capacity, size_t(1)))
+      slot_count <<= 1;
+    slots.resize(slot_count);
+    mask = slot_count - 1;
+    head = 0;
+    tail = 0;
+    closed = false;
+  }
+
+  bool try_push(Item &item) {
+    size_t position = tail.load(memory_order_relaxed);
+    if (position - head.load(memory_order_acquire) == slots.size())
+      return false;
+    slots[position & mask] = move(item);
+    tail.store(position + 1, memory_order_release);
+    return true;
+  }
+
+  bool try_pop(Item &item) {
+    size_t position = head.load(memory_order_relaxed);
+    if (position == tail.load(memory_order_acquire))
+      return false;
+    item = move(slots[position & mask]);
+    head.store(position + 1, memory_order_release);
+    return true;
+  }
+
+  void push(Item &item, double &waited_ms) {
+    if (try_push(item))
+      return;
+    chrono::time_point<chrono::steady_clock> start_time = chrono::steady_clock::now();
+    for (size_t attempts(0); !try_push(item);)
+      back_off(attempts);
+    waited_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start_time).count();
+  }
+
+  bool pop(Item &item, double &waited_ms) {
+    return pop_within(item, numeric_limits<double>::infinity(), waited_ms);
+  }
+
+  bool pop_within(Item &item, double timeout_ms, double &waited_ms) {
+    if (try_pop(item))
+      return true;
+    chrono::time_point<chrono::steady_clock> start_time = chrono::steady_clock::now();
+    double elapsed_ms = 0.0;
+    bool popped = false;
+    for (size_t attempts(0); !popped; back_off(attempts)) {
+      bool was_closed = closed.load(memory_order_acquire);//read before the last try: a push before close() is still seen
+      popped = try_pop(item);
+      elapsed_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start_time).count();
+      if (!popped && (was_closed || elapsed_ms >= timeout_ms))
+        break;
+    }
+    waited_ms += elapsed_ms;
+    return popped;
+  }
+
+  //Closed by the producer and nothing left to pop
+  bool finished() {
+    return closed.load(memory_order_acquire) && head.load(memory_order_acquire) == tail.load(memory_order_acquire);
+  }
+
+  //The producer won't push anymore
+  void close() {
+    closed.store(true, memory_order_release);
+  }
+};
+
+//What the pipeline did: data read and inserted, total time and the time each stage waited for the others (the bottleneck waits less)
+struct IngestionReport {
+  size_t lines;
+  size_t inserted;
+  double elapsed_ms;
+  double reader_wait_ms;//waiting for free room (parse or insert slower than the input)
+  double parser_wait_ms;//waiting for lines or for free room
+  double inserter_wait_ms;//waiting for parsed data (input or parse slower than the tree)
+};
+
+/*TEMPLATE PARAMETERS: (1)data type | (2)number of dimensions
+  Approach: Streaming CSV ingestion in three concurrent stages joined by bounded SPSC queues:
+            read (chunks of PIPELINE_CHUNK_LINES lines of a file or stdin) -> parse (rows -> hyperpoints: the features of the
+            header, the id and the attributes, then the optional transform) -> insert (each chunk is one batch for the index).
+            Reading, parsing and the maintenance of the index overlap, a slow stage stops the ones before it (backpressure), so
+            at most 2 * PIPELINE_QUEUE_CHUNKS chunks are in memory whatever the size of the input.
+            A feed that stops in the middle of a chunk doesn't keep its lines: when no chunk comes for PIPELINE_IDLE_FLUSH_MS
+            the parse stage takes the partial chunk of the reader (only with the queue empty, so the order of the lines is kept).
+  Index: anything with assign(vector<HyperPoint<T, N>>&): RPlus (1x1 or buffered insertion, with its normalization),
+         DurableRPlus, ShardedRPlus, CachedRPlus, AsyncRPlus, PlannedRPlus, PCAReducedRPlus. The insert stage runs in the
+         thread that calls run.*/
+template<typename T, size_t N>
+class IngestionPipeline {
+private:
+  typedef vector<string> LineChunk;
+  typedef vector<HyperPoint<T, N>> DataChunk;
+
+  function<void(DataChunk &)> sink;
+  function<void(HyperPoint<T, N> &)> transform;
+  vector<string> features;
+  string id;
+  size_t queue_chunks;
+
+public:
+  template<typename Index>
+  IngestionPipeline(Index &index, const vector<string> &features, const string &id, size_t queue_chunks = PIPELINE_QUEUE_CHUNKS);
+  void set_transform(const function<void(HyperPoint<T, N> &)> &point_transform);
+  IngestionReport run(istream &input);
+  IngestionReport run(const string &file_path);
+};
+
+//===============================INGESTION-PIPELINE-IMPLEMENTATION=====================================
+
+template<typename T, size_t N>
+template<typename Index>
+IngestionPipeline<T, N>::IngestionPipeline(Index &index, const vector<string> &features, const string &id, size_t queue_chunks) {
+  try {
+    if (N + 1 < features.size()) {
+      throw runtime_error(ERROR_PIPELINE_FEATURES);
+    }
+    else {
+      sink = [&index](DataChunk &batch) { index.assign(batch); };
+      this->features = features;
+      this->id = id;
+      this->queue_chunks = queue_chunks;
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//Change of each parsed data before the insertion (ex.: clamp, scale or derive an axis), runs in the parse stage
+template<typename T, size_t N>
+void IngestionPipeline<T, N>::set_transform(const function<void(HyperPoint<T, N> &)> &point_transform) {
+  transform = point_transform;
+}
+
+//RUN METHOD: Ingests a CSV stream (header in the first line) until its end, returns when every data is in the index
+template<typename T, size_t N>
+IngestionReport IngestionPipeline<T, N>::run(istream &input) {
+  IngestionReport report = IngestionReport();
+  chrono::time_point<chrono::high_resolution_clock> start_time = chrono::high_resolution_clock::now();
+  string cols_labels;
+  getline(input, cols_labels);
+  CsvLayout layout = parse_csv_header(cols_labels, features, id);
+  SpscQueue<LineChunk> lines_q(queue_chunks);
+  SpscQueue<DataChunk> data_q(queue_chunks);
+  LineChunk open_chunk;//lines read since the last chunk, the reader pushes it full (under open_lock) and the parser may take it partial
+  mutex open_lock;
+  thread reader([&]() {
+    string row_data_line;
+    while (getline(input, row_data_line)) {
+      ++report.lines;
+      lock_guard<mutex> guard(open_lock);
+      open_chunk.push_back(move(row_data_line));
+      if (open_chunk.size() == PIPELINE_CHUNK_LINES) {
+        LineChunk chunk;
+        chunk.reserve(PIPELINE_CHUNK_LINES);
+        chunk.swap(open_chunk);
+        lines_q.push(chunk, report.reader_wait_ms);
+      }
+    }
+    lock_guard<mutex> guard(open_lock);
+    if (!open_chunk.empty())
+      lines_q.push(open_chunk, report.reader_wait_ms);
+    lines_q.close();
+  });
+  //the partial chunk of the reader, only if no full chunk is waiting (those go first). try_lock: the reader may hold the lock while it waits for room
+  auto take_open_chunk = [&](LineChunk &chunk) {
+    unique_lock<mutex> guard(open_lock, try_to_lock);
+    if (!guard.owns_lock())
+      return false;
+    if (lines_q.try_pop(chunk))
+      return true;
+    if (open_chunk.empty())
+      return false;
+    chunk.clear();
+    chunk.swap(open_chunk);
+    return true;
+  };
+  thread parser([&]() {
+    LineChunk chunk;
+    while (!lines_q.finished()) {
+      if (!lines_q.pop_within(chunk, PIPELINE_IDLE_FLUSH_MS, report.parser_wait_ms) && !take_open_chunk(chunk))
+        continue;
+      DataChunk batch;
+      batch.reserve(chunk.size());
+      for (const string &row_data_line : chunk) {
+        batch.push_back(parse_csv_row<T, N>(row_data_line, layout));
+        if (transform)
+          transform(batch.back());
+      }
+      data_q.push(batch, report.parser_wait_ms);
+    }
+    data_q.close();
+  });
+  DataChunk batch;
+  while (data_q.pop(batch, report.inserter_wait_ms)) {
+    sink(batch);
+    report.inserted += batch.size();
+  }
+  reader.join();
+  parser.join();
+  report.elapsed_ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start_time).count();
+  return report;
+}
+
+//Ingests a CSV file (use run(cin) for stdin or a continuous feed)
+template<typename T, size_t N>
+IngestionReport IngestionPipeline<T, N>::run(const string &file_path) {
+  try {
+    ifstream data_set_file(file_path);
+    if (!data_set_file.is_open()) {
+      throw runtime_error(ERROR_PIPELINE_FILE);
+    }
+    else {
+      return run(data_set_file);
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+#endif //SOURCE_RPLUS_PIPELINE_HPP
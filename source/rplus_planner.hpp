@@ -0,0 +1,359 @@
+#ifndef SOURCE_RPLUS_PLANNER_HPP
+#define SOURCE_RPLUS_PLANNER_HPP
+
+#include <RPlusTree.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define PLANNER_BUCKETS 64//Buckets of the histogram of each axis
+#define PLANNER_SCAN_SELECTIVITY 0.01//Range query: scan when the estimated answer is at least this fraction of the data
+#define PLANNER_KNN_SCAN_FRACTION 0.003//kNN: scan when k is at least this fraction of the data
+#define PLANNER_REBUILD_FRACTION 0.1//The histograms are rebuilt after this fraction of the data changed
+#define SCAN_BLOCK 1024//Data per block of the scan (the mask of a block stays in L1)
+
+enum QueryPlan { PLAN_TREE, PLAN_SCAN };
+
+//What the planner did with a query: chosen plan, estimated and real size of the answer, time
+struct QueryStats {
+  QueryPlan plan;
+  double estimated_results;
+  size_t results;
+  double elapsed_ms;
+};
+
+/*--SCAN AXIS BLOCK: mask[i] stays 1 only if low <= column[i] <= high, branch free (AVX2 for double, the generic loop is
+                     vectorized by the compiler)--*/
+template<typename T>
+inline void scan_axis_block(const T *column, size_t count, T low, T high, uint8_t *mask) {
+  for (size_t i(0); i < count; ++i)
+    mask[i] &= uint8_t((low <= column[i]) & (column[i] <= high));
+}
+
+#if defined(__AVX2__)
+template<>
+inline void scan_axis_block<double>(const double *column, size_t count, double low, double high, uint8_t *mask) {
+  __m256d low_v = _mm256_set1_pd(low), high_v = _mm256_set1_pd(high);
+  size_t i(0);
+  for (; i + 4 <= count; i += 4) {
+    __m256d values = _mm256_loadu_pd(column + i);
+    __m256d inside = _mm256_and_pd(_mm256_cmp_pd(low_v, values, _CMP_LE_OQ), _mm256_cmp_pd(values, high_v, _CMP_LE_OQ));
+    int bits = _mm256_movemask_pd(inside);
+    for (size_t j(0); j < 4; ++j)
+      mask[i + j] &= uint8_t((bits >> j) & 1);
+  }
+  for (; i < count; ++i)
+    mask[i] &= uint8_t((low <= column[i]) & (column[i] <= high));
+}
+#endif
+
+/*TEMPLATE PARAMETERS: (1)data type | (2)number of dimensions | (3)max entries per node | (4)fill factor(by default = 2)
+                      | (5)distance policy(by default = L2Metric)
+  Approach: RPlus + the same data in columns (one contiguous array per axis, space of the tree) for a brute force scan.
+            A wide window or a huge k reads most of the tree anyway, then one sequential pass over the columns is cheaper.
+  Estimator: equi-width histogram of each axis (PLANNER_BUCKETS), the selectivity of a window is the product of the fractions of
+             each axis (independent axes). The histograms are rebuilt when PLANNER_REBUILD_FRACTION of the data changed.
+  Planner: range query -> scan if the estimated answer >= PLANNER_SCAN_SELECTIVITY of the data, kNN -> scan if
+           k >= PLANNER_KNN_SCAN_FRACTION of the data, otherwise the tree. Both plans give the same answer (the data as it was
+           given, the tree keeps it beside its normalized keys too), the plan and the estimation are reported in QueryStats.
+  Don't write to get_tree() directly: those changes don't reach the columns.*/
+template<typename T, size_t N, size_t M, size_t ff = 2, typename Metric = L2Metric>
+class PlannedRPlus {
+private:
+  RPlus<T, N, M, ff, Metric> tree;
+  AxisNormalization<T, N> normalization;
+  bool normalized_axes;
+
+  array<vector<T>, N> columns;//space of the tree
+  vector<HyperPoint<T, N>> rows;//data as it was given (units, name, attributes), same positions as the columns
+  unordered_multimap<string, size_t> slots;//id -> position
+
+  array<array<size_t, PLANNER_BUCKETS>, N> histograms;
+  array<T, N> histogram_low, histogram_high;
+  size_t changes_since_rebuild;
+
+  double scan_selectivity, knn_scan_fraction;
+
+  void add_row(HyperPoint<T, N> &data);
+  bool remove_row(HyperPoint<T, N> &data);
+  void rebuild_histograms();
+  double estimate_results(const HyperRectangle<T, N> &W);
+  vector<HyperPoint<T, N>> scan_search(const HyperRectangle<T, N> &W);
+  vector<HyperPoint<T, N>> scan_kNN(const HyperPoint<T, N> &refdata, size_t k);
+
+public:
+  PlannedRPlus();
+  RPlus<T, N, M, ff, Metric>& get_tree();
+  void set_normalization(const AxisNormalization<T, N> &axes_normalization);
+  void set_thresholds(double scan_selectivity, double knn_scan_fraction);
+  size_t get_size();
+  void assign(vector<HyperPoint<T, N>> &unpacked_data);
+  bool erase(HyperPoint<T, N> data);
+  bool update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data);
+  double estimate_selectivity(const HyperRectangle<T, N> &W);
+  vector<HyperPoint<T, N>> search(const HyperRectangle<T, N> &W, QueryStats *stats = nullptr);
+  vector<HyperPoint<T, N>> kNN_query(HyperPoint<T, N> refdata, size_t k, QueryStats *stats = nullptr);
+};
+
+//===============================PLANNED-R-PLUS-IMPLEMENTATION=========================================
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+PlannedRPlus<T, N, M, ff, Metric>::PlannedRPlus() {
+  normalized_axes = false;
+  changes_since_rebuild = 0;
+  scan_selectivity = PLANNER_SCAN_SELECTIVITY;
+  knn_scan_fraction = PLANNER_KNN_SCAN_FRACTION;
+  rebuild_histograms();
+}
+
+//The tree of the planner (only to read it or to set its insertion buffer)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+RPlus<T, N, M, ff, Metric>& PlannedRPlus<T, N, M, ff, Metric>::get_tree() {
+  return tree;
+}
+
+//The columns keep the space of the tree, so both plans compare the same values
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void PlannedRPlus<T, N, M, ff, Metric>::set_normalization(const AxisNormalization<T, N> &axes_normalization) {
+  tree.set_normalization(axes_normalization);
+  normalization = axes_normalization;
+  normalized_axes = true;
+}
+
+//Thresholds of the planner for this machine (see PLANNER_SCAN_SELECTIVITY and PLANNER_KNN_SCAN_FRACTION)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void PlannedRPlus<T, N, M, ff, Metric>::set_thresholds(double scan_selectivity, double knn_scan_fraction) {
+  this->scan_selectivity = scan_selectivity;
+  this->knn_scan_fraction = knn_scan_fraction;
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+size_t PlannedRPlus<T, N, M, ff, Metric>::get_size() {
+  return rows.size();
+}
+
+//ASSIGN METHOD: Inserts the data in the tree and appends it to the columns
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void PlannedRPlus<T, N, M, ff, Metric>::assign(vector<HyperPoint<T, N>> &unpacked_data) {
+  tree.assign(unpacked_data);
+  for (HyperPoint<T, N> &data : unpacked_data) {
+#ifdef NON_REPEATED_SONGS
+    if (slots.count(data.get_songs_name()))
+      continue;//dropped by the tree too
+#endif
+    add_row(data);
+  }
+  if (changes_since_rebuild >= PLANNER_REBUILD_FRACTION * double(rows.size()))
+    rebuild_histograms();
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool PlannedRPlus<T, N, M, ff, Metric>::erase(HyperPoint<T, N> data) {
+  if (!tree.erase(data))
+    return false;
+  remove_row(data);
+  return true;
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool PlannedRPlus<T, N, M, ff, Metric>::update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data) {
+  if (!erase(old_data))
+    return false;
+  vector<HyperPoint<T, N>> new_version(1, new_data);
+  assign(new_version);
+  return true;
+}
+
+//Estimated fraction of the data inside W (histograms)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+double PlannedRPlus<T, N, M, ff, Metric>::estimate_selectivity(const HyperRectangle<T, N> &W) {
+  return (rows.empty()) ? 0.0 : estimate_results((normalized_axes) ? normalization.apply(W) : W) / double(rows.size());
+}
+
+//RANGE QUERY METHOD: tree or scan by the estimated size of the answer
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> PlannedRPlus<T, N, M, ff, Metric>::search(const HyperRectangle<T, N> &W, QueryStats *stats) {
+  chrono::time_point<chrono::high_resolution_clock> start_time = chrono::high_resolution_clock::now();
+  HyperRectangle<T, N> W_in_tree = (normalized_axes) ? normalization.apply(W) : W;
+  double estimated = estimate_results(W_in_tree);
+  QueryPlan plan = (!rows.empty() && estimated >= scan_selectivity * double(rows.size())) ? PLAN_SCAN : PLAN_TREE;
+  vector<HyperPoint<T, N>> range_query = (plan == PLAN_SCAN) ? scan_search(W_in_tree) : tree.search(W);
+  if (stats) {
+    stats->plan = plan;
+    stats->estimated_results = estimated;
+    stats->results = range_query.size();
+    stats->elapsed_ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start_time).count();
+  }
+  return range_query;
+}
+
+//KNN METHOD: tree or scan by the fraction of the data asked (k)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> PlannedRPlus<T, N, M, ff, Metric>::kNN_query(HyperPoint<T, N> refdata, size_t k, QueryStats *stats) {
+  chrono::time_point<chrono::high_resolution_clock> start_time = chrono::high_resolution_clock::now();
+  QueryPlan plan = (!rows.empty() && double(k) >= knn_scan_fraction * double(rows.size())) ? PLAN_SCAN : PLAN_TREE;
+  vector<HyperPoint<T, N>> kNN;
+  if (plan == PLAN_SCAN) {
+    HyperPoint<T, N> ref_in_tree = refdata;
+    if (normalized_axes)
+      normalization.apply(ref_in_tree);
+    kNN = scan_kNN(ref_in_tree, k);
+  }
+  else
+    kNN = tree.kNN_query(refdata, k);
+  if (stats) {
+    stats->plan = plan;
+    stats->estimated_results = double(min(k, rows.size()));
+    stats->results = kNN.size();
+    stats->elapsed_ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start_time).count();
+  }
+  return kNN;
+}
+
+//--ADD ROW: appends the data to the columns (space of the tree) and counts it in the histograms--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void PlannedRPlus<T, N, M, ff, Metric>::add_row(HyperPoint<T, N> &data) {
+  HyperPoint<T, N> data_in_tree = data;
+  if (normalized_axes)
+    normalization.apply(data_in_tree);
+  slots.insert(make_pair(data.get_songs_name(), rows.size()));
+  rows.push_back(data);
+  for (size_t i(0); i < N; ++i)
+    columns[i].push_back(data_in_tree[i]);
+  ++changes_since_rebuild;
+}
+
+//--REMOVE ROW: the last row takes the position of the erased one (the histograms are fixed at the next rebuild)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool PlannedRPlus<T, N, M, ff, Metric>::remove_row(HyperPoint<T, N> &data) {
+  pair<typename unordered_multimap<string, size_t>::iterator, typename unordered_multimap<string, size_t>::iterator> same_id =
+    slots.equal_range(data.get_songs_name());
+  for (typename unordered_multimap<string, size_t>::iterator it = same_id.first; it != same_id.second; ++it) {
+    size_t slot = it->second;
+    bool same_coordinates = true;
+    for (size_t i(0); i < N; ++i)
+      same_coordinates = same_coordinates && rows[slot][i] == data[i];
+    if (!same_coordinates)
+      continue;
+    slots.erase(it);
+    size_t last = rows.size() - 1;
+    if (slot != last) {
+      pair<typename unordered_multimap<string, size_t>::iterator, typename unordered_multimap<string, size_t>::iterator> last_id =
+        slots.equal_range(rows[last].get_songs_name());
+      for (typename unordered_multimap<string, size_t>::iterator moved = last_id.first; moved != last_id.second; ++moved) {
+        if (moved->second == last)
+          moved->second = slot;
+      }
+      rows[slot] = rows[last];
+      for (size_t i(0); i < N; ++i)
+        columns[i][slot] = columns[i][last];
+    }
+    rows.pop_back();
+    for (size_t i(0); i < N; ++i)
+      columns[i].pop_back();
+    if (++changes_since_rebuild >= PLANNER_REBUILD_FRACTION * double(rows.size()))
+      rebuild_histograms();
+    return true;
+  }
+  return false;
+}
+
+//--REBUILD HISTOGRAMS: range and equi-width buckets of each axis, one pass over each column--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void PlannedRPlus<T, N, M, ff, Metric>::rebuild_histograms() {
+  for (size_t i(0); i < N; ++i) {
+    histograms[i].fill(0);
+    if (columns[i].empty()) {
+      histogram_low[i] = histogram_high[i] = T(0);
+      continue;
+    }
+    pair<typename vector<T>::iterator, typename vector<T>::iterator> range = minmax_element(columns[i].begin(), columns[i].end());
+    histogram_low[i] = *range.first;
+    histogram_high[i] = *range.second;
+    double width = (double(histogram_high[i]) - double(histogram_low[i])) / PLANNER_BUCKETS;
+    for (T value : columns[i]) {
+      size_t bucket = (width > 0.0) ? size_t((double(value) - double(histogram_low[i])) / width) : 0;
+      ++histograms[i][min(bucket, size_t(PLANNER_BUCKETS - 1))];
+    }
+  }
+  changes_since_rebuild = 0;
+}
+
+//--ESTIMATE RESULTS: data * product of the fraction of each axis inside W (a partial bucket counts by its covered width)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+double PlannedRPlus<T, N, M, ff, Metric>::estimate_results(const HyperRectangle<T, N> &W) {
+  if (rows.empty())
+    return 0.0;
+  size_t counted = 0;
+  for (size_t bucket(0); bucket < PLANNER_BUCKETS; ++bucket)
+    counted += histograms[0][bucket];
+  if (counted == 0)
+    return double(rows.size());//no histogram yet -> assume everything
+  double selectivity = 1.0;
+  for (size_t i(0); i < N; ++i) {
+    double low = max(double(W.get_bottom_left()[i]), double(histogram_low[i]));
+    double high = min(double(W.get_top_right()[i]), double(histogram_high[i]));
+    if (low > high)
+      return 0.0;
+    double width = (double(histogram_high[i]) - double(histogram_low[i])) / PLANNER_BUCKETS;
+    if (width <= 0.0)
+      continue;//one value in this axis and it is inside W
+    double inside = 0.0;
+    for (size_t bucket(0); bucket < PLANNER_BUCKETS; ++bucket) {
+      double bucket_low = double(histogram_low[i]) + bucket * width, bucket_high = bucket_low + width;
+      double covered = min(high, bucket_high) - max(low, bucket_low);
+      if (covered > 0.0)
+        inside += histograms[i][bucket] * min(1.0, covered / width);
+      else if (covered == 0.0 && low == high)
+        inside += histograms[i][bucket] / PLANNER_BUCKETS;//window of width 0 in this axis
+    }
+    selectivity *= inside / double(counted);
+  }
+  return selectivity * double(rows.size());
+}
+
+//--SCAN SEARCH: per block, one branch free pass per axis over its column builds the mask, then the data of the mask is copied--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> PlannedRPlus<T, N, M, ff, Metric>::scan_search(const HyperRectangle<T, N> &W) {
+  vector<HyperPoint<T, N>> range_query;
+  array<uint8_t, SCAN_BLOCK> mask;
+  for (size_t first(0); first < rows.size(); first += SCAN_BLOCK) {
+    size_t count = min(size_t(SCAN_BLOCK), rows.size() - first);
+    fill(mask.begin(), mask.begin() + count, uint8_t(1));
+    for (size_t i(0); i < N; ++i)
+      scan_axis_block(columns[i].data() + first, count, W.get_bottom_left()[i], W.get_top_right()[i], mask.data());
+    for (size_t d(0); d < count; ++d) {
+      if (mask[d])
+        range_query.push_back(rows[first + d]);
+    }
+  }
+  return range_query;
+}
+
+/*--SCAN KNN: distance to every data (metric of the tree, columns in its space), then the k smallest are selected and sorted.
+               Per block, the outer loop goes over the axes and the inner one over the data of the block: each axis adds its
+               part to the partial distances of the block (contiguous, in L1), so every inner loop is a vectorizable pass.--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> PlannedRPlus<T, N, M, ff, Metric>::scan_kNN(const HyperPoint<T, N> &refdata, size_t k) {
+  vector<pair<double, size_t>> distances(rows.size());
+  array<double, SCAN_BLOCK> partial;
+  for (size_t first(0); first < rows.size(); first += SCAN_BLOCK) {
+    size_t count = min(size_t(SCAN_BLOCK), rows.size() - first);
+    fill(partial.begin(), partial.begin() + count, 0.0);
+    for (size_t i(0); i < N; ++i)
+      Metric::ACCUMULATE(refdata[i], columns[i].data() + first, count, partial.data());
+    Metric::FINISH(partial.data(), count);
+    for (size_t d(0); d < count; ++d)
+      distances[first + d] = make_pair(partial[d], first + d);
+  }
+  k = min(k, distances.size());
+  partial_sort(distances.begin(), distances.begin() + k, distances.end());
+  vector<HyperPoint<T, N>> kNN;
+  kNN.reserve(k);
+  for (size_t d(0); d < k; ++d)
+    kNN.push_back(rows[distances[d].second]);
+  return kNN;
+}
+
+#endif //SOURCE_RPLUS_PLANNER_HPP
@@ -0,0 +1,291 @@
+#ifndef SOURCE_RPLUS_SHARDED_HPP
+#define SOURCE_RPLUS_SHARDED_HPP
+
+#include <RPlusTree.hpp>
+
+#include <shared_mutex>
+
+#define ERROR_SHARD_AXIS "The axis of the shards should be lower than the number of dimensions."
+#define ERROR_SHARD_CUTS "The cuts of the shards should be sorted (ascending)."
+#define ERROR_SHARD_INDEX "The index of the shard is out of range."
+
+/*TEMPLATE PARAMETERS: (1)data type | (2)number of dimensions | (3)max entries per node | (4)fill factor(by default = 2)
+                      | (5)distance policy(by default = L2Metric)
+  Approach: The space is cut in one axis (for example the year) by sorted cutlines, shard i keeps the data with
+            cuts[i - 1] <= data[axis] < cuts[i] in its own RPlus, with its own readers/writer lock (one contention domain and one
+            rebuild unit per shard).
+  Queries (scatter-gather): a range query only visits the shards whose MBR overlaps the window, kNN visits the shards by MINDIST
+                            and skips a shard when its MINDIST isn't better than the global k-th distance found so far by any
+                            shard. The shards of a query run in parallel (WorkStealingScheduler).
+  Use quantile_cuts(sample, axis, n_shards) to get shards of similar sizes.*/
+template<typename T, size_t N, size_t M, size_t ff = 2, typename Metric = L2Metric>
+class ShardedRPlus {
+private:
+  struct Shard {
+    unique_ptr<RPlus<T, N, M, ff, Metric>> tree;
+    shared_mutex lock;
+    HyperRectangle<T, N> mbr;//covers every data inserted since the last rebuild (valid only if size > 0)
+    size_t size;
+  };
+
+  size_t axis;
+  vector<T> cuts;
+  vector<unique_ptr<Shard>> shards;
+
+  size_t route(const HyperPoint<T, N> &data);
+  void for_each_shard(vector<size_t> &selected, size_t n_threads, const function<void(size_t)> &visit);
+
+public:
+  ShardedRPlus(size_t shard_axis, const vector<T> &shard_cuts);
+  static vector<T> quantile_cuts(vector<HyperPoint<T, N>> &sample, size_t shard_axis, size_t n_shards);
+  size_t get_shards();
+  size_t get_shard_size(size_t shard);
+  void assign(vector<HyperPoint<T, N>> &unpacked_data, size_t n_threads = thread::hardware_concurrency());
+  bool erase(HyperPoint<T, N> data);
+  bool update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data);
+  void rebuild_shard(size_t shard);
+  vector<HyperPoint<T, N>> search(const HyperRectangle<T, N> &W, size_t n_threads = thread::hardware_concurrency());
+  vector<HyperPoint<T, N>> kNN_query(HyperPoint<T, N> refdata, size_t k, size_t n_threads = thread::hardware_concurrency());
+};
+
+//===============================SHARDED-R-PLUS-IMPLEMENTATION=========================================
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+ShardedRPlus<T, N, M, ff, Metric>::ShardedRPlus(size_t shard_axis, const vector<T> &shard_cuts) {
+  try {
+    if (shard_axis >= N) {
+      throw runtime_error(ERROR_SHARD_AXIS);
+    }
+    else if (!is_sorted(shard_cuts.begin(), shard_cuts.end())) {
+      throw runtime_error(ERROR_SHARD_CUTS);
+    }
+    else {
+      axis = shard_axis;
+      cuts = shard_cuts;
+      for (size_t i(0); i <= cuts.size(); ++i) {
+        shards.push_back(make_unique<Shard>());
+        shards.back()->tree = make_unique<RPlus<T, N, M, ff, Metric>>();
+        shards.back()->size = 0;
+      }
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//QUANTILE CUTS METHOD: n_shards - 1 cutlines in the given axis so that each shard receives about the same part of the sample
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<T> ShardedRPlus<T, N, M, ff, Metric>::quantile_cuts(vector<HyperPoint<T, N>> &sample, size_t shard_axis, size_t n_shards) {
+  vector<T> values, shard_cuts;
+  for (HyperPoint<T, N> &hp : sample)
+    values.push_back(hp[shard_axis]);
+  sort(values.begin(), values.end());
+  for (size_t i(1); i < n_shards && !values.empty(); ++i) {
+    T cutline = values[i * values.size() / n_shards];
+    if (shard_cuts.empty() || shard_cuts.back() < cutline)
+      shard_cuts.push_back(cutline);//repeated values -> fewer shards
+  }
+  return shard_cuts;
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+size_t ShardedRPlus<T, N, M, ff, Metric>::get_shards() {
+  return shards.size();
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+size_t ShardedRPlus<T, N, M, ff, Metric>::get_shard_size(size_t shard) {
+  try {
+    if (shard >= shards.size()) {
+      throw runtime_error(ERROR_SHARD_INDEX);
+    }
+    else {
+      shared_lock<shared_mutex> guard(shards[shard]->lock);
+      return shards[shard]->size;
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//ASSIGN METHOD: Routes each data to the shard that owns it, the shards receive their parts in parallel (one writer per shard).
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void ShardedRPlus<T, N, M, ff, Metric>::assign(vector<HyperPoint<T, N>> &unpacked_data, size_t n_threads) {
+  vector<vector<HyperPoint<T, N>>> per_shard(shards.size());
+  for (HyperPoint<T, N> &hp : unpacked_data)
+    per_shard[route(hp)].push_back(hp);
+  vector<size_t> selected;
+  for (size_t i(0); i < shards.size(); ++i) {
+    if (!per_shard[i].empty())
+      selected.push_back(i);
+  }
+  for_each_shard(selected, n_threads, [&](size_t i) {
+    Shard &shard = *shards[i];
+    unique_lock<shared_mutex> guard(shard.lock);
+    for (HyperPoint<T, N> &hp : per_shard[i]) {
+      if (shard.size++ == 0)
+        shard.mbr = make_hyper_rect(hp);
+      else
+        shard.mbr.adjust(make_hyper_rect(hp));
+    }
+    shard.tree->assign(per_shard[i]);
+  });
+}
+
+//ERASE METHOD: erase in the owning shard only.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool ShardedRPlus<T, N, M, ff, Metric>::erase(HyperPoint<T, N> data) {
+  Shard &shard = *shards[route(data)];
+  unique_lock<shared_mutex> guard(shard.lock);
+  if (!shard.tree->erase(data))
+    return false;
+  --shard.size;
+  return true;
+}
+
+//UPDATE METHOD: erase in the owning shard of the old data + insert in the owning shard of the new one (it could move to another shard).
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool ShardedRPlus<T, N, M, ff, Metric>::update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data) {
+  if (!erase(old_data))
+    return false;
+  vector<HyperPoint<T, N>> new_version(1, new_data);
+  assign(new_version, 1);
+  return true;
+}
+
+/*REBUILD SHARD METHOD: Builds a new tree with the data of one shard (tight MBRs again after many erases/updates) and replaces the old
+                        one. Only this shard is locked, queries and writes over the other shards keep running.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void ShardedRPlus<T, N, M, ff, Metric>::rebuild_shard(size_t shard_index) {
+  try {
+    if (shard_index >= shards.size()) {
+      throw runtime_error(ERROR_SHARD_INDEX);
+    }
+    else {
+      Shard &shard = *shards[shard_index];
+      unique_lock<shared_mutex> guard(shard.lock);
+      vector<HyperPoint<T, N>> shard_data = shard.tree->get_all_data();
+      sort(shard_data.begin(), shard_data.end(), [this](const HyperPoint<T, N> &A, const HyperPoint<T, N> &B) { return A[axis] < B[axis]; });
+      unique_ptr<RPlus<T, N, M, ff, Metric>> new_tree = make_unique<RPlus<T, N, M, ff, Metric>>();
+      new_tree->assign(shard_data);
+      shard.tree.swap(new_tree);
+      shard.size = shard_data.size();
+      for (size_t i(0); i < shard_data.size(); ++i) {
+        if (i == 0)
+          shard.mbr = make_hyper_rect(shard_data[i]);
+        else
+          shard.mbr.adjust(make_hyper_rect(shard_data[i]));
+      }
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//RANGE QUERY METHOD: scatter the window to the shards whose MBR overlaps it (in parallel), gather their answers.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> ShardedRPlus<T, N, M, ff, Metric>::search(const HyperRectangle<T, N> &W, size_t n_threads) {
+  vector<size_t> selected;
+  pair<HyperPoint<T, N>, HyperPoint<T, N>> bounds = W.get_boundaries();
+  for (size_t i(0); i < shards.size(); ++i) {
+    if ((i > 0 && bounds.second[axis] < cuts[i - 1]) || (i < cuts.size() && !(bounds.first[axis] < cuts[i])))
+      continue;//the window is out of the slab of the shard
+    shared_lock<shared_mutex> guard(shards[i]->lock);
+    if (shards[i]->size > 0 && shards[i]->mbr.overlaps(W))
+      selected.push_back(i);
+  }
+  vector<vector<HyperPoint<T, N>>> per_shard(shards.size());
+  for_each_shard(selected, n_threads, [&](size_t i) {
+    shared_lock<shared_mutex> guard(shards[i]->lock);
+    per_shard[i] = shards[i]->tree->search(W);
+  });
+  vector<HyperPoint<T, N>> range_query;
+  for (vector<HyperPoint<T, N>> &answer : per_shard)
+    range_query.insert(range_query.end(), answer.begin(), answer.end());
+  return range_query;
+}
+
+/*KNN METHOD: the shards are visited by MINDIST to their MBRs (in parallel), each one gives its k nearest and they are merged in a
+              global max-heap. A shard is skipped when its MINDIST isn't better than the global k-th distance at that moment.*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> ShardedRPlus<T, N, M, ff, Metric>::kNN_query(HyperPoint<T, N> refdata, size_t k, size_t n_threads) {
+  if (k == 0)
+    return vector<HyperPoint<T, N>>();//the global heap below is never empty
+  vector<pair<double, size_t>> by_mindist;
+  for (size_t i(0); i < shards.size(); ++i) {
+    shared_lock<shared_mutex> guard(shards[i]->lock);
+    if (shards[i]->size > 0)
+      by_mindist.push_back(make_pair(Metric::MINDIST(refdata, shards[i]->mbr), i));
+  }
+  sort(by_mindist.begin(), by_mindist.end());
+  vector<size_t> selected;
+  vector<double> shard_mindist(shards.size());
+  for (pair<double, size_t> &shard : by_mindist) {
+    selected.push_back(shard.second);
+    shard_mindist[shard.second] = shard.first;
+  }
+  vector<pair<double, HyperPoint<T, N>>> k_best;//max-heap by distance (global bound on top)
+  auto farther = [](const pair<double, HyperPoint<T, N>> &A, const pair<double, HyperPoint<T, N>> &B) { return A.first < B.first; };
+  mutex k_best_lock;
+  for_each_shard(selected, n_threads, [&](size_t i) {
+    {
+      lock_guard<mutex> guard(k_best_lock);
+      if (k_best.size() == k && shard_mindist[i] >= k_best.front().first)
+        return;
+    }
+    vector<HyperPoint<T, N>> shard_kNN;
+    {
+      shared_lock<shared_mutex> guard(shards[i]->lock);
+      shard_kNN = shards[i]->tree->kNN_query(refdata, k);
+    }
+    lock_guard<mutex> guard(k_best_lock);
+    for (HyperPoint<T, N> &hp : shard_kNN) {
+      double distance = Metric::DIST(refdata, hp);
+      if (k_best.size() < k) {
+        k_best.push_back(make_pair(distance, hp));
+        push_heap(k_best.begin(), k_best.end(), farther);
+      }
+      else if (distance < k_best.front().first) {
+        pop_heap(k_best.begin(), k_best.end(), farther);
+        k_best.back() = make_pair(distance, hp);
+        push_heap(k_best.begin(), k_best.end(), farther);
+      }
+      else
+        break;//the answer of the shard is sorted, the next ones are farther
+    }
+  });
+  sort_heap(k_best.begin(), k_best.end(), farther);
+  vector<HyperPoint<T, N>> kNN;
+  for (pair<double, HyperPoint<T, N>> &best : k_best)
+    kNN.push_back(best.second);
+  return kNN;
+}
+
+//--ROUTE: shard that owns a data (first cutline greater than its value in the axis)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+size_t ShardedRPlus<T, N, M, ff, Metric>::route(const HyperPoint<T, N> &data) {
+  return size_t(upper_bound(cuts.begin(), cuts.end(), data[axis]) - cuts.begin());
+}
+
+//--FOR EACH SHARD: runs visit over the selected shards in the given order, in parallel if there is more than one shard and thread--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void ShardedRPlus<T, N, M, ff, Metric>::for_each_shard(vector<size_t> &selected, size_t n_threads, const function<void(size_t)> &visit) {
+  if (selected.size() < 2 || n_threads < 2) {
+    for (size_t i : selected)
+      visit(i);
+    return;
+  }
+  vector<size_t> seeds(selected.rbegin(), selected.rend());//each worker pops from the back -> the first shards go first
+  WorkStealingScheduler<size_t> scheduler(min(n_threads, selected.size()));
+  scheduler.run(seeds, [&visit](size_t &i, size_t, function<void(size_t)> &) {
+    visit(i);
+  });
+}
+
+#endif //SOURCE_RPLUS_SHARDED_HPP
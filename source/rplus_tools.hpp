@@ -25,78 +25,89 @@ public:
   friend class KDRecord;
 };
 
-template<size_t K_Dimensions>
+//Coordinate: type of each axis value (float, double, or an integer type for fixed point coordinates)
+template<size_t K_Dimensions, typename Coordinate = double>
 class KDPoint : public KDGeometry<K_Dimensions> {
-  std::array<double, K_Dimensions> axis_values_;
+  std::array<Coordinate, K_Dimensions> axis_values_;
 public:
+  typedef Coordinate Coordinate_type;
+
   KDPoint() {
-    axis_values_.fill(double(0));
+    axis_values_.fill(Coordinate(0));
   }
 
-  double operator[](size_t idx) const {
+  Coordinate operator[](size_t idx) const {
     return axis_values_[idx];
   }
 
-  KDPoint<K_Dimensions>& operator=(const KDPoint<K_Dimensions>& point_value) {
+  Coordinate& operator[](size_t idx) {
+    return axis_values_[idx];
+  }
+
+  KDPoint<K_Dimensions, Coordinate>& operator=(const KDPoint<K_Dimensions, Coordinate>& point_value) {
     std::size_t idx = 0;
-    for (double& value : axis_values_) {
-      value = elem_value.axis_values_[idx++];
+    for (Coordinate& value : axis_values_) {
+      value = point_value.axis_values_[idx++];
     }
+    return *this;
   }
 
   static KDPoint get_max() {
     KDPoint maxpoint;
-    for (double& value : maxpoint.axis_values_) {
-      value = std::numeric_limits<double>::max();
+    for (Coordinate& value : maxpoint.axis_values_) {
+      value = std::numeric_limits<Coordinate>::max();
     }
     return maxpoint;
   }
 
   static KDPoint get_min() {
     KDPoint minpoint;
-    for (double& value : minpoint.axis_values_) {
-      value = std::numeric_limits<double>::min();
+    for (Coordinate& value : minpoint.axis_values_) {
+      value = std::numeric_limits<Coordinate>::lowest();
     }
     return minpoint;
   }
 
-  template<size_t K_Dimensions, typename stream_input_type>
-  friend stream_input_type& operator>>(stream_input_type& is, KDPoint<K_Dimensions>& point);
+  template<size_t Point_Dimensions, typename Point_Coordinate, typename stream_input_type>
+  friend stream_input_type& operator>>(stream_input_type& is, KDPoint<Point_Dimensions, Point_Coordinate>& point);
 };
 
-template<size_t K_Dimensions, typename stream_input_type>
-stream_input_type& operator>>(stream_input_type& is, KDPoint<K_Dimensions>& point) {
-  for (double& value : point.axis_values_)
+template<size_t K_Dimensions, typename Coordinate, typename stream_input_type>
+stream_input_type& operator>>(stream_input_type& is, KDPoint<K_Dimensions, Coordinate>& point) {
+  for (Coordinate& value : point.axis_values_)
     is >> value;
   return is;
 }
 
-template<size_t K_Dimensions>
+template<size_t K_Dimensions, typename Coordinate = double>
 class KDRect : public KDGeometry<K_Dimensions> {
-  KDPoint<K_Dimensions> bottom_left_, top_right_;
+  KDPoint<K_Dimensions, Coordinate> bottom_left_, top_right_;
 public:
+  typedef Coordinate Coordinate_type;
+
   KDRect() {
-    bottom_left_ = KDPoint<K_Dimensions>::get_max();
-    top_right_ = KDPoint<K_Dimensions>::get_min();
+    bottom_left_ = KDPoint<K_Dimensions, Coordinate>::get_max();
+    top_right_ = KDPoint<K_Dimensions, Coordinate>::get_min();
   }
 
-  KDPoint<K_Dimensions> get_bl() { return bottom_left; }
+  const KDPoint<K_Dimensions, Coordinate>& get_bl() const { return bottom_left_; }
 
-  KDPoint<K_Dimensions> get_tr() { return top_right; }
+  const KDPoint<K_Dimensions, Coordinate>& get_tr() const { return top_right_; }
 
-  KDRect<K_Dimensions>& operator=(const KDPoint<K_Dimensions>& point_value) {
+  KDRect<K_Dimensions, Coordinate>& operator=(const KDPoint<K_Dimensions, Coordinate>& point_value) {
     bottom_left_ = point_value;
     top_right_ = point_value;
+    return *this;
   }
 
-  void enlarge(const KDRect<K_Dimensions>& other) {
+  void enlarge(const KDRect<K_Dimensions, Coordinate>& other) {
     for (size_t idx(0); idx < K_Dimensions; ++idx) {
-      bottom_left_[idx] = std::min(bottom_left_[idx], other[idx]);
-      top_right_[idx] = std::max(top_right_[idx], other[idx]);
+      bottom_left_[idx] = std::min(bottom_left_[idx], other.bottom_left_[idx]);
+      top_right_[idx] = std::max(top_right_[idx], other.top_right_[idx]);
     }
   }
 
-  bool overlaps(const KDRect<K_Dimensions>& rect) {
+  bool overlaps(const KDRect<K_Dimensions, Coordinate>& rect) const {
     for (size_t idx(0); idx < K_Dimensions; ++idx) {
       if (bottom_left_[idx] > rect.top_right_[idx] ||
         top_right_[idx] < rect.bottom_left_[idx])
@@ -105,7 +116,7 @@ public:
     return true;
   }
 
-  bool overlaps(const KDPoint<K_Dimensions>& point) {
+  bool overlaps(const KDPoint<K_Dimensions, Coordinate>& point) const {
     for (size_t idx(0); idx < K_Dimensions; ++idx) {
       if (bottom_left_[idx] > point[idx] || top_right_[idx] < point[idx])
         return false;
@@ -116,11 +127,12 @@ public:
 
 template<typename Container, std::size_t Dimensionality = Container::Dimensionality>
 class KDRecord {
-  typedef KDPoint<Dimensionality> Container_t_Point;
-  typedef KDRect<Dimensionality> Container_t_Rect;
+  typedef KDPoint<Dimensionality, typename Container::Coordinate_type> Container_t_Point;
+  typedef KDRect<Dimensionality, typename Container::Coordinate_type> Container_t_Rect;
 public:
   static const std::size_t RDimensionality = Dimensionality;
   typedef Container RContainer;
+  typedef typename Container::Coordinate_type RCoordinate;
 
   virtual RContainer operator()() = 0;
   static bool check_container_class() {
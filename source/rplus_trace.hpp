@@ -0,0 +1,152 @@
+#ifndef SOURCE_RPLUS_TRACE_HPP
+#define SOURCE_RPLUS_TRACE_HPP
+
+#include <rplus_utils.hpp>
+
+/*Comment RPLUS_TRACING if you don't want the timeline of the R+ (or compile with -DRPLUS_TRACING only when you need it).
+  Without it TRACE_SPAN is empty and the tree pays nothing. With it every traced phase (assign, insert, choose_leaf, splits,
+  partition, sweep, queries) is one span in a ring buffer of its thread, dump_trace writes them in the Chrome trace format
+  (chrome://tracing or https://ui.perfetto.dev).*/
+
+//#define RPLUS_TRACING
+
+#define TRACE_RING_CAPACITY 65536//Spans kept by each thread, the oldest are overwritten
+
+#define ERROR_TRACE_FILE "The trace file couldn't be opened."
+
+#define TRACE_CONCAT_LINE(name, line) name##line
+#define TRACE_SPAN_NAME(line) TRACE_CONCAT_LINE(trace_span_, line)
+
+#ifdef RPLUS_TRACING
+#define TRACE_SPAN(phase) TraceSpan TRACE_SPAN_NAME(__LINE__)(phase);
+#else
+#define TRACE_SPAN(phase)
+#endif // RPLUS_TRACING
+
+//One finished phase: name (string literal), start and duration in nanoseconds since the start of the trace
+struct TraceEvent {
+  const char *name;
+  int64_t start;
+  int64_t duration;
+};
+
+//Spans of one thread, only that thread writes (no lock), written counts every span so the ring knows what was overwritten
+struct TraceBuffer {
+  array<TraceEvent, TRACE_RING_CAPACITY> events;
+  atomic<size_t> written;
+  size_t thread_number;
+
+  TraceBuffer(size_t thread_number) {
+    written = 0;
+    this->thread_number = thread_number;
+  }
+};
+
+//All the ring buffers (they live until the end of the process, so the spans of finished threads can be dumped too)
+class TraceRecorder {
+private:
+  vector<shared_ptr<TraceBuffer>> buffers;
+  mutex buffers_lock;
+  chrono::steady_clock::time_point epoch;
+
+  TraceRecorder() {
+    epoch = chrono::steady_clock::now();
+  }
+
+public:
+  static TraceRecorder& get_instance() {
+    static TraceRecorder recorder;
+    return recorder;
+  }
+
+  int64_t now() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+  }
+
+  //The buffer of the calling thread, created the first time the thread traces something
+  TraceBuffer& get_thread_buffer() {
+    thread_local shared_ptr<TraceBuffer> thread_buffer;
+    if (!thread_buffer) {
+      lock_guard<mutex> guard(buffers_lock);
+      thread_buffer = make_shared<TraceBuffer>(buffers.size() + 1);
+      buffers.push_back(thread_buffer);
+    }
+    return *thread_buffer;
+  }
+
+  void record(const char *name, int64_t start, int64_t end) {
+    TraceBuffer &buffer = get_thread_buffer();
+    size_t position = buffer.written.load(memory_order_relaxed);
+    buffer.events[position % TRACE_RING_CAPACITY] = TraceEvent{ name, start, end - start };
+    buffer.written.store(position + 1, memory_order_release);
+  }
+
+  //Forgets the spans of every thread (call it while no traced work is running)
+  void clear() {
+    lock_guard<mutex> guard(buffers_lock);
+    for (shared_ptr<TraceBuffer> &buffer : buffers)
+      buffer->written.store(0, memory_order_release);
+  }
+
+  /*Writes the spans kept by the rings as Chrome trace JSON ("X" events, microseconds, one tid per thread).
+    Dump while the traced work is quiet: a thread that keeps tracing may overwrite a span that is being written.*/
+  void dump(ostream &out) {
+    lock_guard<mutex> guard(buffers_lock);
+    out << "{\"traceEvents\":[";
+    bool first_event = true;
+    for (shared_ptr<TraceBuffer> &buffer : buffers) {
+      size_t written = buffer->written.load(memory_order_acquire);
+      size_t oldest = (written > TRACE_RING_CAPACITY) ? written - TRACE_RING_CAPACITY : 0;
+      out << ((first_event) ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_number
+          << ",\"args\":{\"name\":\"rplus-" << buffer->thread_number << "\"}}";
+      first_event = false;
+      for (size_t e(oldest); e < written; ++e) {
+        const TraceEvent &event = buffer->events[e % TRACE_RING_CAPACITY];
+        out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"rplus\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_number
+            << fixed << setprecision(3) << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "}";
+      }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  }
+};
+
+//Scoped span: measures from its construction to the end of the scope (use it through TRACE_SPAN)
+class TraceSpan {
+private:
+  const char *name;
+  int64_t start;
+
+public:
+  TraceSpan(const char *name) {
+    this->name = name;
+    start = TraceRecorder::get_instance().now();
+  }
+
+  ~TraceSpan() {
+    TraceRecorder &recorder = TraceRecorder::get_instance();
+    recorder.record(name, start, recorder.now());
+  }
+};
+
+//Writes the trace of every thread to a JSON file (open it in chrome://tracing or Perfetto)
+inline void dump_trace(const string &file_name) {
+  try {
+    ofstream trace_file(file_name);
+    if (!trace_file.is_open()) {
+      throw runtime_error(ERROR_TRACE_FILE);
+    }
+    else {
+      TraceRecorder::get_instance().dump(trace_file);
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+inline void clear_trace() {
+  TraceRecorder::get_instance().clear();
+}
+
+#endif //SOURCE_RPLUS_TRACE_HPP
@@ -1,9 +1,18 @@
+#ifndef SOURCE_RPLUS_UTILS_HPP
+#define SOURCE_RPLUS_UTILS_HPP
+
 #include <algorithm>
 #include <array>
+#include <atomic>
 
 #include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include <deque>
 
 #include <fstream>
+#include <functional>
 
 #include <iomanip>
 #include <iostream>
@@ -12,6 +21,7 @@
 
 #include <math.h>
 #include <memory>
+#include <mutex>
 
 #include <queue>
 
@@ -21,8 +31,11 @@
 #include <stdexcept>
 #include <string>
 
+#include <thread>
 #include <tuple>
+#include <type_traits>
 
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 
@@ -39,6 +52,9 @@ using namespace std;
 #define ERROR_FF_VALUE "The value for fill factor should be between 2 and M."
 #define ERROR_NODE_OFR "The index is out of range in the node."
 #define ERROR_EMPTY_TREE "This R+ Tree is empty."
+#define ERROR_NORMALIZATION "The normalization of the axes can only be changed while the R+ Tree is empty."
+#define ERROR_NORMALIZATION_SCALE "The offset of each normalized axis should be finite and its scale finite and greater than 0."
+#define ERROR_PREDICATE_PAYLOAD "The attribute predicates filter the attributes of the songs, this R+ Tree carries another payload."
 
 const size_t T_DIMENSIONS_NUM = 19;//Number of dimensions in the dataset
 const size_t KUSED_DIMENSIONS = 14;//Number of dimensions that will be used
@@ -46,68 +62,116 @@ const size_t KUSED_DIMENSIONS = 14;//Number of dimensions that will be used
 const char csv_delimiter = ';';
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//HyperPoint : DATA or Bound for HyperRectangle
-template<typename T, size_t N>
+/*Attributes of a song that aren't axes of the R+ (columns year, popularity and explicit of the dataset), only for the filters.
+  It's the default payload of HyperPoint, another payload needs the same encode/decode (binary form of the write-ahead log)*/
+struct SongAttributes {
+  int16_t year;
+  uint8_t popularity;
+  bool is_explicit;
+
+  SongAttributes(int16_t year = 0, uint8_t popularity = 0, bool is_explicit = false) {
+    this->year = year;
+    this->popularity = popularity;
+    this->is_explicit = is_explicit;
+  }
+
+  //[year | popularity | explicit], 4 bytes
+  void encode(string &bytes) const {
+    bytes.append(reinterpret_cast<const char *>(&year), sizeof(int16_t));
+    bytes += char(popularity);
+    bytes += char(is_explicit);
+  }
+
+  bool decode(const string &bytes, size_t &offset) {
+    if (offset + sizeof(int16_t) + 2 > bytes.size())
+      return false;
+    memcpy(&year, bytes.data() + offset, sizeof(int16_t));
+    popularity = uint8_t(bytes[offset + sizeof(int16_t)]);
+    is_explicit = bytes[offset + sizeof(int16_t) + 1] != 0;
+    offset += sizeof(int16_t) + 2;
+    return true;
+  }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//HyperPoint : DATA or Bound for HyperRectangle (Payload: data that isn't an axis, carried with the point)
+template<typename T, size_t N, typename Payload = SongAttributes>
 struct HyperPoint {
+  typedef Payload payload_type;
+
   HyperPoint();
   HyperPoint(array<T, N> data);
   HyperPoint(array<T, N> data, string sg_name);
-  HyperPoint<T, N>& operator=(const HyperPoint<T, N> &other);
+  HyperPoint<T, N, Payload>& operator=(const HyperPoint<T, N, Payload> &other);
   T& operator[](size_t index);
   T operator[](size_t index) const;
   string get_songs_name();
+  const Payload& get_attributes() const;
+  void set_attributes(const Payload &song_attributes);
   void show_data();
 
 private:
   array<T, N> multidata;
   string songs_name;
+  Payload attributes;
 };
 
-template<typename T, size_t N>
-HyperPoint<T, N>::HyperPoint() {
+template<typename T, size_t N, typename Payload>
+HyperPoint<T, N, Payload>::HyperPoint() {
   multidata.fill(T(0));
 }
 
-template<typename T, size_t N>
-HyperPoint<T, N>::HyperPoint(array<T, N> data) {
+template<typename T, size_t N, typename Payload>
+HyperPoint<T, N, Payload>::HyperPoint(array<T, N> data) {
   for (size_t i(0); i < N; ++i) {
     multidata[i] = data[i];
   }
 }
 
-template<typename T, size_t N>
-HyperPoint<T, N>::HyperPoint(array<T, N> data, string sg_name) {
+template<typename T, size_t N, typename Payload>
+HyperPoint<T, N, Payload>::HyperPoint(array<T, N> data, string sg_name) {
   for (size_t i(0); i < N; ++i) {
     multidata[i] = data[i];
   }
   songs_name = sg_name;
 }
 
-template<typename T, size_t N>
-HyperPoint<T, N>& HyperPoint<T, N>::operator=(const HyperPoint<T, N>& other) {
+template<typename T, size_t N, typename Payload>
+HyperPoint<T, N, Payload>& HyperPoint<T, N, Payload>::operator=(const HyperPoint<T, N, Payload>& other) {
   songs_name = other.songs_name;
+  attributes = other.attributes;
   for (size_t i(0); i < N; ++i)
     multidata[i] = other.multidata[i];
   return *this;
 }
 
-template<typename T, size_t N>
-T& HyperPoint<T, N>::operator[](size_t index) {
+template<typename T, size_t N, typename Payload>
+T& HyperPoint<T, N, Payload>::operator[](size_t index) {
   return multidata[index];
 }
 
-template<typename T, size_t N>
-T HyperPoint<T, N>::operator[](size_t index) const{
+template<typename T, size_t N, typename Payload>
+T HyperPoint<T, N, Payload>::operator[](size_t index) const{
   return multidata[index];
 }
 
-template<typename T, size_t N>
-string HyperPoint<T, N>::get_songs_name() {
+template<typename T, size_t N, typename Payload>
+string HyperPoint<T, N, Payload>::get_songs_name() {
   return songs_name;
 }
 
-template<typename T, size_t N>
-void HyperPoint<T, N>::show_data() {
+template<typename T, size_t N, typename Payload>
+const Payload& HyperPoint<T, N, Payload>::get_attributes() const {
+  return attributes;
+}
+
+template<typename T, size_t N, typename Payload>
+void HyperPoint<T, N, Payload>::set_attributes(const Payload &song_attributes) {
+  attributes = song_attributes;
+}
+
+template<typename T, size_t N, typename Payload>
+void HyperPoint<T, N, Payload>::show_data() {
   cout << "\tHyperPoint<" << N << "> : {"; for (size_t i(0); i < N; ++i) cout << setprecision(10) << multidata[i] << ((i != N - 1) ? "," : ""); cout << "}\n";
 }
 
@@ -127,15 +191,18 @@ struct HyperRectangle {
   HyperRectangle();
   HyperRectangle(HyperPoint<T, N> &A, HyperPoint<T, N> &B);
   HyperRectangle<T, N>& operator=(const HyperRectangle<T, N>& other);
-  bool overlaps(const HyperRectangle<T, N> &other);
-  bool contains(const HyperPoint<T, N> &point);
+  bool overlaps(const HyperRectangle<T, N> &other) const;
+  template<typename Payload>
+  bool contains(const HyperPoint<T, N, Payload> &point) const;
   void adjust(const HyperRectangle<T, N> &other);
-  pair<HyperPoint<T, N>, HyperPoint<T, N>> get_boundaries();
+  const HyperPoint<T, N>& get_bottom_left() const;
+  const HyperPoint<T, N>& get_top_right() const;
+  pair<HyperPoint<T, N>, HyperPoint<T, N>> get_boundaries() const;
   double get_hypervolume();
   void show_rect();
 
-  template<typename T, size_t N>
-  friend HyperRectangle<T, N> make_hyper_rect(HyperPoint<T, N> &h_point);
+  template<typename U, size_t P, typename Payload>
+  friend HyperRectangle<U, P> make_hyper_rect(HyperPoint<U, P, Payload> &h_point);
 
 private:
   HyperPoint<T, N> bottom_left, top_right;
@@ -162,7 +229,7 @@ HyperRectangle<T, N>& HyperRectangle<T, N>::operator=(const HyperRectangle<T, N>
 }
 
 template<typename T, size_t N>
-bool HyperRectangle<T, N>::overlaps(const HyperRectangle<T, N> &other) {
+bool HyperRectangle<T, N>::overlaps(const HyperRectangle<T, N> &other) const {
   for (size_t i(0); i < N; ++i) {
     if (!(bottom_left[i] <= other.top_right[i] &&
           top_right[i] >= other.bottom_left[i])) {
@@ -173,7 +240,8 @@ bool HyperRectangle<T, N>::overlaps(const HyperRectangle<T, N> &other) {
 }
 
 template<typename T, size_t N>
-bool HyperRectangle<T, N>::contains(const HyperPoint<T, N> &point) {
+template<typename Payload>
+bool HyperRectangle<T, N>::contains(const HyperPoint<T, N, Payload> &point) const {
   for (size_t i(0); i < N; ++i) {
     if (!(bottom_left[i] <= point[i] && point[i] <= top_right[i]))
       return false;
@@ -189,8 +257,20 @@ void HyperRectangle<T, N>::adjust(const HyperRectangle<T, N> &other) {
   }
 }
 
+//Corners without copies (use them in the hot paths: sorts, splits, distances)
+template<typename T, size_t N>
+const HyperPoint<T, N>& HyperRectangle<T, N>::get_bottom_left() const {
+  return bottom_left;
+}
+
 template<typename T, size_t N>
-pair<HyperPoint<T, N>, HyperPoint<T, N>> HyperRectangle<T, N>::get_boundaries() {
+const HyperPoint<T, N>& HyperRectangle<T, N>::get_top_right() const {
+  return top_right;
+}
+
+//Copy of both corners
+template<typename T, size_t N>
+pair<HyperPoint<T, N>, HyperPoint<T, N>> HyperRectangle<T, N>::get_boundaries() const {
   return make_pair(bottom_left, top_right);
 }
 
@@ -209,67 +289,671 @@ void HyperRectangle<T, N>::show_rect() {
   cout << "\t\t\t\t\ttop_right: "; top_right.show_data();
 }
 
-template<typename T, size_t N>
-HyperRectangle<T, N> make_hyper_rect(HyperPoint<T, N> &h_point) {
+//0 volume MBR of a hyperpoint (only the coordinates: the corners don't carry the name or the payload)
+template<typename T, size_t N, typename Payload>
+HyperRectangle<T, N> make_hyper_rect(HyperPoint<T, N, Payload> &h_point) {
   HyperRectangle<T, N> conv;
-  conv.bottom_left = conv.top_right = h_point;
+  for (size_t i(0); i < N; ++i)
+    conv.bottom_left[i] = conv.top_right[i] = h_point[i];
   return conv;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*Distance policies for the R+ (template parameter Metric): DIST between hyperpoints and MINDIST between an hyperpoint (or an
+  hyperrectangle) and the nearest side of an hyperrectangle, each one written for its own norm so the kNN loop has no runtime dispatch.
+  Columnar kernels (data stored by axis): ACCUMULATE adds one axis of a block of data to its partial distances and FINISH turns
+  the partials into distances, both plain loops over contiguous arrays that the compiler vectorizes.
+  Weighted L2: use L2Metric over axes scaled by sqrt(weight) with AxisNormalization::weight_axis.*/
+struct L2Metric {
+  template<typename T, size_t N, typename Payload>
+  static inline double DIST(const HyperPoint<T, N, Payload> &p1, const HyperPoint<T, N, Payload> &p2) {
+    double sum = 0.0;
+    for (size_t i(0); i < N; ++i) {
+      double diff = double(p1[i]) - double(p2[i]);
+      sum += diff * diff;
+    }
+    return sqrt(sum);
+  }
 
-//CSV file reader : path of the file | features that were considered | id(name of the song) | container for the data in hypepoints
+  template<typename T, size_t N, typename Payload>
+  static inline double MINDIST(const HyperPoint<T, N, Payload> &p, const HyperRectangle<T, N> &r) {
+    const HyperPoint<T, N> &low = r.get_bottom_left(), &high = r.get_top_right();
+    double sum = 0.0;
+    for (size_t i(0); i < N; ++i) {
+      double gap = max(double(low[i]) - double(p[i]), max(double(p[i]) - double(high[i]), 0.0));
+      sum += gap * gap;
+    }
+    return sqrt(sum);
+  }
+
+  template<typename T, size_t N>
+  static inline double MINDIST(const HyperRectangle<T, N> &r1, const HyperRectangle<T, N> &r2) {
+    const HyperPoint<T, N> &low1 = r1.get_bottom_left(), &high1 = r1.get_top_right(), &low2 = r2.get_bottom_left(), &high2 = r2.get_top_right();
+    double sum = 0.0;
+    for (size_t i(0); i < N; ++i) {
+      double gap = max(double(low1[i]) - double(high2[i]), max(double(low2[i]) - double(high1[i]), 0.0));
+      sum += gap * gap;
+    }
+    return sqrt(sum);
+  }
+
+  //Kernels over raw coordinates (contiguous layouts)
+  template<typename T, size_t N>
+  static inline double DIST(const T *p1, const T *p2) {
+    double sum = 0.0;
+    for (size_t i(0); i < N; ++i) {
+      double diff = double(p1[i]) - double(p2[i]);
+      sum += diff * diff;
+    }
+    return sqrt(sum);
+  }
+
+  template<typename T, size_t N>
+  static inline double MINDIST(const T *p, const T *low, const T *high) {
+    double sum = 0.0;
+    for (size_t i(0); i < N; ++i) {
+      double gap = max(double(low[i]) - double(p[i]), max(double(p[i]) - double(high[i]), 0.0));
+      sum += gap * gap;
+    }
+    return sqrt(sum);
+  }
+
+  template<typename T>
+  static inline void ACCUMULATE(T ref, const T *column, size_t count, double *partial) {
+    for (size_t d(0); d < count; ++d) {
+      double diff = double(column[d]) - double(ref);
+      partial[d] += diff * diff;
+    }
+  }
+
+  static inline void FINISH(double *partial, size_t count) {
+    for (size_t d(0); d < count; ++d)
+      partial[d] = sqrt(partial[d]);
+  }
+};
+
+struct L1Metric {
+  template<typename T, size_t N, typename Payload>
+  static inline double DIST(const HyperPoint<T, N, Payload> &p1, const HyperPoint<T, N, Payload> &p2) {
+    double sum = 0.0;
+    for (size_t i(0); i < N; ++i)
+      sum += fabs(double(p1[i]) - double(p2[i]));
+    return sum;
+  }
+
+  template<typename T, size_t N, typename Payload>
+  static inline double MINDIST(const HyperPoint<T, N, Payload> &p, const HyperRectangle<T, N> &r) {
+    const HyperPoint<T, N> &low = r.get_bottom_left(), &high = r.get_top_right();
+    double sum = 0.0;
+    for (size_t i(0); i < N; ++i)
+      sum += max(double(low[i]) - double(p[i]), max(double(p[i]) - double(high[i]), 0.0));
+    return sum;
+  }
+  template<typename T, size_t N>
+  static inline double MINDIST(const HyperRectangle<T, N> &r1, const HyperRectangle<T, N> &r2) {
+    const HyperPoint<T, N> &low1 = r1.get_bottom_left(), &high1 = r1.get_top_right(), &low2 = r2.get_bottom_left(), &high2 = r2.get_top_right();
+    double sum = 0.0;
+    for (size_t i(0); i < N; ++i)
+      sum += max(double(low1[i]) - double(high2[i]), max(double(low2[i]) - double(high1[i]), 0.0));
+    return sum;
+  }
+
+  template<typename T, size_t N>
+  static inline double DIST(const T *p1, const T *p2) {
+    double sum = 0.0;
+    for (size_t i(0); i < N; ++i)
+      sum += fabs(double(p1[i]) - double(p2[i]));
+    return sum;
+  }
+
+  template<typename T, size_t N>
+  static inline double MINDIST(const T *p, const T *low, const T *high) {
+    double sum = 0.0;
+    for (size_t i(0); i < N; ++i)
+      sum += max(double(low[i]) - double(p[i]), max(double(p[i]) - double(high[i]), 0.0));
+    return sum;
+  }
+
+  template<typename T>
+  static inline void ACCUMULATE(T ref, const T *column, size_t count, double *partial) {
+    for (size_t d(0); d < count; ++d)
+      partial[d] += fabs(double(column[d]) - double(ref));
+  }
+
+  static inline void FINISH(double *, size_t) {
+    //the sum is the distance
+  }
+};
+
+struct LInfMetric {
+  template<typename T, size_t N, typename Payload>
+  static inline double DIST(const HyperPoint<T, N, Payload> &p1, const HyperPoint<T, N, Payload> &p2) {
+    double farthest = 0.0;
+    for (size_t i(0); i < N; ++i)
+      farthest = max(farthest, fabs(double(p1[i]) - double(p2[i])));
+    return farthest;
+  }
+
+  template<typename T, size_t N, typename Payload>
+  static inline double MINDIST(const HyperPoint<T, N, Payload> &p, const HyperRectangle<T, N> &r) {
+    const HyperPoint<T, N> &low = r.get_bottom_left(), &high = r.get_top_right();
+    double farthest = 0.0;
+    for (size_t i(0); i < N; ++i)
+      farthest = max(farthest, max(double(low[i]) - double(p[i]), double(p[i]) - double(high[i])));
+    return farthest;
+  }
+  template<typename T, size_t N>
+  static inline double MINDIST(const HyperRectangle<T, N> &r1, const HyperRectangle<T, N> &r2) {
+    const HyperPoint<T, N> &low1 = r1.get_bottom_left(), &high1 = r1.get_top_right(), &low2 = r2.get_bottom_left(), &high2 = r2.get_top_right();
+    double farthest = 0.0;
+    for (size_t i(0); i < N; ++i)
+      farthest = max(farthest, max(double(low1[i]) - double(high2[i]), double(low2[i]) - double(high1[i])));
+    return farthest;
+  }
+
+  template<typename T, size_t N>
+  static inline double DIST(const T *p1, const T *p2) {
+    double farthest = 0.0;
+    for (size_t i(0); i < N; ++i)
+      farthest = max(farthest, fabs(double(p1[i]) - double(p2[i])));
+    return farthest;
+  }
+
+  template<typename T, size_t N>
+  static inline double MINDIST(const T *p, const T *low, const T *high) {
+    double farthest = 0.0;
+    for (size_t i(0); i < N; ++i)
+      farthest = max(farthest, max(double(low[i]) - double(p[i]), double(p[i]) - double(high[i])));
+    return farthest;
+  }
+
+  template<typename T>
+  static inline void ACCUMULATE(T ref, const T *column, size_t count, double *partial) {
+    for (size_t d(0); d < count; ++d)
+      partial[d] = max(partial[d], fabs(double(column[d]) - double(ref)));
+  }
+
+  static inline void FINISH(double *, size_t) {
+    //the max is the distance
+  }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*Per-axis normalization: x' = (x - offset) * scale, applied once when the data enters the R+ (so duration_ms or tempo don't
+  swamp the 0-1 features). The normalized point is only the key of the R+, the queries give back the data as it was given.
+  Only for floating point data (an integral scale would be 0) and the scales are always finite and > 0 (same order in every axis).*/
 template<typename T, size_t N>
-void read_data_from_file(string file_path, vector<string> &features, string id, vector<HyperPoint<T, N>> &db_container) {
-  string cols_labels, row_data_line;
-  ifstream data_set_file(file_path);
-  if (!data_set_file.is_open()) {
-    ALERT("Couldn\'t open the file " + file_path)
-    exit(1);
+struct AxisNormalization {
+  AxisNormalization();
+  void fit(vector<HyperPoint<T, N>> &sample);
+  void weight_axis(size_t axis, T factor);
+  bool is_valid() const;
+  template<typename Payload>
+  void apply(HyperPoint<T, N, Payload> &point) const;
+  HyperRectangle<T, N> apply(const HyperRectangle<T, N> &rect) const;
+
+private:
+  array<T, N> offset, scale;
+};
+
+template<typename T, size_t N>
+AxisNormalization<T, N>::AxisNormalization() {
+  offset.fill(T(0));
+  scale.fill(T(1));
+}
+
+//Min-max scaling of each axis to [0, 1] using a sample of the data
+template<typename T, size_t N>
+void AxisNormalization<T, N>::fit(vector<HyperPoint<T, N>> &sample) {
+  static_assert(is_floating_point<T>::value, "The normalization of the axes needs a floating point data type.");
+  if (sample.empty())
+    return;
+  array<T, N> lowest, highest;
+  for (size_t i(0); i < N; ++i)
+    lowest[i] = highest[i] = sample[0][i];
+  for (HyperPoint<T, N> &point : sample) {
+    for (size_t i(0); i < N; ++i) {
+      lowest[i] = min(lowest[i], point[i]);
+      highest[i] = max(highest[i], point[i]);
+    }
   }
-  if (N + 1 < features.size()) {
-    ALERT("The value of N is not enough for the given features.")
-    exit(1);
+  for (size_t i(0); i < N; ++i) {
+    offset[i] = lowest[i];
+    scale[i] = (highest[i] > lowest[i]) ? T(1) / (highest[i] - lowest[i]) : T(1);
+  }
+  try {
+    if (!is_valid())
+      throw runtime_error(ERROR_NORMALIZATION_SCALE);//a coordinate that isn't finite or a range so small that 1 / range overflows
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//Gives more (factor > 1) or less (0 < factor < 1) importance to an axis in the distances
+template<typename T, size_t N>
+void AxisNormalization<T, N>::weight_axis(size_t axis, T factor) {
+  static_assert(is_floating_point<T>::value, "The normalization of the axes needs a floating point data type.");
+  try {
+    if (!(factor > T(0)) || !isfinite(double(scale[axis] * factor)) || !(scale[axis] * factor > T(0)))
+      throw runtime_error(ERROR_NORMALIZATION_SCALE);
+    scale[axis] *= factor;
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
   }
+}
 
-  getline(data_set_file, cols_labels);
+//Finite offsets and finite scales > 0 (a 0 scale would merge every value of the axis, a negative one would flip the MBRs)
+template<typename T, size_t N>
+bool AxisNormalization<T, N>::is_valid() const {
+  for (size_t i(0); i < N; ++i) {
+    if (!isfinite(double(offset[i])) || !isfinite(double(scale[i])) || !(scale[i] > T(0)))
+      return false;
+  }
+  return true;
+}
+
+template<typename T, size_t N>
+template<typename Payload>
+void AxisNormalization<T, N>::apply(HyperPoint<T, N, Payload> &point) const {
+  for (size_t i(0); i < N; ++i)
+    point[i] = (point[i] - offset[i]) * scale[i];
+}
+
+template<typename T, size_t N>
+HyperRectangle<T, N> AxisNormalization<T, N>::apply(const HyperRectangle<T, N> &rect) const {
+  pair<HyperPoint<T, N>, HyperPoint<T, N>> bounds = rect.get_boundaries();
+  apply(bounds.first);
+  apply(bounds.second);
+  return HyperRectangle<T, N>(bounds.first, bounds.second);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*Budget for the approximate kNN: a node is pruned when MINDIST * (1 + epsilon) is not better than the current k-th distance,
+  and the search stops after max_visited_nodes nodes or max_time (0 = no limit for both).*/
+struct KNNBudget {
+  double epsilon;
+  size_t max_visited_nodes;
+  chrono::microseconds max_time;
+
+  KNNBudget(double epsilon = 0.0, size_t max_visited_nodes = 0, chrono::microseconds max_time = chrono::microseconds(0)) {
+    this->epsilon = epsilon;
+    this->max_visited_nodes = max_visited_nodes;
+    this->max_time = max_time;
+  }
+};
+
+//What happened in an approximate kNN: exact -> the answer is the true kNN, budget_exhausted -> stopped by nodes/time (no bound)
+struct KNNReport {
+  bool exact;
+  bool budget_exhausted;
+  size_t visited_nodes;
+  double elapsed_ms;
+};
+
+/*Min/max of the attributes of the data of a subtree (predicate pushdown), an empty summary has min > max and no flags.
+  The summaries only grow (like the MBRs), so after erasing data they may be wider than needed but never too narrow.*/
+struct AttributeSummary {
+  int16_t min_year, max_year;
+  uint8_t min_popularity, max_popularity;
+  bool has_explicit, has_clean;
+
+  AttributeSummary() {
+    min_year = numeric_limits<int16_t>::max();
+    max_year = numeric_limits<int16_t>::min();
+    min_popularity = numeric_limits<uint8_t>::max();
+    max_popularity = 0;
+    has_explicit = has_clean = false;
+  }
+
+  AttributeSummary(const SongAttributes &attributes) {
+    min_year = max_year = attributes.year;
+    min_popularity = max_popularity = attributes.popularity;
+    has_explicit = attributes.is_explicit;
+    has_clean = !attributes.is_explicit;
+  }
+
+  void adjust(const AttributeSummary &other) {
+    min_year = min(min_year, other.min_year);
+    max_year = max(max_year, other.max_year);
+    min_popularity = min(min_popularity, other.min_popularity);
+    max_popularity = max(max_popularity, other.max_popularity);
+    has_explicit = has_explicit || other.has_explicit;
+    has_clean = has_clean || other.has_clean;
+  }
+};
+
+/*Range predicate over the attributes of the songs (ex.: non explicit, year >= 2010, popularity > 40 -> ONLY_CLEAN, min_year = 2010,
+  min_popularity = 41), both bounds are inclusive. The default predicate accepts every song.
+  matches: the song passes | may_match: some song of a subtree with that summary could pass (if not, the subtree is pruned).*/
+struct AttributePredicate {
+  enum ExplicitFilter { ANY_SONG, ONLY_CLEAN, ONLY_EXPLICIT };
+
+  int16_t min_year, max_year;
+  uint8_t min_popularity, max_popularity;
+  ExplicitFilter explicit_filter;
+
+  AttributePredicate() {
+    min_year = numeric_limits<int16_t>::min();
+    max_year = numeric_limits<int16_t>::max();
+    min_popularity = 0;
+    max_popularity = numeric_limits<uint8_t>::max();
+    explicit_filter = ANY_SONG;
+  }
+
+  bool accepts_all() const {
+    return min_year == numeric_limits<int16_t>::min() && max_year == numeric_limits<int16_t>::max() &&
+      min_popularity == 0 && max_popularity == numeric_limits<uint8_t>::max() && explicit_filter == ANY_SONG;
+  }
+
+  bool matches(const SongAttributes &attributes) const {
+    return min_year <= attributes.year && attributes.year <= max_year &&
+      min_popularity <= attributes.popularity && attributes.popularity <= max_popularity &&
+      (explicit_filter == ANY_SONG || attributes.is_explicit == (explicit_filter == ONLY_EXPLICIT));
+  }
+
+  bool may_match(const AttributeSummary &summary) const {
+    return min_year <= summary.max_year && summary.min_year <= max_year &&
+      min_popularity <= summary.max_popularity && summary.min_popularity <= max_popularity &&
+      (explicit_filter == ANY_SONG || ((explicit_filter == ONLY_EXPLICIT) ? summary.has_explicit : summary.has_clean));
+  }
+};
+
+/*Deadline and cancellation of one query: the tree checks stopped() between node expansions and gives up (interrupted = true, the
+  answer is partial) as soon as the query is cancelled or its deadline passes. cancel() can be called from any thread.*/
+struct QueryControl {
+  atomic<bool> cancelled;
+  bool interrupted;
+  chrono::steady_clock::time_point deadline;
+
+  QueryControl(chrono::microseconds timeout = chrono::microseconds(0)) : cancelled(false) {
+    interrupted = false;
+    deadline = (timeout.count() > 0) ? chrono::steady_clock::now() + timeout : chrono::steady_clock::time_point::max();
+  }
+
+  void cancel() {
+    cancelled.store(true, memory_order_relaxed);
+  }
+
+  bool stopped() const {
+    return cancelled.load(memory_order_relaxed) ||
+      (deadline != chrono::steady_clock::time_point::max() && chrono::steady_clock::now() >= deadline);
+  }
+};
+
+//Preference of each axis for the skyline: the lowest values are better, the highest ones, or the axis doesn't matter
+enum SkylinePreference { SKYLINE_MIN, SKYLINE_MAX, SKYLINE_IGNORE };
+
+//Receives the pairs of a join: (id of the left data, id of the right data, distance)
+typedef function<void(const string &, const string &, double)> JoinSink;
+
+//kNN graph in CSR form: the neighbors of ids[i] are neighbors[offsets[i] .. offsets[i + 1]) (positions in ids), nearest first
+struct KNNGraph {
+  vector<string> ids;
+  vector<size_t> offsets;
+  vector<uint32_t> neighbors;
+  vector<float> distances;
+};
+
+/*When a subtree is degraded and how it is rebuilt (repack): utilization = data / (leaves * M) below min_utilization or dead space
+  (part of the MBR of an internal node that its children don't cover) over max_dead_space. Only subtrees with at most
+  max_subtree_data data are rebuilt (the root never, no full rebuilds), the worst max_jobs per round, leaves filled to fill.*/
+struct RepackPolicy {
+  double min_utilization;
+  double max_dead_space;
+  size_t max_subtree_data;
+  size_t max_jobs;
+  double fill;
+
+  RepackPolicy(double min_utilization = 0.4, double max_dead_space = 0.98, size_t max_subtree_data = 65536, size_t max_jobs = 8,
+               double fill = 0.75) {
+    this->min_utilization = min_utilization;
+    this->max_dead_space = max_dead_space;
+    this->max_subtree_data = max_subtree_data;
+    this->max_jobs = max_jobs;
+    this->fill = fill;
+  }
+};
+
+//What a repack round did: degraded subtrees found, rebuilt and published (skipped if the tree changed while they were rebuilt)
+struct RepackReport {
+  size_t candidates;
+  size_t repacked;
+  size_t skipped;
+  size_t moved_data;
+  size_t nodes_before, nodes_after;//nodes of the published subtrees before and after
+  double elapsed_ms;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*Open addressing hash index from the id of a data (name of the song) to the values (for the R+, the nodes that keep each copy of it,
+  the ids can repeat). A slot keeps the hash of the id (not the id) and one value, the owner of the values verifies the id. Linear
+  probing over a power of two number of slots (load <= 1/2). One byte of state per slot: empty, erased (tombstone) or used + 7 bits
+  of the hash, so most of the probes don't read the slot.*/
+template<typename V>
+class IdIndex {
+public:
+  IdIndex();
+  template<typename Visit>
+  bool find_any(const string &id, Visit visit);
+  void insert(const string &id, V value);
+  bool move(const string &id, V from, V to);
+  bool erase(const string &id, V value);
+  size_t size();
+
+private:
+  struct Slot {
+    size_t hash;
+    V value;
+  };
+
+  vector<Slot> slots;
+  vector<uint8_t> states;//0 -> empty, 1 -> erased, 0x80 | hash bits -> used
+  size_t used, erased;
+
+  static uint8_t tag(size_t hash);
+  size_t locate(size_t hash, V value);
+  void insert_hashed(size_t hash, V value);
+  void rehash(size_t new_capacity);
+};
+
+template<typename V>
+IdIndex<V>::IdIndex() {
+  used = erased = 0;
+}
+
+//Calls visit with each value of the id (and some of another id with the same hash) until it returns true, false if none did
+template<typename V>
+template<typename Visit>
+bool IdIndex<V>::find_any(const string &id, Visit visit) {
+  if (slots.empty())
+    return false;
+  size_t hash = std::hash<string>()(id), mask = slots.size() - 1;
+  uint8_t id_tag = tag(hash);
+  for (size_t i(hash & mask); states[i] != 0; i = (i + 1) & mask) {
+    if (states[i] == id_tag && slots[i].hash == hash && visit(slots[i].value))
+      return true;
+  }
+  return false;
+}
+
+//Adds one value to the id (one per copy of the data)
+template<typename V>
+void IdIndex<V>::insert(const string &id, V value) {
+  insert_hashed(std::hash<string>()(id), value);
+}
+
+//One value of the id changes from "from" to "to", false if the id hasn't that value
+template<typename V>
+bool IdIndex<V>::move(const string &id, V from, V to) {
+  size_t i = locate(std::hash<string>()(id), from);
+  if (i == slots.size())
+    return false;
+  slots[i].value = to;
+  return true;
+}
+
+//Removes one value of the id, false if the id hasn't that value
+template<typename V>
+bool IdIndex<V>::erase(const string &id, V value) {
+  size_t i = locate(std::hash<string>()(id), value);
+  if (i == slots.size())
+    return false;
+  states[i] = 1;
+  --used;
+  ++erased;
+  return true;
+}
+
+template<typename V>
+size_t IdIndex<V>::size() {
+  return used;
+}
+
+template<typename V>
+uint8_t IdIndex<V>::tag(size_t hash) {
+  return uint8_t(0x80 | (hash >> (8 * sizeof(size_t) - 7)));
+}
+
+//Slot with the hash and the value, slots.size() if there isn't one
+template<typename V>
+size_t IdIndex<V>::locate(size_t hash, V value) {
+  if (slots.empty())
+    return 0;
+  size_t mask = slots.size() - 1;
+  uint8_t id_tag = tag(hash);
+  for (size_t i(hash & mask); states[i] != 0; i = (i + 1) & mask) {
+    if (states[i] == id_tag && slots[i].hash == hash && slots[i].value == value)
+      return i;
+  }
+  return slots.size();
+}
+
+template<typename V>
+void IdIndex<V>::insert_hashed(size_t hash, V value) {
+  if (2 * (used + erased + 1) > slots.size())
+    rehash((4 * (used + 1) > slots.size()) ? max(size_t(16), 2 * slots.size()) : slots.size());//grow or only drop the tombstones
+  size_t i(hash & (slots.size() - 1));
+  while (states[i] >= 0x80)
+    i = (i + 1) & (slots.size() - 1);
+  if (states[i] == 1)
+    --erased;
+  slots[i].hash = hash;
+  slots[i].value = value;
+  states[i] = tag(hash);
+  ++used;
+}
+
+template<typename V>
+void IdIndex<V>::rehash(size_t new_capacity) {
+  vector<Slot> old_slots(new_capacity);
+  vector<uint8_t> old_states(new_capacity, 0);
+  old_slots.swap(slots);
+  old_states.swap(states);
+  used = erased = 0;
+  for (size_t i(0); i < old_slots.size(); ++i) {
+    if (old_states[i] >= 0x80)
+      insert_hashed(old_slots[i].hash, old_slots[i].value);
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Columns of the CSV that are read: features (axes and id) and the attributes of the filters, given by the header
+struct CsvLayout {
+  array<bool, T_DIMENSIONS_NUM> features;
+  size_t id_col, year_col, popularity_col, explicit_col;
+};
+
+//CSV header reader : first line of the file | features that were considered | id(name of the song)
+inline CsvLayout parse_csv_header(const string &cols_labels, const vector<string> &features, const string &id) {
+  CsvLayout layout;
+  layout.features.fill(false);
+  layout.id_col = 0;
+  layout.year_col = layout.popularity_col = layout.explicit_col = T_DIMENSIONS_NUM;
   string label;
   istringstream iss_cols_labels(cols_labels);
-  array<bool, T_DIMENSIONS_NUM> table_check_features;
-  table_check_features.fill(false);
-  size_t tcfi(0), id_id(0);
+  size_t tcfi(0);
   while (!iss_cols_labels.eof()) {
     getline(iss_cols_labels, label, csv_delimiter);
+    if (label == "year")
+      layout.year_col = tcfi;
+    else if (label == "popularity")
+      layout.popularity_col = tcfi;
+    else if (label == "explicit")
+      layout.explicit_col = tcfi;
     for (size_t fi(0); fi < features.size(); ++fi) {
-      if (features[fi] == label) {
-        table_check_features[tcfi] = true;
+      if (features[fi] == label && tcfi < T_DIMENSIONS_NUM) {
+        layout.features[tcfi] = true;
         if (label == id)
-          id_id = tcfi;
+          layout.id_col = tcfi;
       }
     }
     ++tcfi;
   }
-  while (getline(data_set_file, row_data_line)) {
-    istringstream iss_cols_data(row_data_line);
-    size_t i(0), ii(0);
-    string data_col_row, songs_name;
-    array<T, KUSED_DIMENSIONS> raw_multidimensional_data;
-    while (!iss_cols_data.eof()) {
-      getline(iss_cols_data, data_col_row, csv_delimiter);
-      if (i < T_DIMENSIONS_NUM && table_check_features[i]) {
-        if (id_id == i)
-          songs_name = data_col_row;
-        else {
-          stringstream ss_raw_datacol(data_col_row);
-          ss_raw_datacol >> raw_multidimensional_data[ii];
-          ++ii;
-        }
+  return layout;
+}
+
+//CSV row reader : one line of the file -> hyperpoint (the features in the order of the columns, the id as name, the attributes)
+template<typename T, size_t N>
+HyperPoint<T, N> parse_csv_row(const string &row_data_line, const CsvLayout &layout) {
+  istringstream iss_cols_data(row_data_line);
+  size_t i(0), ii(0);
+  string data_col_row, songs_name;
+  array<T, N> raw_multidimensional_data;
+  raw_multidimensional_data.fill(T(0));
+  SongAttributes attributes;
+  while (!iss_cols_data.eof()) {
+    getline(iss_cols_data, data_col_row, csv_delimiter);
+    if (i == layout.year_col || i == layout.popularity_col || i == layout.explicit_col) {
+      int attribute_value = 0;
+      stringstream(data_col_row) >> attribute_value;
+      if (i == layout.year_col)
+        attributes.year = int16_t(attribute_value);
+      else if (i == layout.popularity_col)
+        attributes.popularity = uint8_t(attribute_value);
+      else
+        attributes.is_explicit = attribute_value != 0;
+    }
+    if (i < T_DIMENSIONS_NUM && layout.features[i]) {
+      if (layout.id_col == i)
+        songs_name = data_col_row;
+      else if (ii < N) {
+        stringstream ss_raw_datacol(data_col_row);
+        ss_raw_datacol >> raw_multidimensional_data[ii];
+        ++ii;
       }
-      ++i;
     }
-    HyperPoint<T, KUSED_DIMENSIONS> multidimensional_data(raw_multidimensional_data, songs_name);
-    db_container.push_back(multidimensional_data);
+    ++i;
   }
+  HyperPoint<T, N> multidimensional_data(raw_multidimensional_data, songs_name);
+  multidimensional_data.set_attributes(attributes);
+  return multidimensional_data;
+}
+
+//CSV file reader : path of the file | features that were considered | id(name of the song) | container for the data in hypepoints
+template<typename T, size_t N>
+void read_data_from_file(string file_path, vector<string> &features, string id, vector<HyperPoint<T, N>> &db_container) {
+  string cols_labels, row_data_line;
+  ifstream data_set_file(file_path);
+  if (!data_set_file.is_open()) {
+    ALERT("Couldn\'t open the file " + file_path)
+    exit(1);
+  }
+  if (N + 1 < features.size()) {
+    ALERT("The value of N is not enough for the given features.")
+    exit(1);
+  }
+
+  getline(data_set_file, cols_labels);
+  CsvLayout layout = parse_csv_header(cols_labels, features, id);
+  while (getline(data_set_file, row_data_line))
+    db_container.push_back(parse_csv_row<T, N>(row_data_line, layout));
 
   data_set_file.close();
-}
\ No newline at end of file
+}
+
+#endif //SOURCE_RPLUS_UTILS_HPP
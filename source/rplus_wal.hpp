@@ -0,0 +1,523 @@
+#ifndef SOURCE_RPLUS_WAL_HPP
+#define SOURCE_RPLUS_WAL_HPP
+
+#include <RPlusTree.hpp>
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#define WAL_OPEN(path, flags) _open(path, flags | _O_BINARY, _S_IREAD | _S_IWRITE)
+#define WAL_WRITE _write
+#define WAL_CLOSE _close
+#define WAL_SYNC _commit
+#define WAL_TRUNCATE _chsize_s
+#define WAL_APPEND_FLAGS (_O_WRONLY | _O_CREAT | _O_APPEND)
+#define WAL_TRUNC_FLAGS (_O_WRONLY | _O_CREAT | _O_TRUNC)
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#define WAL_OPEN(path, flags) ::open(path, flags, 0644)
+#define WAL_WRITE write
+#define WAL_CLOSE close
+#ifdef __APPLE__
+#define WAL_SYNC fsync//no fdatasync in macOS
+#else
+#define WAL_SYNC fdatasync
+#endif
+#define WAL_TRUNCATE ftruncate
+#define WAL_APPEND_FLAGS (O_WRONLY | O_CREAT | O_APPEND)
+#define WAL_TRUNC_FLAGS (O_WRONLY | O_CREAT | O_TRUNC)
+#endif
+
+#define WAL_CHECKPOINT_INTERVAL 100000//Logged operations between automatic checkpoints (0 -> only checkpoint())
+#define WAL_FORMAT_VERSION 2//Layout of the points in the files: 1 -> coordinates + name, 2 -> coordinates + name + payload (attributes)
+
+#define ERROR_WAL_OPEN "Couldn't open the write-ahead log or the checkpoint of the durable R+ Tree."
+#define ERROR_WAL_WRITE "Couldn't write (or sync) the write-ahead log or the checkpoint of the durable R+ Tree."
+#define ERROR_WAL_CLOSED "The durable R+ Tree must be opened (replay) before using it."
+#define ERROR_WAL_FORMAT "A valid record of the write-ahead log or the checkpoint doesn't match its format version (the files aren't changed)."
+
+/*TEMPLATE PARAMETERS: (1)data type | (2)number of dimensions | (3)max entries per node | (4)fill factor(by default = 2)
+                      | (5)distance policy(by default = L2Metric)
+  Approach: RPlus in memory + append-only write-ahead log (path + ".wal") + checkpoint (path + ".ckpt"). Each insert, erase and
+            update is applied to the tree and appended to the log buffer, then the caller waits until its record is on disk.
+  Group commit: the first waiting writer writes the whole buffer (the records of every thread that arrived meanwhile) with one
+                fdatasync, so many operations share one sync and the cost is close to a memory insert + sequential I/O.
+  Checkpoint: every data of the tree is written to a new checkpoint file (atomic rename) and the log is truncated.
+  Replay(open): checkpoint + log. A record is [length | checksum | operation | payload], a torn record at the end of the log
+                (crash in the middle of a write) is dropped. Each file starts with a generation record that has the format version
+                of its points (WAL_FORMAT_VERSION), older versions are still read and a log in an older version is rewritten by a
+                checkpoint on open. A record with a valid checksum that can't be decoded stops the open, nothing is truncated.*/
+template<typename T, size_t N, size_t M, size_t ff = 2, typename Metric = L2Metric>
+class DurableRPlus {
+private:
+  enum Operation : uint8_t { WAL_INSERT = 1, WAL_ERASE = 2, WAL_UPDATE = 3, WAL_GENERATION = 4 };
+
+  RPlus<T, N, M, ff, Metric> tree;
+  string log_path, checkpoint_path;
+  int log_file;
+  size_t checkpoint_interval, logged_since_checkpoint, replayed;
+  uint64_t generation;//of the last checkpoint, the log starts with the generation of the checkpoint it follows
+  uint32_t format;//format version of the file being replayed (and of the log after open)
+
+  mutex lock;//tree + log buffer + sequence numbers
+  condition_variable committed;
+  string log_buffer;
+  uint64_t next_sequence, durable_sequence;
+  bool writing;//a leader is writing the log (or a checkpoint)
+
+  void log_and_wait(string &record);
+  void commit(unique_lock<mutex> &guard, uint64_t sequence);
+  void write_checkpoint(unique_lock<mutex> &guard);
+  static void encode_point(string &record, HyperPoint<T, N> &point);
+  static bool decode_point(const string &payload, size_t &offset, HyperPoint<T, N> &point, uint32_t version);
+  static string make_record(Operation operation, const string &payload);
+  static string make_generation_record(uint64_t checkpoint_generation);
+  static uint32_t checksum(const char *bytes, size_t length);
+  size_t replay_file(const string &path, bool is_log);
+  static void write_all(int file, const string &bytes);
+  static void sync_directory(const string &path);
+
+public:
+  DurableRPlus(const string &path, size_t checkpoint_every = WAL_CHECKPOINT_INTERVAL);
+  virtual ~DurableRPlus();
+  RPlus<T, N, M, ff, Metric>& get_tree();
+  void open();
+  size_t get_replayed();
+  void insert(HyperPoint<T, N> data);
+  void assign(vector<HyperPoint<T, N>> &unpacked_data);
+  bool erase(HyperPoint<T, N> data);
+  bool update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data);
+  void checkpoint();
+  vector<HyperPoint<T, N>> search(const HyperRectangle<T, N> &W);
+  vector<HyperPoint<T, N>> kNN_query(HyperPoint<T, N> refdata, size_t k);
+};
+
+//===============================DURABLE-R-PLUS-IMPLEMENTATION=========================================
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+DurableRPlus<T, N, M, ff, Metric>::DurableRPlus(const string &path, size_t checkpoint_every) {
+  log_path = path + ".wal";
+  checkpoint_path = path + ".ckpt";
+  log_file = -1;
+  checkpoint_interval = checkpoint_every;
+  logged_since_checkpoint = replayed = 0;
+  next_sequence = durable_sequence = 0;
+  generation = 0;
+  format = WAL_FORMAT_VERSION;
+  writing = false;
+}
+
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+DurableRPlus<T, N, M, ff, Metric>::~DurableRPlus() {
+  if (log_file >= 0)
+    WAL_CLOSE(log_file);
+}
+
+//The tree in memory (set its normalization or insertion buffer before open, don't write to it directly: those changes aren't logged)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+RPlus<T, N, M, ff, Metric>& DurableRPlus<T, N, M, ff, Metric>::get_tree() {
+  return tree;
+}
+
+//OPEN METHOD: Replays the checkpoint and the log (recovery after a crash or a normal restart) and opens the log to append.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void DurableRPlus<T, N, M, ff, Metric>::open() {
+  try {
+    replay_file(checkpoint_path, false);
+    size_t log_size = replay_file(log_path, true);
+    log_file = WAL_OPEN(log_path.c_str(), WAL_APPEND_FLAGS);
+    if (log_file < 0) {
+      throw runtime_error(ERROR_WAL_OPEN);
+    }
+    if (log_size == 0) {
+      write_all(log_file, make_generation_record(generation));
+      if (WAL_SYNC(log_file) != 0)
+        throw runtime_error(ERROR_WAL_WRITE);
+    }
+    else if (format != WAL_FORMAT_VERSION) {
+      unique_lock<mutex> guard(lock);
+      write_checkpoint(guard);//the new records can't follow the old ones, the data goes to a checkpoint in the current format
+    }
+    format = WAL_FORMAT_VERSION;
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+//Number of operations recovered by open
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+size_t DurableRPlus<T, N, M, ff, Metric>::get_replayed() {
+  return replayed;
+}
+
+//INSERT METHOD: Durable insertion of one data, returns when its record is on disk.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void DurableRPlus<T, N, M, ff, Metric>::insert(HyperPoint<T, N> data) {
+  vector<HyperPoint<T, N>> single(1, data);
+  assign(single);
+}
+
+//ASSIGN METHOD: Durable insertion of many data, all of them share one group commit.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void DurableRPlus<T, N, M, ff, Metric>::assign(vector<HyperPoint<T, N>> &unpacked_data) {
+  string records;
+  for (HyperPoint<T, N> &hp : unpacked_data) {
+    string payload;
+    encode_point(payload, hp);
+    records += make_record(WAL_INSERT, payload);
+  }
+  log_and_wait(records);
+}
+
+//ERASE METHOD: Durable erase, only logged if the data was in the R+.
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool DurableRPlus<T, N, M, ff, Metric>::erase(HyperPoint<T, N> data) {
+  string payload;
+  encode_point(payload, data);
+  string record = make_record(WAL_ERASE, payload);
+  log_and_wait(record);
+  return !record.empty();
+}
+
+//UPDATE METHOD: Durable update (erase + insert in one record, so the replay never sees only a half of it).
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool DurableRPlus<T, N, M, ff, Metric>::update(HyperPoint<T, N> old_data, HyperPoint<T, N> new_data) {
+  string payload;
+  encode_point(payload, old_data);
+  encode_point(payload, new_data);
+  string record = make_record(WAL_UPDATE, payload);
+  log_and_wait(record);
+  return !record.empty();
+}
+
+//CHECKPOINT METHOD: Writes every data of the tree to a new checkpoint and truncates the log (shorter replay on the next open).
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void DurableRPlus<T, N, M, ff, Metric>::checkpoint() {
+  unique_lock<mutex> guard(lock);
+  write_checkpoint(guard);
+}
+
+//RANGE QUERY METHOD: search of the tree, waits for the writers that are changing it (not for their disk writes)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> DurableRPlus<T, N, M, ff, Metric>::search(const HyperRectangle<T, N> &W) {
+  lock_guard<mutex> guard(lock);
+  return tree.search(W);
+}
+
+//KNN METHOD: kNN_query of the tree, waits for the writers that are changing it (not for their disk writes)
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+vector<HyperPoint<T, N>> DurableRPlus<T, N, M, ff, Metric>::kNN_query(HyperPoint<T, N> refdata, size_t k) {
+  lock_guard<mutex> guard(lock);
+  return tree.kNN_query(refdata, k);
+}
+
+/*--LOG AND WAIT: applies the records to the tree and appends them to the log buffer (both under the lock, so the order in the log is
+                  the order in the tree), then commits. A record with no effect (erase of a missing data) is cleared, not logged--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void DurableRPlus<T, N, M, ff, Metric>::log_and_wait(string &records) {
+  try {
+    if (log_file < 0) {
+      throw runtime_error(ERROR_WAL_CLOSED);
+    }
+    else {
+      unique_lock<mutex> guard(lock);
+      size_t offset(0), applied(0);
+      string effective;
+      while (offset < records.size()) {
+        uint32_t length;
+        memcpy(&length, records.data() + offset, sizeof(uint32_t));
+        size_t record_size = 2 * sizeof(uint32_t) + length;
+        Operation operation = Operation(records[offset + 2 * sizeof(uint32_t)]);
+        string payload = records.substr(offset + 2 * sizeof(uint32_t) + 1, length - 1);
+        size_t payload_offset(0);
+        HyperPoint<T, N> point, new_point;
+        decode_point(payload, payload_offset, point, WAL_FORMAT_VERSION);
+        bool changed = true;
+        if (operation == WAL_INSERT) {
+          vector<HyperPoint<T, N>> single(1, point);
+          tree.assign(single);
+        }
+        else if (operation == WAL_ERASE)
+          changed = tree.erase(point);
+        else {
+          decode_point(payload, payload_offset, new_point, WAL_FORMAT_VERSION);
+          changed = tree.update(point, new_point);
+        }
+        if (changed) {
+          effective.append(records, offset, record_size);
+          ++applied;
+        }
+        offset += record_size;
+      }
+      records.swap(effective);
+      if (applied == 0)
+        return;
+      log_buffer += records;
+      logged_since_checkpoint += applied;
+      commit(guard, ++next_sequence);
+      if (checkpoint_interval > 0 && logged_since_checkpoint >= checkpoint_interval)
+        write_checkpoint(guard);
+    }
+  }
+  catch (const exception &error) {
+    ALERT(error.what())
+      exit(1);
+  }
+}
+
+/*--COMMIT: group commit. If nobody is writing, this writer becomes the leader: it takes the whole buffer (its records and the ones of
+            the writers that arrived before), writes it and syncs once without the lock, so new writers keep filling the buffer for
+            the next group. Otherwise it waits until a leader makes its sequence durable (or the leader finishes and it can lead)--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void DurableRPlus<T, N, M, ff, Metric>::commit(unique_lock<mutex> &guard, uint64_t sequence) {
+  while (durable_sequence < sequence) {
+    if (writing) {
+      committed.wait(guard);
+      continue;
+    }
+    writing = true;
+    string group;
+    group.swap(log_buffer);
+    uint64_t group_last = next_sequence;
+    guard.unlock();
+    write_all(log_file, group);
+    if (WAL_SYNC(log_file) != 0) {
+      ALERT(ERROR_WAL_WRITE)
+        exit(1);
+    }
+    guard.lock();
+    durable_sequence = max(durable_sequence, group_last);
+    writing = false;
+    committed.notify_all();
+  }
+}
+
+/*--WRITE CHECKPOINT: the lock is held while the data is copied (the copy is exactly the log up to next_sequence), the file is written
+                      without the lock. The records still in the buffer are inside the copy, so they're dropped, not logged.
+                      Crash after the rename and before the truncation -> the old log has an older generation, replay skips it--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void DurableRPlus<T, N, M, ff, Metric>::write_checkpoint(unique_lock<mutex> &guard) {
+  while (writing)
+    committed.wait(guard);
+  writing = true;
+  vector<HyperPoint<T, N>> all_data = tree.get_all_data();
+  uint64_t snapshot_last = next_sequence, new_generation = generation + 1;
+  log_buffer.clear();
+  logged_since_checkpoint = 0;
+  guard.unlock();
+  string records = make_generation_record(new_generation);
+  for (HyperPoint<T, N> &hp : all_data) {
+    string payload;
+    encode_point(payload, hp);
+    records += make_record(WAL_INSERT, payload);
+  }
+  string temporal_path = checkpoint_path + ".tmp";
+  int checkpoint_file = WAL_OPEN(temporal_path.c_str(), WAL_TRUNC_FLAGS);
+  if (checkpoint_file < 0) {
+    ALERT(ERROR_WAL_OPEN)
+      exit(1);
+  }
+  write_all(checkpoint_file, records);
+  if (WAL_SYNC(checkpoint_file) != 0) {
+    ALERT(ERROR_WAL_WRITE)
+      exit(1);
+  }
+  WAL_CLOSE(checkpoint_file);
+#ifdef _WIN32
+  remove(checkpoint_path.c_str());//rename doesn't replace in Windows
+#endif
+  if (rename(temporal_path.c_str(), checkpoint_path.c_str()) != 0) {
+    ALERT(ERROR_WAL_WRITE)
+      exit(1);
+  }
+  sync_directory(checkpoint_path);
+  if (WAL_TRUNCATE(log_file, 0) != 0) {
+    ALERT(ERROR_WAL_WRITE)
+      exit(1);
+  }
+  write_all(log_file, make_generation_record(new_generation));
+  if (WAL_SYNC(log_file) != 0) {
+    ALERT(ERROR_WAL_WRITE)
+      exit(1);
+  }
+  guard.lock();
+  generation = new_generation;
+  durable_sequence = max(durable_sequence, snapshot_last);
+  writing = false;
+  committed.notify_all();
+}
+
+//--ENCODE POINT: raw coordinates + length of the name + name + payload (format WAL_FORMAT_VERSION)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void DurableRPlus<T, N, M, ff, Metric>::encode_point(string &record, HyperPoint<T, N> &point) {
+  for (size_t i(0); i < N; ++i) {
+    T value = point[i];
+    record.append(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+  string name = point.get_songs_name();
+  uint32_t name_length = uint32_t(name.size());
+  record.append(reinterpret_cast<const char *>(&name_length), sizeof(uint32_t));
+  record += name;
+  point.get_attributes().encode(record);
+}
+
+//--DECODE POINT: a point written in the given format version (version 1 has no payload, the point keeps the default one)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+bool DurableRPlus<T, N, M, ff, Metric>::decode_point(const string &payload, size_t &offset, HyperPoint<T, N> &point, uint32_t version) {
+  if (offset + N * sizeof(T) + sizeof(uint32_t) > payload.size())
+    return false;
+  array<T, N> data;
+  for (size_t i(0); i < N; ++i, offset += sizeof(T))
+    memcpy(&data[i], payload.data() + offset, sizeof(T));
+  uint32_t name_length;
+  memcpy(&name_length, payload.data() + offset, sizeof(uint32_t));
+  offset += sizeof(uint32_t);
+  if (offset + name_length > payload.size())
+    return false;
+  point = HyperPoint<T, N>(data, payload.substr(offset, name_length));
+  offset += name_length;
+  if (version == 1)
+    return true;
+  typename HyperPoint<T, N>::payload_type attributes;
+  if (!attributes.decode(payload, offset))
+    return false;
+  point.set_attributes(attributes);
+  return true;
+}
+
+//--MAKE RECORD: [length of operation + payload | checksum of operation + payload | operation | payload]--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+string DurableRPlus<T, N, M, ff, Metric>::make_record(Operation operation, const string &payload) {
+  string body(1, char(operation));
+  body += payload;
+  uint32_t length = uint32_t(body.size()), sum = checksum(body.data(), body.size());
+  string record(reinterpret_cast<const char *>(&length), sizeof(uint32_t));
+  record.append(reinterpret_cast<const char *>(&sum), sizeof(uint32_t));
+  return record + body;
+}
+
+//--MAKE GENERATION RECORD: first record of a checkpoint and of the log that follows it, [generation | format version]--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+string DurableRPlus<T, N, M, ff, Metric>::make_generation_record(uint64_t checkpoint_generation) {
+  uint32_t version = WAL_FORMAT_VERSION;
+  string payload(reinterpret_cast<const char *>(&checkpoint_generation), sizeof(uint64_t));
+  payload.append(reinterpret_cast<const char *>(&version), sizeof(uint32_t));
+  return make_record(WAL_GENERATION, payload);
+}
+
+//--CHECKSUM: FNV-1a (32 bits)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+uint32_t DurableRPlus<T, N, M, ff, Metric>::checksum(const char *bytes, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i(0); i < length; ++i) {
+    hash ^= uint8_t(bytes[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/*--REPLAY FILE: applies every complete and valid record of a file to the tree (not logged again), a missing file is an empty one.
+                 A log older than the checkpoint was already inside it and is dropped. Only a torn tail is truncated: a record with
+                 a valid checksum that doesn't decode exactly (unknown version, other layout) throws. Returns the size of the valid part--*/
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+size_t DurableRPlus<T, N, M, ff, Metric>::replay_file(const string &path, bool is_log) {
+  ifstream file(path, ios::binary);
+  if (!file.is_open())
+    return 0;
+  string bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+  file.close();
+  size_t offset(0);
+  format = 1;//a generation record without version (files written before the versions)
+  vector<HyperPoint<T, N>> inserts;//consecutive inserts go to the tree in one assign
+  while (offset + 2 * sizeof(uint32_t) < bytes.size()) {
+    uint32_t length, sum;
+    memcpy(&length, bytes.data() + offset, sizeof(uint32_t));
+    memcpy(&sum, bytes.data() + offset + sizeof(uint32_t), sizeof(uint32_t));
+    size_t body = offset + 2 * sizeof(uint32_t);
+    if (length == 0 || body + length > bytes.size() || checksum(bytes.data() + body, length) != sum)
+      break;//torn record, nothing after it was acknowledged
+    Operation operation = Operation(bytes[body]);
+    string payload = bytes.substr(body + 1, length - 1);
+    if (operation == WAL_GENERATION) {
+      uint64_t file_generation(0);
+      memcpy(&file_generation, payload.data(), min(payload.size(), sizeof(uint64_t)));
+      if (is_log && file_generation < generation)
+        break;//stale log (crash between the checkpoint and the truncation)
+      format = 1;
+      if (payload.size() >= sizeof(uint64_t) + sizeof(uint32_t))
+        memcpy(&format, payload.data() + sizeof(uint64_t), sizeof(uint32_t));
+      if (format == 0 || format > WAL_FORMAT_VERSION)
+        throw runtime_error(ERROR_WAL_FORMAT);
+      generation = file_generation;
+      offset = body + length;
+      continue;
+    }
+    size_t payload_offset(0);
+    HyperPoint<T, N> point, new_point;
+    bool decoded = decode_point(payload, payload_offset, point, format);
+    if (operation == WAL_UPDATE)
+      decoded = decoded && decode_point(payload, payload_offset, new_point, format);
+    if (!decoded || payload_offset != payload.size() || operation < WAL_INSERT || operation > WAL_UPDATE)
+      throw runtime_error(ERROR_WAL_FORMAT);
+    if (operation != WAL_INSERT && !inserts.empty()) {
+      tree.assign(inserts);
+      inserts.clear();
+    }
+    if (operation == WAL_INSERT)
+      inserts.push_back(point);
+    else if (operation == WAL_ERASE)
+      tree.erase(point);
+    else
+      tree.update(point, new_point);
+    ++replayed;
+    offset = body + length;
+  }
+  tree.assign(inserts);
+  if (is_log && offset < bytes.size()) {
+    int torn_file = WAL_OPEN(path.c_str(), WAL_APPEND_FLAGS);
+    if (torn_file < 0 || WAL_TRUNCATE(torn_file, offset) != 0 || WAL_SYNC(torn_file) != 0) {
+      ALERT(ERROR_WAL_WRITE)
+        exit(1);
+    }
+    WAL_CLOSE(torn_file);
+  }
+  return offset;
+}
+
+//--WRITE ALL: write until every byte is in the file (write can be partial)--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void DurableRPlus<T, N, M, ff, Metric>::write_all(int file, const string &bytes) {
+  size_t written(0);
+  while (written < bytes.size()) {
+    auto step = WAL_WRITE(file, bytes.data() + written, (unsigned int)(bytes.size() - written));
+    if (step <= 0) {
+      ALERT(ERROR_WAL_WRITE)
+        exit(1);
+    }
+    written += size_t(step);
+  }
+}
+
+//--SYNC DIRECTORY: makes the rename of a file durable (POSIX), Windows has no directory handles for this--
+template<typename T, size_t N, size_t M, size_t ff, typename Metric>
+void DurableRPlus<T, N, M, ff, Metric>::sync_directory(const string &path) {
+#ifndef _WIN32
+  size_t slash = path.find_last_of('/');
+  string directory = (slash == string::npos) ? string(".") : path.substr(0, max(slash, size_t(1)));
+  int directory_file = ::open(directory.c_str(), O_RDONLY);
+  if (directory_file >= 0) {
+    fsync(directory_file);
+    WAL_CLOSE(directory_file);
+  }
+#endif // _WIN32
+}
+
+#endif //SOURCE_RPLUS_WAL_HPP
@@ -0,0 +1,84 @@
+#ifndef TESTS_RPLUS_TEST_HPP
+#define TESTS_RPLUS_TEST_HPP
+
+#include <RPlusTree.hpp>
+
+#include <random>
+#include <map>
+#include <set>
+
+//Checks of the tests: a failed check is reported and the test keeps going, main returns TEST_RESULT() (ctest needs exit code != 0)
+static size_t test_failures = 0;
+
+#define CHECK(condition) do { if (!(condition)) { ++test_failures; cerr << "[FAILED] " << __FILE__ << ":" << __LINE__ << " : " << #condition << endl; } } while (0)
+#define TEST_RESULT() ((test_failures == 0) ? 0 : 1)
+
+//Uniform data in [0, side)^N with ids "0", "1", ... (grid > 0 -> coordinates rounded to a grid of that step, many ties)
+template<size_t N>
+vector<HyperPoint<double, N>> random_points(size_t n, unsigned seed, double side = 100.0, double grid = 0.0) {
+  mt19937 generator(seed);
+  uniform_real_distribution<double> coordinate(0.0, side);
+  vector<HyperPoint<double, N>> points;
+  for (size_t i(0); i < n; ++i) {
+    array<double, N> raw;
+    for (double &value : raw) {
+      value = coordinate(generator);
+      if (grid > 0.0)
+        value = floor(value / grid) * grid;
+    }
+    HyperPoint<double, N> point(raw, to_string(i));
+    point.set_attributes(SongAttributes(int16_t(1950 + i % 70), uint8_t(i % 100), i % 3 == 0));
+    points.push_back(point);
+  }
+  return points;
+}
+
+template<size_t N>
+HyperRectangle<double, N> random_window(mt19937 &generator, double side, double width) {
+  uniform_real_distribution<double> coordinate(0.0, side - width);
+  array<double, N> low, high;
+  for (size_t i(0); i < N; ++i) {
+    low[i] = coordinate(generator);
+    high[i] = low[i] + width;
+  }
+  HyperPoint<double, N> A(low), B(high);
+  return HyperRectangle<double, N>(A, B);
+}
+
+//Ids of a result (a multiset, so a repeated answer is an error too)
+template<size_t N>
+multiset<string> ids_of(vector<HyperPoint<double, N>> result) {
+  multiset<string> ids;
+  for (HyperPoint<double, N> &point : result)
+    ids.insert(point.get_songs_name());
+  return ids;
+}
+
+template<size_t N>
+multiset<string> brute_range(vector<HyperPoint<double, N>> &data, const HyperRectangle<double, N> &W) {
+  multiset<string> ids;
+  for (HyperPoint<double, N> &point : data) {
+    if (W.contains(point))
+      ids.insert(point.get_songs_name());
+  }
+  return ids;
+}
+
+//The distances of a kNN answer are the k smallest ones of the data (ties may give other ids)
+template<size_t N, typename Metric = L2Metric>
+bool same_kNN(vector<HyperPoint<double, N>> &data, const HyperPoint<double, N> &refdata, size_t k, vector<HyperPoint<double, N>> result) {
+  vector<double> distances;
+  for (HyperPoint<double, N> &point : data)
+    distances.push_back(Metric::DIST(point, refdata));
+  sort(distances.begin(), distances.end());
+  distances.resize(min(k, distances.size()));
+  if (result.size() != distances.size())
+    return false;
+  for (size_t i(0); i < result.size(); ++i) {
+    if (fabs(Metric::DIST(result[i], refdata) - distances[i]) > 1e-9)
+      return false;
+  }
+  return true;
+}
+
+#endif //TESTS_RPLUS_TEST_HPP
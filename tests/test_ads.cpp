@@ -0,0 +1,65 @@
+#include "RPlus.hpp"
+
+#include <random>
+
+//ads::RPlusTree (inline nodes): node sizes for byte budgets and kNN against brute force
+
+static size_t test_failures = 0;
+
+#define CHECK(condition) do { if (!(condition)) { ++test_failures; std::cerr << "[FAILED] " << __FILE__ << ":" << __LINE__ << " : " << #condition << std::endl; } } while (0)
+
+struct Place : public KDRecord<KDPoint<3>> {
+  KDPoint<3> where_;
+  std::size_t id_;
+
+  KDPoint<3> operator()() {
+    return where_;
+  }
+};
+
+static_assert(ads::node_size_for_bytes<14>(4096) >= 2, "a page holds a node");
+static_assert(ads::node_size_for_bytes<3, float>(1024) >= ads::node_size_for_bytes<3, double>(1024), "narrower coordinates, more entries");
+
+double squared_distance(const KDPoint<3>& A, const KDPoint<3>& B) {
+  double sum = 0.0;
+  for (std::size_t idx(0); idx < 3; ++idx)
+    sum += (A[idx] - B[idx]) * (A[idx] - B[idx]);
+  return sum;
+}
+
+int main() {
+  bool rejected = false;
+  try {
+    ads::node_size_for_bytes<14>(256);//a budget smaller than 3 entries (was an underflow)
+  }
+  catch (const std::invalid_argument&) {
+    rejected = true;
+  }
+  CHECK(rejected);
+  std::mt19937 generator(3);
+  std::uniform_real_distribution<double> coordinate(0.0, 100.0);
+  std::vector<Place> places(2000);
+  for (std::size_t i(0); i < places.size(); ++i) {
+    for (std::size_t idx(0); idx < 3; ++idx)
+      places[i].where_[idx] = coordinate(generator);
+    places[i].id_ = i;
+  }
+  ads::RPlusTree<8, 2, Place> tree;
+  tree.assign(places);
+  for (std::size_t q(0); q < 50; ++q) {
+    KDPoint<3> center;
+    for (std::size_t idx(0); idx < 3; ++idx)
+      center[idx] = coordinate(generator);
+    std::vector<double> expected;
+    for (Place& place : places)
+      expected.push_back(squared_distance(place.where_, center));
+    std::sort(expected.begin(), expected.end());
+    std::vector<Place> nearest = tree.knn_query(10, center);
+    CHECK(nearest.size() == 10);
+    for (std::size_t i(0); i < nearest.size() && i < 10; ++i)
+      CHECK(std::abs(squared_distance(nearest[i].where_, center) - expected[i]) < 1e-9);
+  }
+  CHECK(tree.knn_query(0, KDPoint<3>()).empty());
+  CHECK(tree.knn_query(5000, KDPoint<3>()).size() == places.size());
+  return (test_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,396 @@
+#include <rplus_test.hpp>
+
+//1x1 insertion (splits, sibling redistribution, new roots) against brute force: range, kNN, id lookups, erase and update
+
+const size_t D = 4;
+typedef HyperPoint<double, D> Point;
+
+template<size_t M>
+void check_queries(RPlus<double, D, M> &tree, vector<Point> &data, unsigned seed) {
+  mt19937 generator(seed);
+  for (size_t q(0); q < 100; ++q) {
+    HyperRectangle<double, D> W = random_window<D>(generator, 100.0, 20.0);
+    multiset<string> expected = brute_range(data, W);
+    CHECK(ids_of(tree.search(W)) == expected);
+    CHECK(ids_of(tree.parallel_search(W, 2)) == expected);
+    Point refdata = W.get_bottom_left();
+    CHECK(same_kNN(data, refdata, 10, tree.kNN_query(refdata, 10)));
+    KNNReport report;
+    CHECK(same_kNN(data, refdata, 10, tree.approximate_kNN_query(refdata, 10, KNNBudget(), report)) && report.exact);
+    CHECK(tree.approximate_kNN_query(refdata, 0, KNNBudget(0.5, 1), report).empty() && report.exact);
+    vector<Point> browsed;
+    double last_distance = 0.0;
+    bool increasing = true;
+    tree.incremental_kNN(refdata, [&](const Point &point, double distance) {
+      increasing = increasing && distance >= last_distance;
+      last_distance = distance;
+      browsed.push_back(point);
+      return browsed.size() < 25;
+    });
+    CHECK(increasing && same_kNN(data, refdata, 25, browsed));
+  }
+  vector<HyperRectangle<double, D>> windows;
+  for (size_t q(0); q < 20; ++q)
+    windows.push_back(random_window<D>(generator, 100.0, 30.0));
+  vector<vector<Point>> answers = tree.batch_search(windows);
+  for (size_t q(0); q < windows.size(); ++q)
+    CHECK(ids_of(answers[q]) == brute_range(data, windows[q]));
+  for (Point &point : data) {
+    Point found;
+    CHECK(tree.get_by_id(point.get_songs_name(), found));
+  }
+  CHECK(tree.get_all_data().size() == data.size());
+  FrozenRPlus<double, D, L2Metric> full = tree.freeze();
+  for (size_t bits : { 0, 8, 16 }) {
+    FrozenRPlus<double, D, L2Metric> frozen = tree.freeze(bits, bits);
+    CHECK(frozen.get_size() == data.size() && frozen.get_height() <= full.get_height());
+    CHECK(bits == 0 || (frozen.get_child_bound_bytes() < full.get_child_bound_bytes() && frozen.get_total_bytes() < full.get_total_bytes()));
+    CHECK(bits == 0 || M > 8 || frozen.get_height() < full.get_height());//few children per node -> the levels are packed
+    for (size_t q(0); q < 20; ++q) {
+      HyperRectangle<double, D> W = random_window<D>(generator, 100.0, 20.0);
+      CHECK(ids_of(frozen.search(W)) == brute_range(data, W));
+      Point refdata = W.get_top_right();
+      CHECK(same_kNN(data, refdata, 10, frozen.kNN_query(refdata, 10)));
+      CHECK(frozen.kNN_query(refdata, 0).empty());
+    }
+  }
+}
+
+template<size_t M>
+void test_insertion(size_t n, double grid) {
+  vector<Point> data = random_points<D>(n, 7, 100.0, grid);
+  RPlus<double, D, M> tree;
+  tree.assign(data);
+  check_queries(tree, data, 11);
+  //erase a third and move another third
+  vector<Point> kept;
+  for (size_t i(0); i < data.size(); ++i) {
+    if (i % 3 == 0) {
+      CHECK(tree.erase(data[i]));
+    }
+    else if (i % 3 == 1) {
+      Point moved = data[i];
+      moved[0] = 100.0 - moved[0];
+      CHECK(tree.update(data[i], moved));
+      kept.push_back(moved);
+    }
+    else
+      kept.push_back(data[i]);
+  }
+  CHECK(!tree.erase(data[0]));
+  check_queries(tree, kept, 13);
+}
+
+//Buffered insertion: same answers with data still in the buffers and after the flush (the times are only reported)
+template<size_t M>
+void test_buffered(size_t n, size_t capacity) {
+  vector<Point> data = random_points<D>(n, 9);
+  chrono::time_point<chrono::steady_clock> start = chrono::steady_clock::now();
+  {
+    RPlus<double, D, M> plain_tree;
+    plain_tree.assign(data);
+  }
+  double plain_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  start = chrono::steady_clock::now();
+  RPlus<double, D, M> tree;
+  tree.set_insertion_buffer(capacity);
+  tree.assign(data);
+  tree.flush_insertion_buffers();
+  double buffered_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  cout << "M = " << M << ", n = " << n << ", buffer = " << capacity << " : 1x1 " << plain_ms << " ms, buffered " << buffered_ms << " ms" << endl;
+  check_queries(tree, data, 17);
+  vector<Point> more = random_points<D>(n / 10, 21);
+  for (Point &point : more)
+    point = Point(array<double, D>{ point[0], point[1], point[2], point[3] }, "more" + point.get_songs_name());
+  tree.assign(more);//part of it stays in the buffers
+  data.insert(data.end(), more.begin(), more.end());
+  check_queries(tree, data, 19);
+}
+
+//Joins, all kNN graph and freeze with data still in the insertion buffers (they read the buffers, they don't push them down)
+vector<double> nearest_distances(vector<Point> &data, size_t self, size_t k) {
+  vector<double> distances;
+  for (size_t j(0); j < data.size(); ++j) {
+    if (j != self)
+      distances.push_back(L2Metric::DIST(data[self], data[j]));
+  }
+  sort(distances.begin(), distances.end());
+  distances.resize(min(k, distances.size()));
+  return distances;
+}
+
+bool same_distances(vector<double> found, vector<double> &expected, double tolerance) {
+  sort(found.begin(), found.end());
+  if (found.size() != expected.size())
+    return false;
+  for (size_t i(0); i < found.size(); ++i) {
+    if (fabs(found[i] - expected[i]) > tolerance)
+      return false;
+  }
+  return true;
+}
+
+void test_buffered_joins() {
+  vector<Point> data = random_points<D>(3000, 35), others = random_points<D>(1000, 37);
+  for (Point &point : others)
+    point = Point(array<double, D>{ point[0], point[1], point[2], point[3] }, "other" + point.get_songs_name());
+  RPlus<double, D, 16> tree, other_tree;
+  tree.set_insertion_buffer(256);
+  tree.assign(data);
+  other_tree.assign(others);
+  const double epsilon = 6.0;
+  set<pair<string, string>> expected_self, expected_other;
+  for (size_t i(0); i < data.size(); ++i) {
+    for (size_t j(i + 1); j < data.size(); ++j) {
+      if (L2Metric::DIST(data[i], data[j]) <= epsilon)
+        expected_self.insert(minmax(data[i].get_songs_name(), data[j].get_songs_name()));
+    }
+    for (Point &point : others) {
+      if (L2Metric::DIST(data[i], point) <= epsilon)
+        expected_other.insert(make_pair(data[i].get_songs_name(), point.get_songs_name()));
+    }
+  }
+  set<pair<string, string>> found_self, found_other, found_reversed;
+  size_t self_pairs = 0;
+  tree.similarity_join(tree, epsilon, [&](const string &A, const string &B, double) { found_self.insert(minmax(A, B)); ++self_pairs; }, 2);
+  CHECK(found_self == expected_self && self_pairs == expected_self.size());
+  tree.similarity_join(other_tree, epsilon, [&](const string &A, const string &B, double) { found_other.insert(make_pair(A, B)); }, 2);
+  other_tree.similarity_join(tree, epsilon, [&](const string &A, const string &B, double) { found_reversed.insert(make_pair(B, A)); }, 2);
+  CHECK(found_other == expected_other && found_reversed == expected_other);
+  map<string, vector<double>> joined;
+  tree.kNN_join(tree, 3, [&](const string &A, const string &, double distance) { joined[A].push_back(distance); }, 2);
+  KNNGraph graph = tree.all_kNN_graph(3, 2);
+  CHECK(joined.size() == data.size() && graph.ids.size() == data.size());
+  for (size_t g(0); g < graph.ids.size(); ++g) {
+    size_t i = stoul(graph.ids[g]);
+    vector<double> expected = nearest_distances(data, i, 3);
+    CHECK(same_distances(joined[graph.ids[g]], expected, 1e-9));
+    vector<double> graph_distances(graph.distances.begin() + graph.offsets[g], graph.distances.begin() + graph.offsets[g + 1]);
+    CHECK(same_distances(graph_distances, expected, 1e-4));
+  }
+  check_queries(tree, data, 39);
+}
+
+//Repeated ids: each copy is found and erased by the index, whatever node the other copies are in
+template<size_t M>
+void test_repeated_ids(size_t capacity) {
+  vector<Point> data = random_points<D>(2000, 27);
+  vector<Point> copies;
+  for (size_t c(0); c < 3; ++c) {
+    vector<Point> moved = random_points<D>(100, 29 + unsigned(c));
+    for (size_t i(0); i < moved.size(); ++i)
+      copies.push_back(Point(array<double, D>{ moved[i][0], moved[i][1], moved[i][2], moved[i][3] }, data[i].get_songs_name()));
+  }
+  RPlus<double, D, M> tree;
+  tree.set_insertion_buffer(capacity);
+  tree.assign(data);
+  tree.assign(copies);//part of them stays in the buffers
+  data.insert(data.end(), copies.begin(), copies.end());
+  check_queries(tree, data, 31);
+  //the copies leave in the order they were given: the first one (the original) goes first
+  vector<Point> kept;
+  for (size_t i(0); i < data.size(); ++i) {
+    if (i < 100 || i >= 2000) {
+      Point found;
+      CHECK(tree.get_by_id(data[i].get_songs_name(), found));
+      CHECK(tree.erase(data[i]));
+      CHECK(!tree.erase(data[i]));
+      CHECK(tree.get_by_id(data[i].get_songs_name(), found) == (i < 2000 + 2 * 100));
+    }
+    else
+      kept.push_back(data[i]);
+  }
+  check_queries(tree, kept, 33);
+}
+
+//Filtered queries: the predicate pushed down into the tree (summaries of the nodes) gives the brute force answer over the matching data
+vector<AttributePredicate> test_predicates() {
+  vector<AttributePredicate> predicates(4);
+  predicates[0].min_year = 1990;
+  predicates[0].max_year = 2005;
+  predicates[1].explicit_filter = AttributePredicate::ONLY_CLEAN;
+  predicates[1].min_popularity = 41;
+  predicates[2].explicit_filter = AttributePredicate::ONLY_EXPLICIT;
+  predicates[2].min_year = 2015;
+  predicates[2].max_popularity = 30;
+  predicates[3].min_year = 2100;//nothing matches
+  return predicates;
+}
+
+bool all_match(vector<Point> result, const AttributePredicate &predicate) {
+  for (Point &point : result) {
+    if (!predicate.matches(point.get_attributes()))
+      return false;
+  }
+  return true;
+}
+
+template<size_t M>
+void check_filtered(RPlus<double, D, M> &tree, vector<Point> &data, unsigned seed) {
+  mt19937 generator(seed);
+  for (AttributePredicate &predicate : test_predicates()) {
+    vector<Point> matching;
+    for (Point &point : data) {
+      if (predicate.matches(point.get_attributes()))
+        matching.push_back(point);
+    }
+    for (size_t q(0); q < 30; ++q) {
+      HyperRectangle<double, D> W = random_window<D>(generator, 100.0, 30.0);
+      CHECK(ids_of(tree.search(W, predicate)) == brute_range(matching, W));
+      Point refdata = W.get_bottom_left();
+      vector<Point> nearest = tree.kNN_query(refdata, 10, predicate);
+      CHECK(same_kNN(matching, refdata, 10, nearest) && all_match(nearest, predicate));
+    }
+  }
+}
+
+template<size_t M>
+void test_filtered(size_t capacity) {
+  vector<Point> data = random_points<D>(4000, 47);
+  RPlus<double, D, M> tree;
+  tree.set_insertion_buffer(capacity);
+  tree.assign(data);//part of it stays in the buffers
+  check_filtered(tree, data, 49);
+  //erase a third and move another third with other attributes (the summaries only grow, they can't drop a match)
+  vector<Point> kept;
+  for (size_t i(0); i < data.size(); ++i) {
+    if (i % 3 == 0) {
+      CHECK(tree.erase(data[i]));
+    }
+    else if (i % 3 == 1) {
+      Point moved = data[i];
+      moved[1] = 100.0 - moved[1];
+      moved.set_attributes(SongAttributes(int16_t(2019 - i % 70), uint8_t(99 - i % 100), i % 2 == 0));
+      CHECK(tree.update(data[i], moved));
+      kept.push_back(moved);
+    }
+    else
+      kept.push_back(data[i]);
+  }
+  check_filtered(tree, kept, 51);
+}
+
+//Skyline: the brute force Pareto frontier (of the data in the window if there is one) for mixed preferences, and emit gives each point once
+bool dominates_point(Point &A, Point &B, const array<SkylinePreference, D> &preferences) {
+  bool better = false;
+  for (size_t i(0); i < D; ++i) {
+    if (preferences[i] == SKYLINE_IGNORE || A[i] == B[i])
+      continue;
+    if ((preferences[i] == SKYLINE_MIN) ? A[i] > B[i] : A[i] < B[i])
+      return false;
+    better = true;
+  }
+  return better;
+}
+
+multiset<string> brute_skyline(vector<Point> &data, const array<SkylinePreference, D> &preferences, const HyperRectangle<double, D> *W) {
+  vector<Point> candidates;
+  for (Point &point : data) {
+    if (!W || W->contains(point))
+      candidates.push_back(point);
+  }
+  multiset<string> ids;
+  for (Point &point : candidates) {
+    bool dominated = false;
+    for (size_t j(0); j < candidates.size() && !dominated; ++j)
+      dominated = dominates_point(candidates[j], point, preferences);
+    if (!dominated)
+      ids.insert(point.get_songs_name());
+  }
+  return ids;
+}
+
+template<size_t M>
+void test_skyline(size_t n, double grid, size_t capacity) {
+  vector<Point> data = random_points<D>(n, 53, 100.0, grid);
+  RPlus<double, D, M> tree;
+  tree.set_insertion_buffer(capacity);
+  tree.assign(data);
+  vector<array<SkylinePreference, D>> all_preferences = {
+    { SKYLINE_MIN, SKYLINE_MIN, SKYLINE_MIN, SKYLINE_MIN },
+    { SKYLINE_MAX, SKYLINE_MAX, SKYLINE_MAX, SKYLINE_MAX },
+    { SKYLINE_MIN, SKYLINE_MAX, SKYLINE_IGNORE, SKYLINE_MIN },
+    { SKYLINE_IGNORE, SKYLINE_IGNORE, SKYLINE_MAX, SKYLINE_IGNORE }//only one axis: the data with its greatest value
+  };
+  mt19937 generator(55);
+  for (array<SkylinePreference, D> &preferences : all_preferences) {
+    vector<Point> emitted;
+    vector<Point> frontier = tree.skyline(preferences, [&](const Point &point) { emitted.push_back(point); });
+    multiset<string> expected = brute_skyline(data, preferences, nullptr);
+    CHECK(ids_of(frontier) == expected && ids_of(emitted) == expected);
+    for (size_t q(0); q < 10; ++q) {
+      HyperRectangle<double, D> W = random_window<D>(generator, 100.0, 40.0);
+      emitted.clear();
+      frontier = tree.skyline(preferences, W, [&](const Point &point) { emitted.push_back(point); });
+      expected = brute_skyline(data, preferences, &W);
+      CHECK(ids_of(frontier) == expected && ids_of(emitted) == expected);
+    }
+  }
+  RPlus<double, D, M> empty_tree;
+  CHECK(empty_tree.skyline(all_preferences[0]).empty());
+}
+
+//Normalized axes: the answers are the data as it was given (same coordinates bit by bit, not reverted from the keys)
+bool exact_data(vector<Point> &data, vector<Point> result) {
+  for (Point &point : result) {
+    Point &given = data[stoul(point.get_songs_name())];
+    for (size_t i(0); i < D; ++i) {
+      if (point[i] != given[i])
+        return false;
+    }
+  }
+  return true;
+}
+
+void test_normalized() {
+  vector<Point> data = random_points<D>(3000, 23);
+  for (Point &point : data) {
+    point[1] = point[1] * 3137.77 + 0.1;//other units in each axis
+    point[2] = point[2] / 7.3 - 2.9;
+  }
+  AxisNormalization<double, D> normalization;
+  normalization.fit(data);
+  normalization.weight_axis(3, 1.7);
+  RPlus<double, D, 16> tree;
+  tree.set_normalization(normalization);
+  tree.assign(data);
+  mt19937 generator(25);
+  for (size_t q(0); q < 50; ++q) {
+    Point refdata = data[generator() % data.size()];
+    array<double, D> low, high;
+    for (size_t i(0); i < D; ++i) {
+      low[i] = refdata[i] - ((i == 1) ? 20000.0 : (i == 2) ? 3.0 : 20.0);
+      high[i] = refdata[i] + ((i == 1) ? 20000.0 : (i == 2) ? 3.0 : 20.0);
+    }
+    Point A(low), B(high);
+    HyperRectangle<double, D> W(A, B);
+    vector<Point> found = tree.search(W);
+    CHECK(ids_of(found) == brute_range(data, W) && exact_data(data, found));
+    vector<Point> nearest = tree.kNN_query(refdata, 10);
+    CHECK(nearest.size() == 10 && exact_data(data, nearest) && nearest[0][1] == refdata[1]);
+  }
+  Point found;
+  CHECK(tree.get_by_id("17", found) && exact_data(data, vector<Point>(1, found)));
+  CHECK(exact_data(data, tree.get_all_data()));
+  FrozenRPlus<double, D, L2Metric> frozen = tree.freeze();
+  CHECK(exact_data(data, frozen.kNN_query(data[5], 20)));
+}
+
+int main() {
+  test_insertion<4>(3000, 0.0);
+  test_insertion<16>(5000, 0.0);
+  test_insertion<8>(3000, 5.0);//many equal coordinates
+  test_buffered<16>(20000, 1024);
+  test_buffered<32>(20000, 2048);
+  test_buffered_joins();
+  test_repeated_ids<4>(0);
+  test_repeated_ids<16>(64);
+  test_filtered<8>(0);
+  test_filtered<16>(256);
+  test_skyline<8>(3000, 0.0, 0);
+  test_skyline<16>(3000, 5.0, 128);//ties: equal data are all in the skyline
+  test_normalized();
+  RPlus<double, D, 8> empty_tree;
+  CHECK(empty_tree.kNN_query(Point(), 3).empty());
+  return TEST_RESULT();
+}
@@ -0,0 +1,431 @@
+#include <rplus_test.hpp>
+#include <rplus_async.hpp>
+#include <rplus_cache.hpp>
+#include <rplus_maintenance.hpp>
+#include <rplus_pca.hpp>
+#include <rplus_pipeline.hpp>
+#include <rplus_planner.hpp>
+#include <rplus_sharded.hpp>
+#include <rplus_wal.hpp>
+
+#include <condition_variable>
+
+//Every front-end of the R+ against brute force (same answers as the plain tree)
+
+const size_t D = 4;
+typedef HyperPoint<double, D> Point;
+
+vector<Point> songs = random_points<D>(4000, 3);
+
+void test_durable() {
+  remove("test_durable.wal");
+  remove("test_durable.ckpt");
+  vector<Point> kept;
+  {
+    DurableRPlus<double, D, 16> durable("test_durable", 1500);
+    durable.open();
+    durable.assign(songs);
+    for (size_t i(0); i < songs.size(); ++i) {
+      if (i % 4 == 0)
+        CHECK(durable.erase(songs[i]));
+      else
+        kept.push_back(songs[i]);
+    }
+  }
+  DurableRPlus<double, D, 16> reopened("test_durable", 1500);
+  reopened.open();
+  mt19937 generator(5);
+  for (size_t q(0); q < 50; ++q) {
+    HyperRectangle<double, D> W = random_window<D>(generator, 100.0, 25.0);
+    CHECK(ids_of(reopened.search(W)) == brute_range(kept, W));
+  }
+  CHECK(reopened.get_tree().get_all_data().size() == kept.size());
+}
+
+//--LEGACY RECORD: a record of a log written before the format versions (points without attributes)--
+string legacy_record(uint8_t operation, const string &payload) {
+  string body(1, char(operation));
+  body += payload;
+  uint32_t length = uint32_t(body.size()), hash = 2166136261u;
+  for (char byte : body) {
+    hash ^= uint8_t(byte);
+    hash *= 16777619u;
+  }
+  string record(reinterpret_cast<const char *>(&length), sizeof(uint32_t));
+  record.append(reinterpret_cast<const char *>(&hash), sizeof(uint32_t));
+  return record + body;
+}
+
+void test_durable_legacy() {
+  remove("test_legacy.wal");
+  remove("test_legacy.ckpt");
+  vector<Point> old_songs(songs.begin(), songs.begin() + 500), new_songs(songs.begin() + 500, songs.begin() + 700);
+  {
+    uint64_t generation = 0;
+    string bytes = legacy_record(4, string(reinterpret_cast<const char *>(&generation), sizeof(uint64_t)));
+    for (Point &point : old_songs) {
+      string payload;
+      for (size_t i(0); i < D; ++i)
+        payload.append(reinterpret_cast<const char *>(&point[i]), sizeof(double));
+      string name = point.get_songs_name();
+      uint32_t name_length = uint32_t(name.size());
+      payload.append(reinterpret_cast<const char *>(&name_length), sizeof(uint32_t));
+      bytes += legacy_record(1, payload + name);
+    }
+    ofstream log("test_legacy.wal", ios::binary);
+    log << bytes;
+  }
+  {
+    DurableRPlus<double, D, 16> durable("test_legacy", 0);
+    durable.open();
+    CHECK(durable.get_replayed() == old_songs.size());
+    durable.assign(new_songs);
+  }
+  DurableRPlus<double, D, 16> reopened("test_legacy", 0);
+  reopened.open();
+  vector<Point> all_songs(songs.begin(), songs.begin() + 700);
+  CHECK(reopened.get_tree().get_all_data().size() == all_songs.size());
+  mt19937 generator(6);
+  for (size_t q(0); q < 50; ++q) {
+    HyperRectangle<double, D> W = random_window<D>(generator, 100.0, 30.0);
+    CHECK(ids_of(reopened.search(W)) == brute_range(all_songs, W));
+  }
+  Point found;
+  CHECK(reopened.get_tree().get_by_id(new_songs[0].get_songs_name(), found));
+  CHECK(found.get_attributes().year == new_songs[0].get_attributes().year);
+}
+
+void test_cached() {
+  CachedRPlus<double, D, 16> cached(64);
+  vector<Point> first(songs.begin(), songs.begin() + 2000), second(songs.begin() + 2000, songs.end());
+  cached.assign(first);
+  mt19937 generator(7);
+  vector<HyperRectangle<double, D>> windows;
+  for (size_t q(0); q < 20; ++q)
+    windows.push_back(random_window<D>(generator, 100.0, 25.0));
+  for (size_t round(0); round < 2; ++round) {
+    for (HyperRectangle<double, D> &W : windows)
+      CHECK(ids_of(cached.search(W)) == brute_range(first, W));
+  }
+  CHECK(cached.get_hit_ratio() > 0.0);
+  cached.assign(second);//the cached answers that see the new data are invalidated
+  for (HyperRectangle<double, D> &W : windows) {
+    CHECK(ids_of(cached.search(W)) == brute_range(songs, W));
+    Point refdata = W.get_top_right();
+    CHECK(same_kNN(songs, refdata, 5, cached.kNN_query(refdata, 5)));
+  }
+  //queries of several threads at the same time (the same keys too) and a write between them
+  vector<thread> readers;
+  for (size_t r(0); r < 3; ++r) {
+    readers.push_back(thread([&]() {
+      for (size_t round(0); round < 3; ++round) {
+        for (HyperRectangle<double, D> &W : windows)
+          CHECK(ids_of(cached.search(W)) == brute_range(songs, W));
+      }
+    }));
+  }
+  for (thread &reader : readers)
+    reader.join();
+  CHECK(cached.get_cached() <= 64);
+  Point moved = songs[0];
+  moved[0] = 100.0 - moved[0];
+  CHECK(cached.update(songs[0], moved));
+  vector<Point> after_update = songs;
+  after_update[0] = moved;
+  for (HyperRectangle<double, D> &W : windows)
+    CHECK(ids_of(cached.search(W)) == brute_range(after_update, W));
+}
+
+void test_async() {
+  RPlus<double, D, 16> tree;
+  tree.assign(songs);
+  AsyncRPlus<double, D, 16> executor(tree, 3);
+  mt19937 generator(9);
+  vector<HyperRectangle<double, D>> windows;
+  vector<future<QueryResult<double, D>>> answers;
+  for (size_t q(0); q < 50; ++q) {
+    windows.push_back(random_window<D>(generator, 100.0, 25.0));
+    answers.push_back(executor.search_async(windows.back()));
+  }
+  for (size_t q(0); q < answers.size(); ++q) {
+    QueryResult<double, D> result = answers[q].get();
+    CHECK(result.status == QUERY_OK);
+    CHECK(ids_of(result.data) == brute_range(songs, windows[q]));
+  }
+  QueryResult<double, D> nearest = executor.kNN_async(songs[0], 5).get();
+  CHECK(nearest.status == QUERY_OK && same_kNN(songs, songs[0], 5, nearest.data));
+  shared_ptr<QueryControl> cancelled = make_shared<QueryControl>();
+  cancelled->cancel();
+  CHECK(executor.search_async(windows[0], cancelled).get().status == QUERY_CANCELLED);
+  //bad arguments and errors of the tree come back as QUERY_FAILED, the process goes on
+  CHECK(executor.kNN_async(songs[0], 1ULL << 62).get().status == QUERY_FAILED);
+  Point nowhere = songs[0];
+  nowhere[1] = numeric_limits<double>::quiet_NaN();
+  CHECK(executor.kNN_async(nowhere, 5).get().status == QUERY_FAILED);
+  HyperRectangle<double, D> infinite_window(nowhere, nowhere);
+  CHECK(executor.search_async(infinite_window).get().status == QUERY_FAILED);
+  QueryResult<double, D> everything = executor.kNN_async(songs[0], ASYNC_MAX_K).get();
+  CHECK(everything.status == QUERY_OK && everything.data.size() == songs.size());
+  RPlus<double, D, 16> empty_tree;
+  AsyncRPlus<double, D, 16> empty_executor(empty_tree, 1);
+  QueryResult<double, D> nothing = empty_executor.kNN_async(songs[0], 3).get();
+  CHECK((nothing.status == QUERY_OK && nothing.data.empty()) || nothing.status == QUERY_FAILED);
+}
+
+void test_sharded() {
+  ShardedRPlus<double, D, 16> sharded(0, ShardedRPlus<double, D, 16>::quantile_cuts(songs, 0, 4));
+  sharded.assign(songs, 2);
+  mt19937 generator(11);
+  for (size_t q(0); q < 50; ++q) {
+    HyperRectangle<double, D> W = random_window<D>(generator, 100.0, 25.0);
+    CHECK(ids_of(sharded.search(W, 2)) == brute_range(songs, W));
+    Point refdata = W.get_bottom_left();
+    CHECK(same_kNN(songs, refdata, 7, sharded.kNN_query(refdata, 7, 2)));
+    CHECK(sharded.kNN_query(refdata, 0, 2).empty());
+  }
+}
+
+void test_planned() {
+  PlannedRPlus<double, D, 16> planned;
+  planned.assign(songs);
+  mt19937 generator(13);
+  size_t scans = 0;
+  for (double width : { 5.0, 60.0, 95.0 }) {
+    for (size_t q(0); q < 10; ++q) {
+      HyperRectangle<double, D> W = random_window<D>(generator, 100.0, width);
+      QueryStats stats;
+      CHECK(ids_of(planned.search(W, &stats)) == brute_range(songs, W));
+      scans += (stats.plan == PLAN_SCAN);
+      Point refdata = W.get_bottom_left();
+      CHECK(same_kNN(songs, refdata, 5, planned.kNN_query(refdata, 5)));
+    }
+  }
+  CHECK(scans > 0);
+  //with normalized axes both plans return the data as it was given, the columnar kNN scan with every metric
+  AxisNormalization<double, D> normalization;
+  normalization.fit(songs);
+  normalization.weight_axis(0, 2.5);
+  PlannedRPlus<double, D, 16> scanned, traversed;
+  PlannedRPlus<double, D, 16, 2, L1Metric> scanned_l1;
+  PlannedRPlus<double, D, 16, 2, LInfMetric> scanned_linf;
+  scanned.set_normalization(normalization);
+  traversed.set_normalization(normalization);
+  scanned.set_thresholds(0.0, 0.0);
+  traversed.set_thresholds(2.0, 2.0);
+  scanned_l1.set_thresholds(0.0, 0.0);
+  scanned_linf.set_thresholds(0.0, 0.0);
+  scanned.assign(songs);
+  traversed.assign(songs);
+  scanned_l1.assign(songs);
+  scanned_linf.assign(songs);
+  auto coordinates_of = [](vector<Point> result) {
+    multiset<pair<string, vector<double>>> rows;
+    for (Point &point : result)
+      rows.insert(make_pair(point.get_songs_name(), vector<double>{ point[0], point[1], point[2], point[3] }));
+    return rows;
+  };
+  for (size_t q(0); q < 20; ++q) {
+    HyperRectangle<double, D> W = random_window<D>(generator, 100.0, 40.0);
+    QueryStats scan_stats, tree_stats;
+    CHECK(coordinates_of(scanned.search(W, &scan_stats)) == coordinates_of(traversed.search(W, &tree_stats)));
+    CHECK(scan_stats.plan == PLAN_SCAN && tree_stats.plan == PLAN_TREE);
+    Point refdata = W.get_top_right();
+    CHECK(coordinates_of(scanned.kNN_query(refdata, 9)) == coordinates_of(traversed.kNN_query(refdata, 9)));
+    CHECK((same_kNN<D, L1Metric>(songs, refdata, 9, scanned_l1.kNN_query(refdata, 9))));
+    CHECK((same_kNN<D, LInfMetric>(songs, refdata, 9, scanned_linf.kNN_query(refdata, 9))));
+  }
+}
+
+void test_pipeline() {
+  stringstream csv;
+  csv << "name;a;year;b;c;popularity;d\n";
+  for (Point &point : songs)
+    csv << point.get_songs_name() << ';' << setprecision(17) << point[0] << ";2001;" << point[1] << ';' << point[2] << ";50;" << point[3] << '\n';
+  RPlus<double, D, 16> tree;
+  IngestionPipeline<double, D> pipeline(tree, vector<string>{ "name", "a", "b", "c", "d" }, "name", 2);
+  IngestionReport report = pipeline.run(csv);
+  CHECK(report.lines == songs.size() && report.inserted == songs.size());
+  mt19937 generator(15);
+  for (size_t q(0); q < 50; ++q) {
+    HyperRectangle<double, D> W = random_window<D>(generator, 100.0, 25.0);
+    vector<Point> found = tree.search(W);
+    CHECK(ids_of(found) == brute_range(songs, W));
+    for (Point &point : found)
+      CHECK(point.get_attributes().year == 2001 && point.get_attributes().popularity == 50);
+  }
+}
+
+//A feed that pauses (getline blocks): its lines reach the index before the feed goes on
+class PausedFeed : public streambuf {
+private:
+  mutex lock;
+  condition_variable more;
+  string waiting, current;
+  bool ended = false;
+
+protected:
+  int_type underflow() override {
+    unique_lock<mutex> guard(lock);
+    more.wait(guard, [this]() { return !waiting.empty() || ended; });
+    if (waiting.empty())
+      return traits_type::eof();
+    current.swap(waiting);
+    waiting.clear();
+    setg(&current[0], &current[0], &current[0] + current.size());
+    return traits_type::to_int_type(current[0]);
+  }
+
+public:
+  void feed(const string &text) {
+    lock_guard<mutex> guard(lock);
+    waiting += text;
+    more.notify_all();
+  }
+
+  void end() {
+    lock_guard<mutex> guard(lock);
+    ended = true;
+    more.notify_all();
+  }
+};
+
+struct CountingIndex {
+  mutex lock;
+  vector<string> ids;
+  void assign(vector<Point> &batch) {
+    lock_guard<mutex> guard(lock);
+    for (Point &point : batch)
+      ids.push_back(point.get_songs_name());
+  }
+  size_t size() {
+    lock_guard<mutex> guard(lock);
+    return ids.size();
+  }
+};
+
+void test_paused_pipeline() {
+  PausedFeed feed;
+  istream input(&feed);
+  CountingIndex index;
+  IngestionPipeline<double, D> pipeline(index, vector<string>{ "name", "a", "b", "c", "d" }, "name");
+  IngestionReport report;
+  thread runner([&]() { report = pipeline.run(input); });
+  feed.feed("name;a;b;c;d\n");
+  for (size_t part(0); part < 3; ++part) {
+    for (size_t i(0); i < 10; ++i)
+      feed.feed(to_string(part * 10 + i) + ";1;2;3;4\n");
+    chrono::time_point<chrono::steady_clock> start = chrono::steady_clock::now();
+    while (index.size() < 10 * (part + 1) && chrono::steady_clock::now() - start < chrono::seconds(5))
+      this_thread::sleep_for(chrono::milliseconds(1));
+    CHECK(index.size() == 10 * (part + 1));
+  }
+  feed.end();
+  runner.join();
+  CHECK(report.lines == 30 && report.inserted == 30);
+  for (size_t i(0); i < index.ids.size(); ++i)
+    CHECK(index.ids[i] == to_string(i));//in the order of the feed
+}
+
+//PCA reduced tree: the filter by the keys loses nothing, same answers as brute force in the full space (repeated ids too)
+void test_pca() {
+  const size_t F = 8;
+  typedef HyperPoint<double, F> FullPoint;
+  vector<HyperPoint<double, 3>> latent = random_points<3>(3000, 41);
+  vector<FullPoint> noise = random_points<F>(3200, 43, 5.0), data;
+  for (size_t i(0); i < noise.size(); ++i) {
+    array<double, F> raw;
+    for (size_t j(0); j < F; ++j)
+      raw[j] = latent[i % latent.size()][j % 3] * (1.0 + 0.25 * double(j)) + noise[i][j];
+    data.push_back(FullPoint(raw, to_string(i % latent.size())));//the last 200 repeat ids of the first ones
+  }
+  PCAReducedRPlus<double, F, 3, 16> reduced;
+  reduced.fit(data);
+  reduced.assign(data);
+  CHECK(reduced.get_explained_variance() > 0.9);
+  mt19937 generator(45);
+  for (size_t q(0); q < 50; ++q) {
+    FullPoint refdata = data[generator() % data.size()];
+    array<double, F> low, high;
+    for (size_t j(0); j < F; ++j) {
+      low[j] = refdata[j] - 30.0;
+      high[j] = refdata[j] + 30.0;
+    }
+    FullPoint A(low), B(high);
+    HyperRectangle<double, F> W(A, B);
+    CHECK(ids_of(reduced.search(W)) == brute_range(data, W));
+    refdata[0] += 3.0;
+    CHECK(same_kNN(data, refdata, 10, reduced.kNN_query(refdata, 10)));
+  }
+  CHECK(reduced.kNN_query(data[0], 0).empty());
+  CHECK(same_kNN(data, data[0], data.size(), reduced.kNN_query(data[0], data.size() + 5)));
+}
+
+void test_repacking() {
+  RPlus<double, D, 16> tree;
+  atomic<bool> done(false);
+  {
+    RepackingRPlus<double, D, 16> repacking(tree, RepackPolicy(), chrono::milliseconds(2));
+    thread reader([&]() {
+      mt19937 generator(17);
+      while (!done) {
+        HyperRectangle<double, D> W = random_window<D>(generator, 100.0, 10.0);
+        for (Point &point : repacking.search(W))
+          CHECK(W.contains(point));
+        this_thread::sleep_for(chrono::microseconds(200));
+      }
+    });
+    for (size_t i(0); i < songs.size(); i += 250) {
+      vector<Point> batch(songs.begin() + i, songs.begin() + min(songs.size(), i + 250));
+      repacking.assign(batch);
+    }
+    repacking.repack_now();
+    done = true;
+    reader.join();
+    CHECK(repacking.get_rounds() > 0);
+  }
+  mt19937 generator(19);
+  for (size_t q(0); q < 50; ++q) {
+    HyperRectangle<double, D> W = random_window<D>(generator, 100.0, 25.0);
+    CHECK(ids_of(tree.search(W)) == brute_range(songs, W));
+  }
+  for (Point &point : songs) {
+    Point found;
+    CHECK(tree.get_by_id(point.get_songs_name(), found));
+  }
+  //the read-only methods that aren't queries take the root once too, a repack may publish while they run
+  RPlus<double, D, 16> degraded;
+  for (size_t i(0); i < songs.size(); i += 2) {
+    vector<Point> pair_of_songs(songs.begin() + i, songs.begin() + min(songs.size(), i + 2));
+    degraded.assign(pair_of_songs);
+  }
+  for (size_t i(0); i < songs.size(); i += 3)
+    degraded.erase(songs[i]);
+  size_t kept = degraded.get_all_data().size();
+  RepackReport repacked;
+  thread maintainer([&]() { repacked = degraded.repack(); });
+  for (size_t round(0); round < 3; ++round) {
+    CHECK(degraded.get_all_data().size() == kept);
+    CHECK(degraded.freeze().get_size() == kept);
+    KNNGraph graph = degraded.all_kNN_graph(3, 2);
+    CHECK(graph.ids.size() == kept && graph.neighbors.size() == 3 * kept);
+    size_t pairs = 0;
+    degraded.kNN_join(degraded, 2, [&pairs](const string &, const string &, double) { ++pairs; }, 2);
+    CHECK(pairs == 2 * kept);
+  }
+  maintainer.join();
+  CHECK(degraded.get_all_data().size() == kept);
+}
+
+int main() {
+  test_durable();
+  test_durable_legacy();
+  test_cached();
+  test_async();
+  test_sharded();
+  test_planned();
+  test_pipeline();
+  test_paused_pipeline();
+  test_pca();
+  test_repacking();
+  return TEST_RESULT();
+}